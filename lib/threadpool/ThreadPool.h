@@ -1,6 +1,12 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <iterator>
 #include <vector>
 #include <queue>
 #include <memory>
@@ -19,46 +25,230 @@ public:
         ->std::future<typename std::result_of<F(Args...)>::type>;
     ~ThreadPool();
 
+    // Call f for every element of [begin, end) and wait for all of them, the calling thread takes part in the work.
+    // The range is split in halves down to chunks of a few elements, split off halves can be stolen by idle workers.
+    // Safe to call from inside a task of this pool, any number of levels deep.
     template<class It, class Func>
     void parallel_for(It begin, It end, Func f);
+
+    // Wait for a task of this pool and return its result.
+    // A worker of this pool runs other queued tasks while waiting instead of blocking, so tasks can wait for tasks
+    // they enqueued even when every worker is busy. Other threads simply block.
+    template<class T>
+    T wait(std::future<T>& future);
+
+    size_t size() const { return workers.size(); }
 private:
+    // Tasks pushed by a worker go to its own deque, the worker takes them from the back,
+    // idle workers steal from the front, where the biggest chunks of a parallel_for are
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque< std::function<void()> > tasks;
+    };
+
+    template<class It, class Func>
+    struct ParallelFor;
+
+    void push(std::function<void()> task);
+    bool tryPop(std::function<void()>& task);
+    void workerLoop(size_t index);
+
+    // On a worker of this pool run queued tasks until isDone() returns true, calling waitBriefly() when there are none.
+    // Returns false without doing anything on other threads.
+    template<class IsDone, class WaitBriefly>
+    bool helpUntil(IsDone isDone, WaitBriefly waitBriefly);
+
+    // how long a waiting worker blocks before it looks for queued tasks again
+    static constexpr std::chrono::microseconds helpInterval{ 200 };
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
+    std::vector< std::unique_ptr<WorkerQueue> > localQueues;
+    // the task queue for tasks enqueued from outside of the pool
+    std::deque< std::function<void()> > tasks;
 
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable condition;
     bool stop;
+    // number of tasks in all queues, only increased under queue_mutex so that no sleeping worker misses a task
+    std::atomic<size_t> queuedTasks;
+
+    // the pool and index of the worker running on this thread
+    inline static thread_local ThreadPool* currentPool = nullptr;
+    inline static thread_local size_t currentWorker = 0;
+};
+
+// State of a single parallel_for shared by all threads working on it
+template<class It, class Func>
+struct ThreadPool::ParallelFor
+{
+    // Part of the range split off to be stolen, it is run by whoever claims it first
+    struct Chunk
+    {
+        size_t first;
+        size_t last;
+        std::atomic<bool> claimed{ false };
+    };
+
+    It begin;
+    Func f;
+    size_t grain;
+
+    std::atomic<size_t> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+
+    ParallelFor(It b, Func func, size_t count, size_t threads)
+        : begin(b), f(std::move(func)), grain(std::max<size_t>(1, count / (8 * threads))), remaining(count) {}
+
+    // Split [first, last) until it is small enough, run it and then the split off chunks nobody stole
+    static void run(ThreadPool& pool, const std::shared_ptr<ParallelFor>& self, size_t first, size_t last)
+    {
+        std::vector< std::shared_ptr<Chunk> > spawned;
+        while (last - first > self->grain)
+        {
+            auto chunk = std::make_shared<Chunk>();
+            chunk->first = first + (last - first) / 2;
+            chunk->last = last;
+            last = chunk->first;
+
+            pool.push([&pool, self, chunk]() {
+                if (!chunk->claimed.exchange(true))
+                    run(pool, self, chunk->first, chunk->last);
+            });
+            spawned.push_back(std::move(chunk));
+        }
+
+        self->runElements(first, last);
+
+        // The smallest chunks were split off last
+        for (auto it = spawned.rbegin(); it != spawned.rend(); ++it)
+        {
+            if (!(*it)->claimed.exchange(true))
+                run(pool, self, (*it)->first, (*it)->last);
+        }
+    }
+
+    void runElements(size_t first, size_t last)
+    {
+        try
+        {
+            It it = std::next(begin, first);
+            for (size_t i = first; i < last; ++i, ++it)
+                f(*it);
+        }
+        catch (...)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+
+        // elements after an exception are skipped, they still count as finished
+        if (remaining.fetch_sub(last - first) == last - first)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
 };
 
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false)
+    : stop(false), queuedTasks(0)
 {
     for (size_t i = 0; i < threads; ++i)
-        workers.emplace_back(
-            [this]
+        localQueues.emplace_back(std::make_unique<WorkerQueue>());
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+inline void ThreadPool::workerLoop(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+    for (;;)
     {
-        for (;;)
+        std::function<void()> task;
+        if (tryPop(task))
         {
-            std::function<void()> task;
-
-            {
-                std::unique_lock<std::mutex> lock(this->queue_mutex);
-                this->condition.wait(lock,
-                    [this] { return this->stop || !this->tasks.empty(); });
-                if (this->stop && this->tasks.empty())
-                    return;
-                task = std::move(this->tasks.front());
-                this->tasks.pop();
-            }
-
             task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        this->condition.wait(lock,
+            [this] { return this->stop || this->queuedTasks > 0; });
+        if (this->stop && this->queuedTasks == 0)
+            return;
+    }
+}
+
+inline void ThreadPool::push(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+
+        // don't allow enqueueing after stopping the pool
+        if (stop && currentPool != this)
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+
+        // counted before the task is visible, so the count is never lower than the number of queued tasks
+        ++queuedTasks;
+        if (currentPool != this)
+            tasks.push_back(std::move(task));
+    }
+
+    if (currentPool == this)
+    {
+        WorkerQueue& queue = *localQueues[currentWorker];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    condition.notify_one();
+}
+
+// take a task from the back of own deque, the outside queue or steal from the front of another worker's deque
+inline bool ThreadPool::tryPop(std::function<void()>& task)
+{
+    const size_t queueCount = localQueues.size();
+    {
+        WorkerQueue& queue = *localQueues[currentWorker];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --queuedTasks;
+            return true;
         }
     }
-    );
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (!tasks.empty())
+        {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queueCount; ++i)
+    {
+        WorkerQueue& queue = *localQueues[(currentWorker + i) % queueCount];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
 }
 
 // add new work item to the pool
@@ -73,16 +263,7 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
         );
 
     std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-
-        // don't allow enqueueing after stopping the pool
-        if (stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
-
-        tasks.emplace([task]() { (*task)(); });
-    }
-    condition.notify_one();
+    push([task]() { (*task)(); });
     return res;
 }
 
@@ -101,13 +282,52 @@ inline ThreadPool::~ThreadPool()
 template<class It, class Func>
 void ThreadPool::parallel_for(It begin, It end, Func f)
 {
-    std::vector<std::future<void>> futures;
-    for (It it = begin; it != end; ++it)
+    const size_t count = static_cast<size_t>(std::distance(begin, end));
+    if (count == 0)
+        return;
+
+    using State = ParallelFor<It, Func>;
+    auto state = std::make_shared<State>(begin, std::move(f), count, workers.size() + 1);
+    State::run(*this, state, 0, count);
+
+    // Wait for the chunks stolen by other workers
+    const auto isDone = [&state] { return state->remaining == 0; };
+    const bool helped = helpUntil(isDone, [&state, &isDone] {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait_for(lock, helpInterval, isDone);
+    });
+    if (!helped)
     {
-        futures.emplace_back(enqueue(f, *it));
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, isDone);
     }
 
-    // Wait for all
-    std::for_each(futures.begin(), futures.end(), [](auto& f) { f.get(); });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+template<class T>
+T ThreadPool::wait(std::future<T>& future)
+{
+    helpUntil([&future] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; },
+              [&future] { future.wait_for(helpInterval); });
+    return future.get();
+}
+
+template<class IsDone, class WaitBriefly>
+bool ThreadPool::helpUntil(IsDone isDone, WaitBriefly waitBriefly)
+{
+    if (currentPool != this)
+        return false;
+
+    while (!isDone())
+    {
+        std::function<void()> task;
+        if (tryPop(task))
+            task();
+        else
+            waitBriefly();
+    }
+    return true;
 }
 #endif
@@ -0,0 +1,142 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+/// parallel_for as it used to be, one task and one future per element
+template <class It, class Func>
+void parallelForPerElement(ThreadPool& pool, It begin, It end, Func f) {
+    std::vector<std::future<void>> futures;
+    for(It it = begin; it != end; ++it) {
+        futures.emplace_back(pool.enqueue(f, *it));
+    }
+    std::for_each(futures.begin(), futures.end(), [](auto& future) { future.get(); });
+}
+
+}  // namespace
+
+TEST(ThreadPool, EnqueueReturnsResult) {
+    ThreadPool pool(2);
+    auto result = pool.enqueue([](int answer) { return answer; }, 42);
+    EXPECT_EQ(result.get(), 42);
+}
+
+TEST(ThreadPool, ParallelForVisitsEveryElementOnce) {
+    ThreadPool pool(3);
+    for(const size_t count : {0, 1, 7, 1000, 100000}) {
+        std::vector<size_t> indices(count);
+        std::iota(indices.begin(), indices.end(), 0);
+        std::vector<std::atomic<int>> visits(count);
+
+        pool.parallel_for(indices.begin(), indices.end(), [&visits](size_t i) { ++visits[i]; });
+
+        for(size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(visits[i], 1);
+        }
+    }
+}
+
+TEST(ThreadPool, ParallelForFromWorker) {
+    ThreadPool pool(2);
+    std::vector<size_t> indices(10000);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    std::atomic<size_t> sum{0};
+    pool.enqueue([&]() {
+            pool.parallel_for(indices.begin(), indices.end(), [&sum](size_t i) { sum += i; });
+        }).get();
+    EXPECT_EQ(sum, indices.size() * (indices.size() - 1) / 2);
+}
+
+TEST(ThreadPool, ParallelForRethrows) {
+    ThreadPool pool(2);
+    std::vector<int> values(1000, 0);
+    values[500] = 1;
+    EXPECT_THROW(pool.parallel_for(values.begin(), values.end(),
+                                   [](int value) {
+                                       if(value == 1) {
+                                           throw std::runtime_error("Test exception");
+                                       }
+                                   }),
+                 std::runtime_error);
+}
+
+TEST(ThreadPool, WaitInsideTaskOnSingleThread) {
+    /**
+     * Test that a task can wait for a task it enqueued even if it occupies the only worker
+     */
+
+    ThreadPool pool(1);
+    auto outer = pool.enqueue([&pool]() {
+        auto inner = pool.enqueue([]() { return 21; });
+        return 2 * pool.wait(inner);
+    });
+    EXPECT_EQ(pool.wait(outer), 42);
+}
+
+TEST(ThreadPool, NestedParallelForStress) {
+    /**
+     * Test that parallel_for nested three levels deep inside tasks, which all wait for their children, does not
+     * deadlock on a pool with 2 threads
+     */
+
+    ThreadPool pool(2);
+    std::vector<size_t> level(16);
+    std::iota(level.begin(), level.end(), 0);
+
+    for(int repetition = 0; repetition < 20; ++repetition) {
+        std::atomic<size_t> leafCount{0};
+        std::vector<std::future<void>> tasks;
+        for(int task = 0; task < 4; ++task) {
+            tasks.push_back(pool.enqueue([&]() {
+                pool.parallel_for(level.begin(), level.end(), [&](size_t) {
+                    pool.parallel_for(level.begin(), level.end(), [&](size_t) {
+                        auto child = pool.enqueue([&]() {
+                            pool.parallel_for(level.begin(), level.end(), [&](size_t) { ++leafCount; });
+                        });
+                        pool.wait(child);
+                    });
+                });
+            }));
+        }
+        for(auto& task : tasks) {
+            pool.wait(task);
+        }
+        ASSERT_EQ(leafCount, 4 * level.size() * level.size() * level.size());
+    }
+}
+
+TEST(ThreadPool, DISABLED_benchmarkParallelFor) {
+    ThreadPool pool(std::max<size_t>(3, std::thread::hardware_concurrency()) - 1);
+    for(const size_t count : {10000, 1000000}) {
+        std::vector<size_t> indices(count);
+        std::iota(indices.begin(), indices.end(), 0);
+        std::vector<size_t> output(count);
+        auto trivial = [&output](size_t i) { output[i] = 2 * i; };
+
+        const auto chunkedStart = std::chrono::high_resolution_clock::now();
+        pool.parallel_for(indices.begin(), indices.end(), trivial);
+        const auto chunkedEnd = std::chrono::high_resolution_clock::now();
+
+        const auto perElementStart = std::chrono::high_resolution_clock::now();
+        parallelForPerElement(pool, indices.begin(), indices.end(), trivial);
+        const auto perElementEnd = std::chrono::high_resolution_clock::now();
+
+        std::cout << "parallel_for over " << count << " trivial items took: "
+                  << std::chrono::duration<double, std::milli>(chunkedEnd - chunkedStart).count()
+                  << " ms chunked, "
+                  << std::chrono::duration<double, std::milli>(perElementEnd - perElementStart).count()
+                  << " ms with a task per item" << std::endl;
+    }
+}
+
+#endif
@@ -24,14 +24,23 @@ class CmdPaintBrush : public CommandBase<Geometry> {
     CmdPaintBrush(ci::Ray ray, const BrushSettings settings)
         : CommandBase(true, true), mRays{ray}, mSettings(settings) {}
 
+    size_t getMemoryBytes() const override {
+        return sizeof(CmdPaintBrush) + mRays.capacity() * sizeof(ci::Ray);
+    }
+
    protected:
     void run(Geometry& target) const override {
         const auto start = std::chrono::high_resolution_clock::now();
 
-        for(const ci::Ray& ray : mRays) {
-            if(mSettings.spherical) {
-                target.paintAreaWithSphere(ray, mSettings);
-            } else {
+        // The whole stroke is painted at once, so that each triangle is retriangulated only once
+        if(mSettings.spherical) {
+            target.paintAreaWithSpheres(mRays, mSettings);
+        } else {
+            std::vector<ci::Ray> shapeRays;
+            std::vector<std::vector<Point3>> shapes;
+            shapeRays.reserve(mRays.size());
+            shapes.reserve(mRays.size());
+            for(const ci::Ray& ray : mRays) {
                 glm::vec3 ro = ray.getOrigin();
                 glm::vec3 rd = ray.getDirection();
                 if(mSettings.alignToNormal) {
@@ -40,16 +49,17 @@ class CmdPaintBrush : public CommandBase<Geometry> {
                         continue;
                     }
 
-                    rd = -target.getTriangle(*intersection).getNormal();
+                    rd = -target.getTriangleNormal(*intersection);
                 }
 
                 // Create a shape to paint with
                 const Vector3 rayDirectionVector(rd.x, rd.y, rd.z);
                 const Circle circle(Point3(ro.x, ro.y, ro.z), mSettings.size * mSettings.size, rayDirectionVector);
-                const std::vector<Point3> circlePoints = GeometryUtils::pointsOnCircle(circle, mSettings.segments);
-
-                target.paintWithShape(ray, circlePoints, mSettings.color, mSettings.paintBackfaces);
+                shapeRays.push_back(ray);
+                shapes.push_back(GeometryUtils::pointsOnCircle(circle, mSettings.segments));
             }
+
+            target.paintWithShapes(shapeRays, shapes, mSettings.color, mSettings.paintBackfaces);
         }
 
         const auto end = std::chrono::high_resolution_clock::now();
@@ -31,6 +31,10 @@ class CmdPaintSingleColor : public CommandBase<Geometry> {
         }
     }
 
+    size_t getMemoryBytes() const override {
+        return sizeof(CmdPaintSingleColor) + mTriangleIds.capacity() * sizeof(DetailedTriangleId);
+    }
+
    protected:
     void run(Geometry& target) const override {
         for(DetailedTriangleId triangleId : mTriangleIds) {
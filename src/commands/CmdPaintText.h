@@ -32,6 +32,14 @@ class CmdPaintText : public CommandBase<Geometry> {
         }
     }
 
+    size_t getMemoryBytes() const override {
+        size_t bytes = sizeof(CmdPaintText) + mText.capacity() * sizeof(std::vector<Triangle>);
+        for(const std::vector<Triangle>& letter : mText) {
+            bytes += letter.capacity() * sizeof(Triangle);
+        }
+        return bytes;
+    }
+
    protected:
     void run(Geometry& target) const override {
         const auto start = std::chrono::high_resolution_clock::now();
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <string>
 
 namespace pepr3d {
@@ -32,6 +33,11 @@ class CommandBase {
         return mCanBeJoined;
     }
 
+    /// Approximate memory held by this command. Commands that keep dynamic data should include it.
+    virtual size_t getMemoryBytes() const {
+        return sizeof(CommandBase);
+    }
+
    protected:
     /// Run the command, applying the modifications to the target
     virtual void run(Target& target) const = 0;
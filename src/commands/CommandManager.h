@@ -1,6 +1,15 @@
 #pragma once
+#include <cereal/archives/binary.hpp>
+#include <cinder/Log.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <istream>
 #include <memory>
+#include <ostream>
 #include <stdexcept>
+#include <streambuf>
+#include <string>
 #include <type_traits>
 #include <vector>
 #include "commands/Command.h"
@@ -8,6 +17,22 @@
 
 namespace pepr3d {
 
+/// Detects states that can report their memory via getMemoryBytes() and getMemoryBytesExcluding(const State&)
+template <typename State, typename = void>
+struct HasSharedMemory : std::false_type {};
+
+template <typename State>
+struct HasSharedMemory<State, std::void_t<decltype(std::declval<const State&>().getMemoryBytes()),
+                                          decltype(std::declval<const State&>().getMemoryBytesExcluding(
+                                              std::declval<const State&>()))>> : std::true_type {};
+
+/// Detects states that can be spilled to a binary cereal archive
+template <typename State>
+struct IsSpillableState
+    : std::bool_constant<std::is_default_constructible<State>::value &&
+                         cereal::traits::is_output_serializable<State, cereal::BinaryOutputArchive>::value &&
+                         cereal::traits::is_input_serializable<State, cereal::BinaryInputArchive>::value> {};
+
 /// CommandManager handles all undoable operations on target in the form of commands See @see
 /// CommandBase. All commands must be executed via the CommandManager Requirements for Target: Target
 /// must have a saveState() and loadState(State) methods
@@ -50,15 +75,124 @@ class CommandManager {
         return mVersion;
     }
 
+    /// Approximate memory held by the history, all commands and snapshots.
+    /// Data shared between snapshots is counted once if the state reports it via getMemoryBytesExcluding().
+    /// Snapshots spilled to the disk are not counted, they are limited by the spill budget instead.
+    size_t getHistoryMemoryBytes() const {
+        return mCommandHistory.capacity() * sizeof(std::unique_ptr<CommandBaseType>) + mCommandMemoryBytes +
+               mTargetSnapshots.capacity() * sizeof(SnapshotPair) + mSnapshotMemoryBytes;
+    }
+
+    /// Limit memory of the history, 0 means unlimited.
+    /// When the budget is exceeded the oldest snapshots are spilled to a temporary file (if the state is
+    /// serializable) and read back on deep undo. The file never grows over spillBudgetBytes, 0 disables spilling.
+    /// To make room in it, the oldest spilled snapshots are folded away with the commands before the next snapshot.
+    /// If spilling is not enough, the oldest snapshots still in memory are dropped. Only when no such snapshot is
+    /// left, the commands before the oldest snapshot are folded into the next one, so that they can no longer be
+    /// undone.
+    void setMemoryBudget(size_t budgetBytes, size_t spillBudgetBytes = 0);
+
+    size_t getMemoryBudget() const {
+        return mMemoryBudget;
+    }
+
+    size_t getSpillBudget() const {
+        return mSpillBudget;
+    }
+
+    /// Used size of the spill file, at most getSpillBudget()
+    uint64_t getSpillFileBytes() const {
+        return mSpillFileEnd;
+    }
+
    private:
     Target& mTarget;
     /// Executed and possibly future commands
     std::vector<std::unique_ptr<CommandBaseType>> mCommandHistory;
 
+    /// Closes the spill file, temporary files are deleted by that
+    struct SpillFileCloser {
+        void operator()(std::FILE* file) const {
+            std::fclose(file);
+        }
+    };
+
+    /// Unbuffered stream over a FILE, so that cereal reads and writes the spill file directly
+    class SpillStreamBuf : public std::streambuf {
+       public:
+        explicit SpillStreamBuf(std::FILE* file) : mFile(file) {}
+
+       protected:
+        std::streamsize xsputn(const char* data, std::streamsize count) override {
+            return static_cast<std::streamsize>(std::fwrite(data, 1, static_cast<size_t>(count), mFile));
+        }
+
+        int_type overflow(int_type ch) override {
+            if(traits_type::eq_int_type(ch, traits_type::eof())) {
+                return traits_type::not_eof(ch);
+            }
+            return std::fputc(ch, mFile) == EOF ? traits_type::eof() : ch;
+        }
+
+        std::streamsize xsgetn(char* data, std::streamsize count) override {
+            return static_cast<std::streamsize>(std::fread(data, 1, static_cast<size_t>(count), mFile));
+        }
+
+        int_type underflow() override {
+            const int ch = std::fgetc(mFile);
+            return ch == EOF || std::ungetc(ch, mFile) == EOF ? traits_type::eof() : ch;
+        }
+
+        int_type uflow() override {
+            const int ch = std::fgetc(mFile);
+            return ch == EOF ? traits_type::eof() : ch;
+        }
+
+       private:
+        std::FILE* mFile;
+    };
+
+    /// Stream that only counts the written bytes, used to size the spill file range before writing
+    class CountingStreamBuf : public std::streambuf {
+       public:
+        uint64_t getSize() const {
+            return mSize;
+        }
+
+       protected:
+        std::streamsize xsputn(const char*, std::streamsize count) override {
+            mSize += static_cast<uint64_t>(count);
+            return count;
+        }
+
+        int_type overflow(int_type ch) override {
+            if(!traits_type::eq_int_type(ch, traits_type::eof())) {
+                ++mSize;
+            }
+            return traits_type::not_eof(ch);
+        }
+
+       private:
+        uint64_t mSize = 0;
+    };
+
+    /// Byte range [offset, offset + size) of the spill file
+    struct SpillRange {
+        uint64_t offset;
+        uint64_t size;
+    };
+
     /// Saved states of the target and commandId after them
     struct SnapshotPair {
         StateType state;
         size_t nextCommandIdx;
+
+        /// Memory of the state not shared with the previous snapshot
+        size_t memoryBytes = 0;
+
+        /// Set when the state was moved into spillRange of the spill file, the range is released with the snapshot
+        bool isSpilled = false;
+        SpillRange spillRange = {0, 0};
     };
 
     std::vector<SnapshotPair> mTargetSnapshots;
@@ -69,6 +203,66 @@ class CommandManager {
     /// Cumulative version number which gets incremented every single time a command is executed or Undo/Redo is done
     size_t mVersion = 0;
 
+    /// Maximum memory of the history in bytes, 0 for unlimited
+    size_t mMemoryBudget = 0;
+
+    /// Maximum size of the spill file in bytes, 0 disables spilling
+    size_t mSpillBudget = 0;
+
+    /// Temporary file shared by all spilled snapshots, created on the first spill
+    std::unique_ptr<std::FILE, SpillFileCloser> mSpillFile;
+
+    /// Released ranges before mSpillFileEnd, sorted by offset and never adjacent to each other
+    std::vector<SpillRange> mSpillFreeRanges;
+
+    /// End of the last range in use, the file is never written past mSpillBudget
+    uint64_t mSpillFileEnd = 0;
+
+    /// Sum of getMemoryBytes() of all commands in mCommandHistory
+    size_t mCommandMemoryBytes = 0;
+
+    /// Sum of memoryBytes of all snapshots in mTargetSnapshots
+    size_t mSnapshotMemoryBytes = 0;
+
+    /// Load snapshot into the target, reading it from the spill file if needed
+    void loadSnapshot(const SnapshotPair& snapshot);
+
+    static bool seekSpillFile(std::FILE* file, uint64_t offset);
+
+    /// Find room for size bytes in the spill file, reusing released ranges first
+    /// @return false if the file would have to grow over mSpillBudget
+    bool allocateSpillRange(uint64_t size, SpillRange& range);
+
+    /// Return a range of the spill file, merging it with its free neighbours
+    void releaseSpillRange(const SpillRange& range);
+
+    /// Compute memoryBytes of a snapshot, relative to the previous one if it is still in memory
+    void updateSnapshotMemory(size_t snapshotIdx);
+
+    /// Erase snapshots [first, last), releasing their spill file ranges
+    void eraseSnapshots(size_t first, size_t last);
+
+    /// Erase commands [first, last) without touching the snapshots
+    void eraseCommands(size_t first, size_t last);
+
+    /// Spill or evict the oldest snapshots until the history fits into mMemoryBudget
+    void enforceMemoryBudget();
+
+    /// Move the oldest in-memory snapshot (except the last one) into the spill file, folding the oldest spilled
+    /// snapshots if the file would not fit into mSpillBudget otherwise
+    /// @return false if there is nothing to spill or spilling failed
+    bool spillOldestSnapshot();
+
+    /// Drop the oldest in-memory snapshot (except the last one), the commands after it are replayed from the
+    /// previous snapshot instead. If there is no previous snapshot or all snapshots but the last one are spilled,
+    /// the oldest snapshot is folded away.
+    /// @return false if there is only a single snapshot left or folding the commands could not meet the budget
+    bool evictOldestSnapshot();
+
+    /// Remove the oldest snapshot together with all commands before the next one
+    /// @return false if there is only a single snapshot left or the commands are not all undone past
+    bool foldOldestSnapshot();
+
     void clearFutureState();
 
     /// Get snapshot before current state
@@ -118,13 +312,17 @@ void CommandManager<Target>::execute(std::unique_ptr<CommandBaseType>&& command,
         if(shouldSaveState()) {
             const size_t nextCommandIdx = mCommandHistory.size() - mPosFromEnd;
             mTargetSnapshots.push_back({mTarget.saveState(), nextCommandIdx});
+            updateSnapshotMemory(mTargetSnapshots.size() - 1);
         }
 
         command->run(mTarget);
+        mCommandMemoryBytes += command->getMemoryBytes();
         mCommandHistory.emplace_back(std::move(command));
     } else {
         command->run(mTarget);
     }
+
+    enforceMemoryBudget();
 }
 
 template <typename Target>
@@ -137,7 +335,7 @@ void CommandManager<Target>::undo() {
 
     mPosFromEnd++;
     auto prevSnapshotIt = getPrevSnapshotIterator();
-    mTarget.loadState(prevSnapshotIt->state);
+    loadSnapshot(*prevSnapshotIt);
 
     // Execute all commands between last snapshot and desired state
     for(size_t i = prevSnapshotIt->nextCommandIdx; i < mCommandHistory.size() - mPosFromEnd; i++) {
@@ -158,7 +356,7 @@ void CommandManager<Target>::redo() {
         // Try to restore future snapshot to avoid doing a slow command again
         auto nextSnapshotIt = std::next(getPrevSnapshotIterator());
         if(nextSnapshotIt != mTargetSnapshots.end()) {
-            mTarget.loadState(nextSnapshotIt->state);
+            loadSnapshot(*nextSnapshotIt);
         } else {
             mCommandHistory[nextCommandIdx]->run(mTarget);
         }
@@ -170,6 +368,291 @@ void CommandManager<Target>::redo() {
     mPosFromEnd--;
 }
 
+template <typename Target>
+void CommandManager<Target>::setMemoryBudget(size_t budgetBytes, size_t spillBudgetBytes) {
+    mMemoryBudget = budgetBytes;
+    mSpillBudget = IsSpillableState<StateType>::value ? spillBudgetBytes : 0;
+
+    // Spilled snapshots over a lowered spill budget are folded as long as they are not needed for the undo position
+    while(mSpillFileEnd > mSpillBudget && !mTargetSnapshots.empty() && mTargetSnapshots[0].isSpilled) {
+        if(!foldOldestSnapshot()) {
+            break;
+        }
+    }
+
+    enforceMemoryBudget();
+}
+
+template <typename Target>
+void CommandManager<Target>::loadSnapshot(const SnapshotPair& snapshot) {
+    if(!snapshot.isSpilled) {
+        mTarget.loadState(snapshot.state);
+        return;
+    }
+
+    if constexpr(IsSpillableState<StateType>::value) {
+        P_ASSERT(mSpillFile);
+        if(!seekSpillFile(mSpillFile.get(), snapshot.spillRange.offset)) {
+            throw std::runtime_error("Failed to read an undo snapshot from the temporary file");
+        }
+
+        SpillStreamBuf buffer(mSpillFile.get());
+        std::istream stream(&buffer);
+        StateType state;
+        try {
+            cereal::BinaryInputArchive archive(stream);
+            archive(state);
+        } catch(const cereal::Exception&) {
+            throw std::runtime_error("Failed to read an undo snapshot from the temporary file");
+        }
+        mTarget.loadState(state);
+    } else {
+        P_ASSERT(false);  // Only spillable states are ever spilled
+    }
+}
+
+template <typename Target>
+bool CommandManager<Target>::seekSpillFile(std::FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+template <typename Target>
+bool CommandManager<Target>::allocateSpillRange(uint64_t size, SpillRange& range) {
+    // First fit, the snapshots are spilled oldest first so the holes usually match in size
+    for(auto it = mSpillFreeRanges.begin(); it != mSpillFreeRanges.end(); ++it) {
+        if(it->size >= size) {
+            range = {it->offset, size};
+            it->offset += size;
+            it->size -= size;
+            if(it->size == 0) {
+                mSpillFreeRanges.erase(it);
+            }
+            return true;
+        }
+    }
+
+    if(size > mSpillBudget || mSpillFileEnd > mSpillBudget - size) {
+        return false;
+    }
+    range = {mSpillFileEnd, size};
+    mSpillFileEnd += size;
+    return true;
+}
+
+template <typename Target>
+void CommandManager<Target>::releaseSpillRange(const SpillRange& range) {
+    P_ASSERT(range.offset + range.size <= mSpillFileEnd);
+    auto it = std::lower_bound(mSpillFreeRanges.begin(), mSpillFreeRanges.end(), range,
+                               [](const SpillRange& a, const SpillRange& b) { return a.offset < b.offset; });
+    it = mSpillFreeRanges.insert(it, range);
+
+    // Merge with the following and the preceding free range
+    if(std::next(it) != mSpillFreeRanges.end() && it->offset + it->size == std::next(it)->offset) {
+        it->size += std::next(it)->size;
+        mSpillFreeRanges.erase(std::next(it));
+    }
+    if(it != mSpillFreeRanges.begin() && std::prev(it)->offset + std::prev(it)->size == it->offset) {
+        std::prev(it)->size += it->size;
+        it = std::prev(mSpillFreeRanges.erase(it));
+    }
+
+    // A free range at the end shrinks the used part of the file instead
+    if(it->offset + it->size == mSpillFileEnd) {
+        mSpillFileEnd = it->offset;
+        mSpillFreeRanges.erase(it);
+    }
+}
+
+template <typename Target>
+void CommandManager<Target>::updateSnapshotMemory(size_t snapshotIdx) {
+    P_ASSERT(snapshotIdx < mTargetSnapshots.size());
+    SnapshotPair& snapshot = mTargetSnapshots[snapshotIdx];
+    mSnapshotMemoryBytes -= snapshot.memoryBytes;
+    snapshot.memoryBytes = 0;  // Spilled snapshots and states without shared memory are counted in sizeof(SnapshotPair)
+
+    if constexpr(HasSharedMemory<StateType>::value) {
+        if(snapshot.isSpilled) {
+            return;
+        }
+        if(snapshotIdx > 0 && !mTargetSnapshots[snapshotIdx - 1].isSpilled) {
+            snapshot.memoryBytes = snapshot.state.getMemoryBytesExcluding(mTargetSnapshots[snapshotIdx - 1].state);
+        } else {
+            snapshot.memoryBytes = snapshot.state.getMemoryBytes();
+        }
+        mSnapshotMemoryBytes += snapshot.memoryBytes;
+    }
+}
+
+template <typename Target>
+void CommandManager<Target>::eraseSnapshots(size_t first, size_t last) {
+    P_ASSERT(first <= last && last <= mTargetSnapshots.size());
+    for(size_t i = first; i < last; ++i) {
+        mSnapshotMemoryBytes -= mTargetSnapshots[i].memoryBytes;
+        if(mTargetSnapshots[i].isSpilled) {
+            releaseSpillRange(mTargetSnapshots[i].spillRange);
+        }
+    }
+    mTargetSnapshots.erase(mTargetSnapshots.begin() + first, mTargetSnapshots.begin() + last);
+
+    // The snapshot after the erased ones now follows a different one
+    if(first < last && first < mTargetSnapshots.size()) {
+        updateSnapshotMemory(first);
+    }
+}
+
+template <typename Target>
+void CommandManager<Target>::eraseCommands(size_t first, size_t last) {
+    P_ASSERT(first <= last && last <= mCommandHistory.size());
+    for(size_t i = first; i < last; ++i) {
+        mCommandMemoryBytes -= mCommandHistory[i]->getMemoryBytes();
+    }
+    mCommandHistory.erase(mCommandHistory.begin() + first, mCommandHistory.begin() + last);
+}
+
+template <typename Target>
+void CommandManager<Target>::enforceMemoryBudget() {
+    if(mMemoryBudget == 0) {
+        return;
+    }
+
+    while(getHistoryMemoryBytes() > mMemoryBudget) {
+        if(mSpillBudget > 0 && spillOldestSnapshot()) {
+            continue;
+        }
+        if(!evictOldestSnapshot()) {
+            break;  // Only the latest snapshot is left, keep at least that
+        }
+    }
+}
+
+template <typename Target>
+bool CommandManager<Target>::spillOldestSnapshot() {
+    if constexpr(IsSpillableState<StateType>::value) {
+        // Spilled snapshots always form a prefix of the history
+        const auto findOldestInMemory = [this]() {
+            size_t snapshotIdx = 0;
+            while(snapshotIdx < mTargetSnapshots.size() && mTargetSnapshots[snapshotIdx].isSpilled) {
+                ++snapshotIdx;
+            }
+            return snapshotIdx;
+        };
+        if(findOldestInMemory() + 1 >= mTargetSnapshots.size()) {
+            return false;  // Never spill the latest snapshot
+        }
+
+        if(!mSpillFile) {
+            mSpillFile.reset(std::tmpfile());
+            if(!mSpillFile) {
+                CI_LOG_E("Failed to create a temporary file for the undo history, spilling to the disk is disabled");
+                mSpillBudget = 0;
+                return false;
+            }
+        }
+
+        // Size the state first, so that it can be serialized right into its place in the file
+        CountingStreamBuf counter;
+        {
+            std::ostream stream(&counter);
+            cereal::BinaryOutputArchive archive(stream);
+            archive(mTargetSnapshots[findOldestInMemory()].state);
+        }
+
+        // Make room by folding the oldest spilled snapshots, they are the least likely to be undone to
+        SpillRange range;
+        while(!allocateSpillRange(counter.getSize(), range)) {
+            if(!mTargetSnapshots[0].isSpilled || !foldOldestSnapshot()) {
+                return false;
+            }
+        }
+
+        const size_t snapshotIdx = findOldestInMemory();
+        SnapshotPair& snapshot = mTargetSnapshots[snapshotIdx];
+        bool written = seekSpillFile(mSpillFile.get(), range.offset);
+        if(written) {
+            SpillStreamBuf buffer(mSpillFile.get());
+            std::ostream stream(&buffer);
+            try {
+                cereal::BinaryOutputArchive archive(stream);
+                archive(snapshot.state);
+                written = std::fflush(mSpillFile.get()) == 0;
+            } catch(const cereal::Exception&) {
+                written = false;
+            }
+        }
+        if(!written) {
+            releaseSpillRange(range);
+            CI_LOG_E("Failed to write an undo snapshot to the temporary file, spilling to the disk is disabled");
+            mSpillBudget = 0;
+            return false;
+        }
+
+        snapshot.isSpilled = true;
+        snapshot.spillRange = range;
+        snapshot.state = StateType();
+        updateSnapshotMemory(snapshotIdx);
+        updateSnapshotMemory(snapshotIdx + 1);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+template <typename Target>
+bool CommandManager<Target>::evictOldestSnapshot() {
+    if(mTargetSnapshots.size() < 2) {
+        return false;
+    }
+
+    // Spilled snapshots hold no memory, drop the oldest one that does
+    size_t snapshotIdx = 0;
+    while(snapshotIdx + 1 < mTargetSnapshots.size() && mTargetSnapshots[snapshotIdx].isSpilled) {
+        ++snapshotIdx;
+    }
+
+    if(snapshotIdx > 0 && snapshotIdx + 1 < mTargetSnapshots.size()) {
+        // Commands after the dropped snapshot are still reachable from the previous one
+        eraseSnapshots(snapshotIdx, snapshotIdx + 1);
+        return true;
+    }
+
+    // Nothing but the oldest snapshot can go, take the commands before the next snapshot with it
+    if(mTargetSnapshots[0].isSpilled) {
+        // Only the commands can be freed now, do not throw away the history if even all of them would not do
+        size_t retainedCommandBytes = 0;
+        for(size_t i = mTargetSnapshots.back().nextCommandIdx; i < mCommandHistory.size(); ++i) {
+            retainedCommandBytes += mCommandHistory[i]->getMemoryBytes();
+        }
+        if(getHistoryMemoryBytes() - (mCommandMemoryBytes - retainedCommandBytes) > mMemoryBudget) {
+            return false;
+        }
+    }
+
+    return foldOldestSnapshot();
+}
+
+template <typename Target>
+bool CommandManager<Target>::foldOldestSnapshot() {
+    if(mTargetSnapshots.size() < 2) {
+        return false;
+    }
+
+    const size_t foldedCommands = mTargetSnapshots[1].nextCommandIdx;
+    if(foldedCommands > mCommandHistory.size() - mPosFromEnd) {
+        return false;  // The target is at a state before the next snapshot
+    }
+
+    eraseCommands(0, foldedCommands);
+    eraseSnapshots(0, 1);
+    for(SnapshotPair& snapshot : mTargetSnapshots) {
+        snapshot.nextCommandIdx -= foldedCommands;
+    }
+    return true;
+}
+
 template <typename Target>
 bool CommandManager<Target>::canUndo() const {
     return mCommandHistory.size() > mPosFromEnd;
@@ -201,11 +684,12 @@ const typename CommandManager<Target>::CommandBaseType& CommandManager<Target>::
 template <typename Target>
 void CommandManager<Target>::clearFutureState() {
     if(mPosFromEnd > 0) {
-        // Clear all future snapshots
-        mTargetSnapshots.erase(std::next(getPrevSnapshotIterator()), mTargetSnapshots.end());
+        // Clear all future snapshots, releasing their spill file ranges
+        const size_t firstFutureSnapshot = std::next(getPrevSnapshotIterator()) - mTargetSnapshots.begin();
+        eraseSnapshots(firstFutureSnapshot, mTargetSnapshots.size());
 
         // Clear all future commands
-        mCommandHistory.erase(std::prev(mCommandHistory.end(), mPosFromEnd), mCommandHistory.end());
+        eraseCommands(mCommandHistory.size() - mPosFromEnd, mCommandHistory.size());
 
         mPosFromEnd = 0;
     }
@@ -228,10 +712,13 @@ bool CommandManager<Target>::joinWithLastCommand(CommandBaseType& command) {
     if(!canUndo() || !getLastCommand().canBeJoined())
         return false;
 
+    const size_t lastCommandBytes = getLastCommand().getMemoryBytes();
     if(getLastCommand().joinCommand(command)) {
+        mCommandMemoryBytes = mCommandMemoryBytes - lastCommandBytes + getLastCommand().getMemoryBytes();
+
         // If the command that got modified has a valid snapshot in front of it destroy it
         if(getNumOfCommandsSinceSnapshot() == 0) {
-            mTargetSnapshots.erase(std::prev(mTargetSnapshots.end()), mTargetSnapshots.end());
+            eraseSnapshots(mTargetSnapshots.size() - 1, mTargetSnapshots.size());
         }
         return true;
     } else {
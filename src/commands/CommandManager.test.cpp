@@ -1,6 +1,7 @@
 #include "commands/CommandManager.h"
 #ifdef _TEST_
 #include <gtest/gtest.h>
+#include <cereal/types/vector.hpp>
 #include <vector>
 
 namespace pepr3d {
@@ -349,5 +350,206 @@ TEST(CommandManager, JoinRemovesSnapshot) {
     EXPECT_EQ(target.mInnerValue, 11);
 }
 
+TEST(CommandManager, MemoryBudgetEviction) {
+    /**
+     * Test that the oldest history is dropped when over the budget and the rest can still be undone and redone
+     */
+
+    MockTarget unboundedTarget;
+    CommandManager<MockTarget> unbounded(unboundedTarget);
+    const int maxSteps = 10 * CommandManager<MockTarget>::SNAPSHOT_FREQUENCY;
+    for(int i = 0; i < maxSteps; i++) {
+        unbounded.execute(make_unique<CmdAddValue>(1));
+    }
+
+    MockTarget target;
+    CommandManager<MockTarget> cm(target);
+    const size_t budget = unbounded.getHistoryMemoryBytes() / 2;
+    cm.setMemoryBudget(budget);
+    for(int i = 0; i < maxSteps; i++) {
+        cm.execute(make_unique<CmdAddValue>(1));
+        EXPECT_LE(cm.getHistoryMemoryBytes(), budget);
+    }
+    EXPECT_EQ(target.mInnerValue, maxSteps);
+
+    // Only the retained window can be undone
+    int undone = 0;
+    while(cm.canUndo()) {
+        cm.undo();
+        undone++;
+        EXPECT_EQ(target.mInnerValue, maxSteps - undone);
+    }
+    EXPECT_GT(undone, 0);
+    EXPECT_LT(undone, maxSteps);
+
+    while(cm.canRedo()) {
+        cm.redo();
+    }
+    EXPECT_EQ(target.mInnerValue, maxSteps);
+}
+
+/// State reporting a large memory footprint, so that it gets spilled
+struct MockBigState {
+    int value = 0;
+    std::vector<char> payload;
+
+    size_t getMemoryBytes() const {
+        return payload.capacity();
+    }
+
+    size_t getMemoryBytesExcluding(const MockBigState&) const {
+        return getMemoryBytes();
+    }
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(value, payload);
+    }
+};
+
+struct MockBigTarget {
+    int mInnerValue = 0;
+
+    MockBigState saveState() const {
+        return MockBigState{mInnerValue, std::vector<char>(1000, 'x')};
+    }
+
+    void loadState(const MockBigState& state) {
+        EXPECT_EQ(state.payload.size(), 1000);
+        mInnerValue = state.value;
+    }
+};
+
+class CmdAddBigValueSlow : public CommandBase<MockBigTarget> {
+   public:
+    virtual std::string_view getDescription() const override {
+        return "IncreaseVal";
+    }
+
+    explicit CmdAddBigValueSlow(int addedValue = 1) : CommandBase(true), mAddedValue(addedValue) {}
+
+   protected:
+    virtual void run(MockBigTarget& target) const override {
+        target.mInnerValue += mAddedValue;
+    }
+
+    int mAddedValue;
+};
+
+TEST(CommandManager, MemoryBudgetSpill) {
+    /**
+     * Test that snapshots over the budget are spilled to the disk and read back on deep undo
+     */
+
+    MockBigTarget target;
+    CommandManager<MockBigTarget> cm(target);
+    const size_t budget = 20000;
+    cm.setMemoryBudget(budget, size_t(1) << 20);
+
+    const int maxSteps = 100;
+    for(int i = 0; i < maxSteps; i++) {
+        cm.execute(make_unique<CmdAddBigValueSlow>(1));
+        EXPECT_LE(cm.getHistoryMemoryBytes(), budget);
+    }
+
+    // Nothing was evicted, the whole history can be undone and redone
+    for(int i = maxSteps - 1; i >= 0; i--) {
+        ASSERT_TRUE(cm.canUndo());
+        cm.undo();
+        EXPECT_EQ(target.mInnerValue, i);
+    }
+    EXPECT_FALSE(cm.canUndo());
+
+    for(int i = 1; i <= maxSteps; i++) {
+        ASSERT_TRUE(cm.canRedo());
+        cm.redo();
+        EXPECT_EQ(target.mInnerValue, i);
+    }
+    EXPECT_FALSE(cm.canRedo());
+
+    // Clear the future behind a spilled snapshot and continue from there
+    for(int i = 0; i < maxSteps / 2; i++) {
+        cm.undo();
+    }
+    cm.execute(make_unique<CmdAddBigValueSlow>(1000));
+    EXPECT_EQ(target.mInnerValue, maxSteps / 2 + 1000);
+    EXPECT_FALSE(cm.canRedo());
+
+    cm.undo();
+    EXPECT_EQ(target.mInnerValue, maxSteps / 2);
+    while(cm.canUndo()) {
+        cm.undo();
+    }
+    EXPECT_EQ(target.mInnerValue, 0);
+}
+
+TEST(CommandManager, MemoryBudgetSpillCap) {
+    /**
+     * Test that the spill file stays within its budget and the history is folded instead
+     */
+
+    MockBigTarget target;
+    CommandManager<MockBigTarget> cm(target);
+    const size_t budget = 20000;
+    const size_t spillBudget = 10000;
+    cm.setMemoryBudget(budget, spillBudget);
+
+    const int maxSteps = 100;
+    for(int i = 0; i < maxSteps; i++) {
+        cm.execute(make_unique<CmdAddBigValueSlow>(1));
+        EXPECT_LE(cm.getHistoryMemoryBytes(), budget);
+        EXPECT_LE(cm.getSpillFileBytes(), spillBudget);
+    }
+    EXPECT_GT(cm.getSpillFileBytes(), 0);
+
+    // Only the latest states are retained, all of them can still be restored
+    int undone = 0;
+    while(cm.canUndo()) {
+        cm.undo();
+        ++undone;
+        EXPECT_EQ(target.mInnerValue, maxSteps - undone);
+    }
+    EXPECT_LT(undone, maxSteps);
+
+    // Lowering the spill budget folds the spilled snapshots only once they are not needed anymore
+    cm.setMemoryBudget(budget, 0);
+    EXPECT_GT(cm.getSpillFileBytes(), 0);
+    while(cm.canRedo()) {
+        cm.redo();
+    }
+    EXPECT_EQ(target.mInnerValue, maxSteps);
+    cm.setMemoryBudget(budget, 0);
+    EXPECT_EQ(cm.getSpillFileBytes(), 0);
+
+    int retained = 0;
+    while(cm.canUndo()) {
+        cm.undo();
+        ++retained;
+        EXPECT_EQ(target.mInnerValue, maxSteps - retained);
+    }
+    EXPECT_LT(retained, undone);
+}
+
+TEST(CommandManager, MemoryBudgetBelowSingleSnapshot) {
+    /**
+     * Test that the spilled history is kept when the latest snapshot alone does not fit into the budget
+     */
+
+    MockBigTarget target;
+    CommandManager<MockBigTarget> cm(target);
+    cm.setMemoryBudget(500, size_t(1) << 20);
+
+    const int maxSteps = 50;
+    for(int i = 0; i < maxSteps; i++) {
+        cm.execute(make_unique<CmdAddBigValueSlow>(1));
+    }
+
+    for(int i = maxSteps - 1; i >= 0; i--) {
+        ASSERT_TRUE(cm.canUndo());
+        cm.undo();
+        EXPECT_EQ(target.mInnerValue, i);
+    }
+}
+
 }  // namespace pepr3d
 #endif
@@ -13,14 +13,17 @@ template <typename Progress>
 class AssimpProgress : public Assimp::ProgressHandler {
     Progress* mProgress;
 
+    /// Assimp progress is multiplied by this, so that the import can be only a part of the reported progress
+    float mScale;
+
    public:
-    AssimpProgress(Progress* progress) : mProgress(progress) {}
+    AssimpProgress(Progress* progress, float scale = 1.0f) : mProgress(progress), mScale(scale) {}
 
     /// Sets the progress to a certain value, usually -1 means unknown progress / not started yet, 0 means start of a
     /// progress and 1 means finished
     virtual bool Update(float percentage = -1.f) override {
         if(mProgress != nullptr) {
-            *mProgress = percentage;
+            *mProgress = percentage < 0.f ? percentage : percentage * mScale;
         }
         return true;
     }
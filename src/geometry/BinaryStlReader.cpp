@@ -0,0 +1,262 @@
+#include "geometry/BinaryStlReader.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cinder/Log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "geometry/ModelImporter.h"
+#include "geometry/VertexWelder.h"
+
+namespace pepr3d {
+
+namespace {
+/// STL is little endian, as are all platforms we build for, so the values can be copied as they are.
+/// Facets are 50 bytes long, memcpy avoids unaligned reads.
+template <typename T>
+T readValue(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+glm::vec3 readVec3(const char* data) {
+    return glm::vec3(readValue<float>(data), readValue<float>(data + 4), readValue<float>(data + 8));
+}
+
+/// Expand a 5 bit color channel to 8 bits
+uint32_t expandChannel(uint32_t channel) {
+    return (channel << 3) | (channel >> 2);
+}
+
+uint32_t packColor(uint32_t r, uint32_t g, uint32_t b) {
+    return (r << 16) | (g << 8) | b;
+}
+}  // namespace
+
+bool BinaryStlReader::isBinaryStl(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file) {
+        return false;
+    }
+    const auto fileSize = static_cast<uint64_t>(file.tellg());
+    if(fileSize < sHeaderSize + sizeof(uint32_t)) {
+        return false;
+    }
+
+    file.seekg(sHeaderSize);
+    uint32_t facetCount = 0;
+    file.read(reinterpret_cast<char*>(&facetCount), sizeof(facetCount));
+    if(!file) {
+        return false;
+    }
+
+    // ASCII files starting with "solid" are matched here only if their size happens to match as well, same as in Assimp
+    return facetCount > 0 && fileSize == sHeaderSize + sizeof(uint32_t) + sFacetSize * uint64_t(facetCount);
+}
+
+uint32_t BinaryStlReader::decodeColor(uint16_t attributes, bool isMaterialise, uint32_t defaultColor) {
+    const bool colorBit = (attributes & 0x8000) != 0;
+    const uint32_t low = expandChannel(attributes & 0x1F);
+    const uint32_t middle = expandChannel((attributes >> 5) & 0x1F);
+    const uint32_t high = expandChannel((attributes >> 10) & 0x1F);
+
+    if(isMaterialise) {
+        // Materialise Magics: bit 15 set means the facet uses the default color from the header, RGB from low bits
+        return colorBit ? defaultColor : packColor(low, middle, high);
+    } else {
+        // VisCAM and SolidView: bit 15 set means the color is valid, BGR from low bits
+        return colorBit ? packColor(high, middle, low) : sNoColor;
+    }
+}
+
+void BinaryStlReader::readChunk(const char* facets, bool isMaterialise, uint32_t defaultColor, Chunk& chunk) {
+    const size_t facetCount = chunk.endFacet - chunk.beginFacet;
+    VertexWelder welder(facetCount / 2 + 3);
+    chunk.indices.reserve(facetCount);
+    chunk.colors.reserve(facetCount);
+    chunk.isNormalFlipped.reserve(facetCount);
+    std::unordered_set<uint32_t> seenColors;
+
+    for(size_t i = chunk.beginFacet; i < chunk.endFacet; ++i) {
+        const char* facet = facets + i * sFacetSize;
+        const std::array<glm::vec3, 3> triangle = {readVec3(facet + 12), readVec3(facet + 24), readVec3(facet + 36)};
+
+        /// Check for degenerate triangles which we do not want in the representation
+        if(ModelImporter::zeroAreaCheck(triangle)) {
+            continue;
+        }
+
+        chunk.indices.push_back(
+            {welder.addVertex(triangle[0]), welder.addVertex(triangle[1]), welder.addVertex(triangle[2])});
+
+        // The normal is recalculated from the vertices and only oriented by the stored facet normal, which is often
+        // imprecise or zero
+        const glm::vec3 faceNormal = glm::cross(triangle[1] - triangle[0], triangle[2] - triangle[0]);
+        chunk.isNormalFlipped.push_back(glm::dot(faceNormal, readVec3(facet)) < 0.0f);
+
+        const uint32_t color = decodeColor(readValue<uint16_t>(facet + 48), isMaterialise, defaultColor);
+        chunk.colors.push_back(color);
+        if(seenColors.insert(color).second) {
+            chunk.distinctColors.push_back(color);
+        }
+    }
+
+    chunk.vertices = welder.takeVertices();
+}
+
+BinaryStlReader::Mesh BinaryStlReader::read(const std::string& path, GeometryProgress* progress,
+                                            ::ThreadPool& threadPool) {
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    try {
+        file = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+        region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+    } catch(const boost::interprocess::interprocess_exception& e) {
+        CI_LOG_E("Failed to map " + path + ": " + e.what());
+        throw std::runtime_error("Failed to map " + path + ": " + e.what());
+    }
+    region.advise(boost::interprocess::mapped_region::advice_sequential);
+
+    const char* data = static_cast<const char*>(region.get_address());
+    const size_t dataSize = region.get_size();
+    if(dataSize < sHeaderSize + sizeof(uint32_t)) {
+        CI_LOG_E("Binary STL file " + path + " is too short");
+        throw std::runtime_error("Binary STL file " + path + " is too short");
+    }
+    const size_t facetCount = readValue<uint32_t>(data + sHeaderSize);
+    if(dataSize < sHeaderSize + sizeof(uint32_t) + facetCount * sFacetSize) {
+        CI_LOG_E("Binary STL file " + path + " is truncated");
+        throw std::runtime_error("Binary STL file " + path + " is truncated");
+    }
+    const char* facets = data + sHeaderSize + sizeof(uint32_t);
+
+    // Materialise Magics stores the default color in the header as "COLOR=" followed by RGBA bytes
+    const std::string header(data, sHeaderSize);
+    const size_t colorPosition = header.find("COLOR=");
+    const bool isMaterialise = colorPosition != std::string::npos && colorPosition + 10 <= sHeaderSize;
+    uint32_t defaultColor = sNoColor;
+    if(isMaterialise) {
+        const auto* rgb = reinterpret_cast<const unsigned char*>(data + colorPosition + 6);
+        defaultColor = packColor(rgb[0], rgb[1], rgb[2]);
+    }
+
+    // Enough chunks to balance the load on all threads, each big enough to outweigh the duplicates on its boundaries
+    const size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const size_t chunkCount = std::max<size_t>(std::min(4 * threadCount, facetCount / sMinChunkFacets), 1);
+    std::vector<Chunk> chunks(chunkCount);
+    for(size_t i = 0; i < chunkCount; ++i) {
+        chunks[i].beginFacet = facetCount * i / chunkCount;
+        chunks[i].endFacet = facetCount * (i + 1) / chunkCount;
+    }
+
+    std::vector<size_t> chunkIndices(chunkCount);
+    std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+
+    /// Read and weld every chunk on its own
+    std::atomic<size_t> chunksRead{0};
+    threadPool.parallel_for(chunkIndices.begin(), chunkIndices.end(), [&](const size_t chunkIdx) {
+        readChunk(facets, isMaterialise, defaultColor, chunks[chunkIdx]);
+        if(progress != nullptr) {
+            progress->importRenderPercentage = static_cast<float>(++chunksRead) / chunkCount;
+        }
+    });
+
+    /// Join the chunks in their order, so that the result does not depend on the scheduling
+    Mesh mesh;
+    size_t triangleCount = 0;
+    size_t localVertexCount = 0;
+    bool hasColors = false;
+    for(Chunk& chunk : chunks) {
+        chunk.firstTriangle = triangleCount;
+        triangleCount += chunk.indices.size();
+        localVertexCount += chunk.vertices.size();
+        hasColors |= std::any_of(chunk.distinctColors.begin(), chunk.distinctColors.end(),
+                                 [](const uint32_t color) { return color != sNoColor; });
+    }
+    if(facetCount > triangleCount) {
+        CI_LOG_W("Omitted " + std::to_string(facetCount - triangleCount) +
+                 " triangles with zero surface area from geometry data.");
+    }
+
+    VertexWelder welder(localVertexCount);
+    for(Chunk& chunk : chunks) {
+        chunk.globalVertices.reserve(chunk.vertices.size());
+        for(const glm::vec3& vertex : chunk.vertices) {
+            chunk.globalVertices.push_back(welder.addVertex(vertex));
+        }
+        chunk.vertices.clear();
+        chunk.vertices.shrink_to_fit();
+    }
+    mesh.vertexBuffer = welder.takeVertices();
+
+    // Palette in the order in which the colors appear in the file, facets without a color are gray
+    std::unordered_map<uint32_t, size_t> paletteLookup;
+    std::vector<glm::vec4> paletteColors;
+    if(hasColors) {
+        for(const Chunk& chunk : chunks) {
+            for(const uint32_t color : chunk.distinctColors) {
+                if(paletteLookup.find(color) != paletteLookup.end()) {
+                    continue;
+                }
+                if(paletteColors.size() < PEPR3D_MAX_PALETTE_COLORS) {
+                    paletteColors.push_back(color == sNoColor ? glm::vec4(0.6f, 0.6f, 0.6f, 1.0f)
+                                                              : unpackColor(color));
+                }
+                // Colors over the palette limit end up as the last color of the palette
+                paletteLookup.emplace(color, paletteColors.size() - 1);
+            }
+        }
+        mesh.palette = ColorManager(paletteColors.begin(), paletteColors.end());
+    }
+
+    if(progress != nullptr) {
+        progress->importComputePercentage = 0.5f;
+    }
+
+    /// Write out triangles and indices of every chunk into its own range of the result
+    mesh.triangles.resize(triangleCount);
+    mesh.indexBuffer.resize(triangleCount);
+    std::atomic<size_t> chunksWritten{0};
+    threadPool.parallel_for(chunkIndices.begin(), chunkIndices.end(), [&](const size_t chunkIdx) {
+        Chunk& chunk = chunks[chunkIdx];
+        for(size_t i = 0; i < chunk.indices.size(); ++i) {
+            std::array<size_t, 3>& indices = mesh.indexBuffer[chunk.firstTriangle + i];
+            std::array<glm::vec3, 3> vertices;
+            for(size_t j = 0; j < 3; ++j) {
+                indices[j] = chunk.globalVertices[chunk.indices[i][j]];
+                vertices[j] = mesh.vertexBuffer[indices[j]];
+            }
+
+            const glm::vec3 faceNormal =
+                glm::normalize(glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]));
+            const glm::vec3 normal = chunk.isNormalFlipped[i] ? -faceNormal : faceNormal;
+            const size_t color = hasColors ? paletteLookup.at(chunk.colors[i]) : 0;
+            mesh.triangles.set(chunk.firstTriangle + i, vertices[0], vertices[1], vertices[2], normal, color);
+        }
+
+        chunk = Chunk();
+        if(progress != nullptr) {
+            progress->importComputePercentage = 0.5f + 0.5f * static_cast<float>(++chunksWritten) / chunkCount;
+        }
+    });
+
+    if(progress != nullptr) {
+        progress->importRenderPercentage = 1.0f;
+        progress->importComputePercentage = 1.0f;
+    }
+
+    return mesh;
+}
+
+}  // namespace pepr3d
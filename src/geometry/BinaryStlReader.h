@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+#include "geometry/ColorManager.h"
+#include "geometry/GeometryProgress.h"
+#include "geometry/TriangleStore.h"
+
+namespace pepr3d {
+
+/// Reads binary STL files straight from a memory mapped file, bypassing the Assimp scene graph.
+/// The triangle soup, the welded vertex and index buffers and the color palette are built in a single pass over the
+/// file, split into chunks that are read and welded in parallel.
+/// Per-face colors are taken from the attribute bytes, in both the VisCAM/SolidView and the Materialise Magics
+/// (header containing "COLOR=") conventions.
+class BinaryStlReader {
+   public:
+    /// Everything read from the file, the i-th index triple belongs to the i-th triangle
+    struct Mesh {
+        TriangleStore triangles;
+        std::vector<glm::vec3> vertexBuffer;
+        std::vector<std::array<size_t, 3>> indexBuffer;
+        ColorManager palette;
+    };
+
+    /// Is the file a binary STL, i.e. does its size match the triangle count in its header
+    static bool isBinaryStl(const std::string& path);
+
+    /// Read a binary STL file. Throws std::runtime_error if the file cannot be read.
+    static Mesh read(const std::string& path, GeometryProgress* progress, ::ThreadPool& threadPool);
+
+   private:
+    static const size_t sHeaderSize = 80;
+
+    /// Normal, 3 vertices and 2 attribute bytes
+    static const size_t sFacetSize = 50;
+
+    /// Smallest number of facets worth reading as a separate chunk
+    static const size_t sMinChunkFacets = 1 << 16;
+
+    /// Facet color before it is mapped into the palette, packed 8 bit RGB or sNoColor
+    static const uint32_t sNoColor = 0xFFFFFFFF;
+
+    /// Facets welded and colored independently of the other chunks
+    struct Chunk {
+        size_t beginFacet = 0;
+        size_t endFacet = 0;
+
+        /// Unique vertices of this chunk
+        std::vector<glm::vec3> vertices;
+
+        /// Non-degenerate facets as indices into vertices
+        std::vector<std::array<size_t, 3>> indices;
+
+        /// Packed color of every non-degenerate facet
+        std::vector<uint32_t> colors;
+
+        /// Does the stored normal of the facet point against its vertex winding
+        std::vector<bool> isNormalFlipped;
+
+        /// Distinct colors in the order of their first appearance
+        std::vector<uint32_t> distinctColors;
+
+        /// Position of the first triangle of this chunk in the final mesh
+        size_t firstTriangle = 0;
+
+        /// Index into the final vertex buffer of every vertex in vertices
+        std::vector<size_t> globalVertices;
+    };
+
+    /// Read, weld and color all facets of the chunk
+    static void readChunk(const char* facets, bool isMaterialise, uint32_t defaultColor, Chunk& chunk);
+
+    /// Decode the color from facet attribute bytes
+    static uint32_t decodeColor(uint16_t attributes, bool isMaterialise, uint32_t defaultColor);
+
+    static glm::vec4 unpackColor(uint32_t packedColor) {
+        return glm::vec4(((packedColor >> 16) & 0xFF) / 255.0f, ((packedColor >> 8) & 0xFF) / 255.0f,
+                         (packedColor & 0xFF) / 255.0f, 1.0f);
+    }
+};
+
+}  // namespace pepr3d
@@ -0,0 +1,185 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/BinaryStlReader.h"
+#include "ui/MainApplication.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace pepr3d {
+
+/// Facet of a binary STL file, vertices, attribute bytes and the stored normal
+struct StlFacet {
+    std::array<glm::vec3, 3> vertices;
+    uint16_t attributes;
+    glm::vec3 normal = glm::vec3(0.f);
+};
+
+void writeBinaryStl(const std::string& path, const std::string& headerText, const std::vector<StlFacet>& facets) {
+    std::ofstream file(path, std::ios::binary);
+    std::array<char, 80> header{};
+    std::memcpy(header.data(), headerText.data(), std::min(headerText.size(), header.size()));
+    file.write(header.data(), header.size());
+
+    const uint32_t facetCount = static_cast<uint32_t>(facets.size());
+    file.write(reinterpret_cast<const char*>(&facetCount), sizeof(facetCount));
+    for(const StlFacet& facet : facets) {
+        file.write(reinterpret_cast<const char*>(&facet.normal.x), sizeof(float) * 3);
+        for(const glm::vec3& vertex : facet.vertices) {
+            file.write(reinterpret_cast<const char*>(&vertex.x), sizeof(float) * 3);
+        }
+        file.write(reinterpret_cast<const char*>(&facet.attributes), sizeof(facet.attributes));
+    }
+}
+
+/// Grid of 2 * quadsPerSide^2 facets in the XZ plane, facet i gets attributes[i % attributes.size()]
+std::vector<StlFacet> getGridFacets(const size_t quadsPerSide, const std::vector<uint16_t>& attributes) {
+    std::vector<StlFacet> facets;
+    const float step = 1.f / static_cast<float>(quadsPerSide);
+    for(size_t x = 0; x < quadsPerSide; ++x) {
+        for(size_t z = 0; z < quadsPerSide; ++z) {
+            const glm::vec3 a(x * step, 0, z * step);
+            const glm::vec3 b((x + 1) * step, 0, z * step);
+            const glm::vec3 c((x + 1) * step, 0, (z + 1) * step);
+            const glm::vec3 d(x * step, 0, (z + 1) * step);
+            facets.push_back({{a, d, b}, attributes[facets.size() % attributes.size()]});
+            facets.push_back({{b, d, c}, attributes[facets.size() % attributes.size()]});
+        }
+    }
+    return facets;
+}
+
+TEST(BinaryStlReader, DetectsBinaryStl) {
+    const std::string binaryPath = "binaryStlReaderDetect.stl";
+    writeBinaryStl(binaryPath, "solid but binary", getGridFacets(2, {0}));
+    EXPECT_TRUE(BinaryStlReader::isBinaryStl(binaryPath));
+    std::remove(binaryPath.c_str());
+
+    const std::string asciiPath = "binaryStlReaderDetectAscii.stl";
+    {
+        std::ofstream file(asciiPath);
+        file << "solid test\n"
+                "facet normal 0 0 1\nouter loop\nvertex 0 0 0\nvertex 1 0 0\nvertex 0 1 0\nendloop\nendfacet\n"
+                "endsolid test\n";
+    }
+    EXPECT_FALSE(BinaryStlReader::isBinaryStl(asciiPath));
+    std::remove(asciiPath.c_str());
+
+    EXPECT_FALSE(BinaryStlReader::isBinaryStl("binaryStlReaderMissing.stl"));
+}
+
+TEST(BinaryStlReader, WeldsAndSkipsDegenerate) {
+    const std::string path = "binaryStlReaderWeld.stl";
+    const size_t quadsPerSide = 600;  // several chunks
+    std::vector<StlFacet> facets = getGridFacets(quadsPerSide, {0});
+    facets.insert(facets.begin() + facets.size() / 2,
+                  StlFacet{{glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), glm::vec3(1, 0, 0)}, 0});
+    writeBinaryStl(path, "", facets);
+
+    GeometryProgress progress;
+    const BinaryStlReader::Mesh mesh = BinaryStlReader::read(path, &progress, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+
+    EXPECT_EQ(progress.importRenderPercentage, 1.0f);
+    EXPECT_EQ(progress.importComputePercentage, 1.0f);
+    ASSERT_EQ(mesh.triangles.size(), 2 * quadsPerSide * quadsPerSide);
+    ASSERT_EQ(mesh.indexBuffer.size(), mesh.triangles.size());
+    EXPECT_EQ(mesh.vertexBuffer.size(), (quadsPerSide + 1) * (quadsPerSide + 1));
+
+    // No colors in the file, default palette
+    EXPECT_EQ(mesh.palette.size(), ColorManager().size());
+
+    // Triangles keep the file order and match the welded buffers
+    for(size_t i = 0; i < mesh.triangles.size(); ++i) {
+        const size_t facetIdx = i < facets.size() / 2 ? i : i + 1;
+        EXPECT_EQ(mesh.triangles[i].getColor(), 0);
+        EXPECT_NEAR(mesh.triangles[i].getNormal().y, 1.0f, 1e-6f);
+        for(size_t j = 0; j < 3; ++j) {
+            ASSERT_LT(mesh.indexBuffer[i][j], mesh.vertexBuffer.size());
+            ASSERT_EQ(mesh.vertexBuffer[mesh.indexBuffer[i][j]], mesh.triangles[i].getVertex(j));
+            ASSERT_EQ(mesh.triangles[i].getVertex(j), facets[facetIdx].vertices[j]);
+        }
+    }
+}
+
+TEST(BinaryStlReader, OrientsByStoredNormals) {
+    const std::string path = "binaryStlReaderNormals.stl";
+    std::vector<StlFacet> facets = getGridFacets(2, {0});
+    facets[0].normal = glm::vec3(0.f, -1.f, 0.f);
+    facets[1].normal = glm::vec3(0.1f, 0.9f, 0.f);
+    writeBinaryStl(path, "", facets);
+
+    const BinaryStlReader::Mesh mesh = BinaryStlReader::read(path, nullptr, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+
+    // Vertices stay as they are, only the normal follows the stored one
+    ASSERT_EQ(mesh.triangles.size(), facets.size());
+    EXPECT_NEAR(mesh.triangles[0].getNormal().y, -1.0f, 1e-6f);
+    EXPECT_NEAR(mesh.triangles[1].getNormal().y, 1.0f, 1e-6f);
+    EXPECT_NEAR(mesh.triangles[2].getNormal().y, 1.0f, 1e-6f);
+    EXPECT_EQ(mesh.triangles[0].getVertex(0), facets[0].vertices[0]);
+}
+
+TEST(BinaryStlReader, VisCamColors) {
+    const std::string path = "binaryStlReaderVisCam.stl";
+    const uint16_t red = 0x8000 | (31 << 10);
+    const uint16_t blue = 0x8000 | 31;
+    const uint16_t noColor = 0x7FFF;
+    writeBinaryStl(path, "", getGridFacets(4, {red, blue, noColor}));
+
+    const BinaryStlReader::Mesh mesh = BinaryStlReader::read(path, nullptr, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+
+    ASSERT_EQ(mesh.palette.size(), 3);
+    EXPECT_EQ(mesh.palette.getColor(0), glm::vec4(1, 0, 0, 1));
+    EXPECT_EQ(mesh.palette.getColor(1), glm::vec4(0, 0, 1, 1));
+    EXPECT_EQ(mesh.palette.getColor(2), glm::vec4(0.6f, 0.6f, 0.6f, 1));
+    for(size_t i = 0; i < mesh.triangles.size(); ++i) {
+        EXPECT_EQ(mesh.triangles[i].getColor(), i % 3);
+    }
+}
+
+TEST(BinaryStlReader, MaterialiseColors) {
+    const std::string path = "binaryStlReaderMaterialise.stl";
+    const uint16_t red = 31;
+    const uint16_t defaultColor = 0x8000;
+    const std::string header = std::string("COLOR=") + char(0) + char(255) + char(0) + char(255);
+    writeBinaryStl(path, header, getGridFacets(4, {defaultColor, red}));
+
+    const BinaryStlReader::Mesh mesh = BinaryStlReader::read(path, nullptr, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+
+    ASSERT_EQ(mesh.palette.size(), 2);
+    EXPECT_EQ(mesh.palette.getColor(0), glm::vec4(0, 1, 0, 1));
+    EXPECT_EQ(mesh.palette.getColor(1), glm::vec4(1, 0, 0, 1));
+    for(size_t i = 0; i < mesh.triangles.size(); ++i) {
+        EXPECT_EQ(mesh.triangles[i].getColor(), i % 2);
+    }
+}
+
+TEST(BinaryStlReader, PaletteLimit) {
+    const std::string path = "binaryStlReaderPaletteLimit.stl";
+    std::vector<uint16_t> attributes;
+    for(uint16_t i = 0; i < PEPR3D_MAX_PALETTE_COLORS + 4; ++i) {
+        attributes.push_back(0x8000 | i);
+    }
+    writeBinaryStl(path, "", getGridFacets(8, attributes));
+
+    const BinaryStlReader::Mesh mesh = BinaryStlReader::read(path, nullptr, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+
+    ASSERT_EQ(mesh.palette.size(), PEPR3D_MAX_PALETTE_COLORS);
+    for(size_t i = 0; i < mesh.triangles.size(); ++i) {
+        EXPECT_EQ(mesh.triangles[i].getColor(), std::min<size_t>(i % attributes.size(), PEPR3D_MAX_PALETTE_COLORS - 1));
+    }
+}
+
+}  // namespace pepr3d
+#endif
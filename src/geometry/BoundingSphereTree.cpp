@@ -0,0 +1,83 @@
+#include "geometry/BoundingSphereTree.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace pepr3d {
+
+void BoundingSphereTree::build(const std::vector<Bound>& bounds) {
+    clear();
+    if(bounds.empty()) {
+        return;
+    }
+
+    mIndices.resize(bounds.size());
+    std::iota(mIndices.begin(), mIndices.end(), 0);
+
+    // A binary tree with leaves of at least half the leaf size
+    mNodes.reserve(4 * (bounds.size() / sLeafSize + 1));
+    buildNode(bounds, 0, bounds.size());
+}
+
+size_t BoundingSphereTree::buildNode(const std::vector<Bound>& bounds, const size_t begin, const size_t end) {
+    P_ASSERT(begin < end);
+    const size_t nodeIdx = mNodes.size();
+    mNodes.emplace_back();
+
+    auto getCoord = [&bounds](const size_t sphereIdx, const int axis) -> double {
+        return CGAL::to_double(bounds[sphereIdx].first[axis]);
+    };
+
+    // Bounding box of sphere centers
+    std::array<double, 3> min, max;
+    min.fill(std::numeric_limits<double>::max());
+    max.fill(std::numeric_limits<double>::lowest());
+    for(size_t i = begin; i < end; ++i) {
+        for(int axis = 0; axis < 3; ++axis) {
+            min[axis] = std::min(min[axis], getCoord(mIndices[i], axis));
+            max[axis] = std::max(max[axis], getCoord(mIndices[i], axis));
+        }
+    }
+
+    const Point3 center((min[0] + max[0]) / 2.0, (min[1] + max[1]) / 2.0, (min[2] + max[2]) / 2.0);
+    double radius = 0.0;
+    for(size_t i = begin; i < end; ++i) {
+        const Bound& bound = bounds[mIndices[i]];
+        const double centerDistance = std::sqrt(CGAL::to_double(CGAL::squared_distance(center, bound.first)));
+        radius = std::max(radius, centerDistance + bound.second);
+    }
+
+    // Enlarge slightly so that rounding never prunes a sphere that passes the exact test
+    mNodes[nodeIdx].center = center;
+    mNodes[nodeIdx].radius = radius * (1.0 + 1e-9) + 1e-9;
+    mNodes[nodeIdx].begin = begin;
+    mNodes[nodeIdx].end = end;
+
+    if(end - begin <= sLeafSize) {
+        return nodeIdx;
+    }
+
+    // Split at the median along the longest axis
+    int splitAxis = 0;
+    for(int axis = 1; axis < 3; ++axis) {
+        if(max[axis] - min[axis] > max[splitAxis] - min[splitAxis]) {
+            splitAxis = axis;
+        }
+    }
+
+    const size_t middle = begin + (end - begin) / 2;
+    std::nth_element(mIndices.begin() + begin, mIndices.begin() + middle, mIndices.begin() + end,
+                     [&getCoord, splitAxis](const size_t a, const size_t b) {
+                         return getCoord(a, splitAxis) < getCoord(b, splitAxis);
+                     });
+
+    buildNode(bounds, begin, middle);
+    const size_t rightChild = buildNode(bounds, middle, end);
+    mNodes[nodeIdx].rightChild = rightChild;
+
+    return nodeIdx;
+}
+
+}  // namespace pepr3d
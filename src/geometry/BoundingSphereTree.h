@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "geometry/Triangle.h"
+#include "peprassert.h"
+
+namespace pepr3d {
+
+/// Bounding volume hierarchy over spheres, each node is a sphere enclosing all spheres below it.
+/// Answers "which spheres are closer than radius to an object" queries, object being any CGAL object with
+/// squared_distance to a point defined (point, line, ...).
+class BoundingSphereTree {
+   public:
+    using Point3 = DataTriangle::K::Point_3;
+    using Bound = std::pair<Point3, double>;
+
+    /// Build the hierarchy over the spheres. The spheres are not copied, the same vector has to be passed to query.
+    void build(const std::vector<Bound>& bounds);
+
+    /// Remove all nodes
+    void clear() {
+        mNodes.clear();
+        mIndices.clear();
+    }
+
+    /// Number of spheres the tree was built over
+    size_t size() const {
+        return mIndices.size();
+    }
+
+    /// Get indices of all spheres closer to the object than radius, sorted in increasing order
+    /// @param bounds the same spheres that the tree was built over
+    /// @param object CGAL Object - point, line, etc
+    template <typename Object>
+    std::vector<size_t> query(const std::vector<Bound>& bounds, const Object& object, double radius) const;
+
+   private:
+    struct Node {
+        /// Sphere enclosing all spheres of this node
+        Point3 center;
+        double radius = 0.0;
+
+        /// Range of mIndices covered by this node
+        size_t begin = 0;
+        size_t end = 0;
+
+        /// Index of the right child, left child immediately follows its parent. 0 for leaves.
+        size_t rightChild = 0;
+    };
+
+    /// Maximum number of spheres in a leaf
+    static constexpr size_t sLeafSize = 8;
+
+    /// Build node over the mIndices range and its children, return its index
+    size_t buildNode(const std::vector<Bound>& bounds, size_t begin, size_t end);
+
+    /// Nodes in depth first order, root is the first one
+    std::vector<Node> mNodes;
+
+    /// Sphere indices ordered so that every node covers a continuous range
+    std::vector<size_t> mIndices;
+};
+
+template <typename Object>
+std::vector<size_t> BoundingSphereTree::query(const std::vector<Bound>& bounds, const Object& object,
+                                              double radius) const {
+    P_ASSERT(bounds.size() == mIndices.size());
+    std::vector<size_t> result;
+    if(mNodes.empty()) {
+        return result;
+    }
+
+    std::vector<size_t> toVisit{0};
+    while(!toVisit.empty()) {
+        const size_t nodeIdx = toVisit.back();
+        const Node& node = mNodes[nodeIdx];
+        toVisit.pop_back();
+
+        const double nodeLimit = radius + node.radius;
+        if(CGAL::squared_distance(object, node.center) > nodeLimit * nodeLimit) {
+            continue;  // Nothing in this subtree can be in range
+        }
+
+        if(node.rightChild == 0) {
+            for(size_t i = node.begin; i < node.end; ++i) {
+                const size_t sphereIdx = mIndices[i];
+
+                // Same test as Geometry::isTriangleInRadius
+                const double distanceLimitSquared =
+                    (radius + bounds[sphereIdx].second) * (radius + bounds[sphereIdx].second);
+                if(CGAL::squared_distance(object, bounds[sphereIdx].first) <= distanceLimitSquared) {
+                    result.push_back(sphereIdx);
+                }
+            }
+        } else {
+            toVisit.push_back(node.rightChild);
+            toVisit.push_back(nodeIdx + 1);
+        }
+    }
+
+    // Keep the order of a linear scan
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+}  // namespace pepr3d
@@ -0,0 +1,113 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/BoundingSphereTree.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace pepr3d {
+using Point3 = BoundingSphereTree::Point3;
+using Bound = BoundingSphereTree::Bound;
+using Line3 = DataTriangle::K::Line_3;
+using Vector3 = DataTriangle::K::Vector_3;
+
+/// Random small spheres in a unit cube
+std::vector<Bound> getRandomSpheres(const size_t count, std::mt19937& generator) {
+    std::uniform_real_distribution<double> coordDistribution(0.0, 1.0);
+    std::uniform_real_distribution<double> radiusDistribution(0.0, 0.01);
+
+    std::vector<Bound> spheres;
+    spheres.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        const Point3 center(coordDistribution(generator), coordDistribution(generator), coordDistribution(generator));
+        spheres.emplace_back(center, radiusDistribution(generator));
+    }
+    return spheres;
+}
+
+/// Linear scan over all spheres, the way Geometry used to answer the queries
+template <typename Object>
+std::vector<size_t> getSpheresInRadiusBruteForce(const std::vector<Bound>& spheres, const Object& object,
+                                                 double radius) {
+    std::vector<size_t> result;
+    for(size_t i = 0; i < spheres.size(); ++i) {
+        const double distanceLimitSquared = (radius + spheres[i].second) * (radius + spheres[i].second);
+        if(CGAL::squared_distance(object, spheres[i].first) <= distanceLimitSquared) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+TEST(BoundingSphereTree, MatchesBruteForce) {
+    std::mt19937 generator(42);
+    const std::vector<Bound> spheres = getRandomSpheres(5000, generator);
+
+    BoundingSphereTree tree;
+    tree.build(spheres);
+    ASSERT_EQ(tree.size(), spheres.size());
+
+    std::uniform_real_distribution<double> coordDistribution(-0.2, 1.2);
+    std::uniform_real_distribution<double> radiusDistribution(0.0, 0.3);
+    for(int i = 0; i < 200; ++i) {
+        const Point3 point(coordDistribution(generator), coordDistribution(generator), coordDistribution(generator));
+        const Vector3 direction(coordDistribution(generator) - 0.5, coordDistribution(generator) - 0.5, 1.0);
+        const Line3 line(point, direction);
+        const double radius = radiusDistribution(generator);
+
+        EXPECT_EQ(tree.query(spheres, point, radius), getSpheresInRadiusBruteForce(spheres, point, radius));
+        EXPECT_EQ(tree.query(spheres, line, radius), getSpheresInRadiusBruteForce(spheres, line, radius));
+    }
+
+    // Zero radius still returns the spheres containing the point
+    const Point3 center = spheres[17].first;
+    EXPECT_EQ(tree.query(spheres, center, 0.0), getSpheresInRadiusBruteForce(spheres, center, 0.0));
+}
+
+TEST(BoundingSphereTree, Empty) {
+    BoundingSphereTree tree;
+    const std::vector<Bound> spheres;
+    tree.build(spheres);
+    EXPECT_TRUE(tree.query(spheres, Point3(0, 0, 0), 1.0).empty());
+}
+
+TEST(BoundingSphereTree, DISABLED_QueriesPerSecond) {
+    std::mt19937 generator(42);
+    for(const size_t sphereCount : {100000, 1000000, 5000000}) {
+        const std::vector<Bound> spheres = getRandomSpheres(sphereCount, generator);
+
+        BoundingSphereTree tree;
+        tree.build(spheres);
+
+        std::uniform_real_distribution<double> coordDistribution(0.0, 1.0);
+        const size_t queryCount = 1000;
+        std::vector<Point3> queries;
+        for(size_t i = 0; i < queryCount; ++i) {
+            queries.emplace_back(coordDistribution(generator), coordDistribution(generator),
+                                 coordDistribution(generator));
+        }
+
+        size_t found = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(const Point3& query : queries) {
+            found += tree.query(spheres, query, 0.02).size();
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+        const std::chrono::duration<double> treeTime = end - start;
+
+        const auto bruteStart = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < 10; ++i) {
+            found += getSpheresInRadiusBruteForce(spheres, queries[i], 0.02).size();
+        }
+        const auto bruteEnd = std::chrono::high_resolution_clock::now();
+        const std::chrono::duration<double> bruteTime = bruteEnd - bruteStart;
+
+        std::cout << sphereCount << " spheres: " << queryCount / treeTime.count() << " queries/s with tree, "
+                  << 10 / bruteTime.count() << " queries/s with linear scan (" << found << " found)" << std::endl;
+    }
+}
+
+}  // namespace pepr3d
+#endif
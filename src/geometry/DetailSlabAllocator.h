@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "peprassert.h"
+
+namespace pepr3d {
+
+/// Hands out stable ranges of triangle slots in the OpenGL buffers for TriangleDetails.
+/// Capacities are rounded up to a power of two and released ranges are reused through per-capacity free lists,
+/// so a detail keeps its position in the buffers until it outgrows its slab.
+class DetailSlabAllocator {
+   public:
+    /// Range of triangle slots, one triangle slot is three vertices in the buffers
+    struct Slab {
+        size_t firstTriangle = 0;
+        size_t capacity = 0;
+
+        /// Index of the first vertex of this slab in the OpenGL buffers
+        size_t getFirstVertex() const {
+            return 3 * firstTriangle;
+        }
+    };
+
+    DetailSlabAllocator() = default;
+
+    /// Create an allocator that hands out slots starting after the first firstFreeTriangle slots
+    explicit DetailSlabAllocator(size_t firstFreeTriangle) : mEnd(firstFreeTriangle) {}
+
+    /// Forget all allocated slabs and start allocating from firstFreeTriangle
+    void reset(size_t firstFreeTriangle) {
+        mEnd = firstFreeTriangle;
+        mFreeLists.clear();
+    }
+
+    /// Allocate a slab with space for at least triangleCount triangles
+    Slab allocate(size_t triangleCount) {
+        const size_t capacity = getCapacityClass(triangleCount);
+
+        auto freeIt = mFreeLists.find(capacity);
+        if(freeIt != mFreeLists.end() && !freeIt->second.empty()) {
+            const size_t firstTriangle = freeIt->second.back();
+            freeIt->second.pop_back();
+            return Slab{firstTriangle, capacity};
+        }
+
+        const Slab slab{mEnd, capacity};
+        mEnd += capacity;
+        return slab;
+    }
+
+    /// Return a slab to the allocator so that it can be reused by a later allocation of the same capacity
+    void release(const Slab& slab) {
+        P_ASSERT(slab.capacity == getCapacityClass(slab.capacity));
+        P_ASSERT(slab.firstTriangle + slab.capacity <= mEnd);
+        mFreeLists[slab.capacity].push_back(slab.firstTriangle);
+    }
+
+    /// Number of triangle slots spanned by the allocator, including the slots before the first slab
+    size_t getEnd() const {
+        return mEnd;
+    }
+
+    /// Smallest power of two that can hold triangleCount triangles
+    static size_t getCapacityClass(size_t triangleCount) {
+        size_t capacity = 1;
+        while(capacity < triangleCount) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+   private:
+    /// One past the last triangle slot handed out so far
+    size_t mEnd = 0;
+
+    /// Released slabs, capacity -> first triangle slots
+    std::map<size_t, std::vector<size_t>> mFreeLists;
+};
+
+}  // namespace pepr3d
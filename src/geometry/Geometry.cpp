@@ -4,45 +4,197 @@
 #include "ui/MainApplication.h"
 
 #include <CGAL/Sphere_3.h>
+#include <CGAL/boost/graph/Euler_operations.h>
 #include <CGAL/Spherical_kernel_3.h>
 #include <functional>
 #include <set>
 #include <unordered_map>
 #include "geometry/SdfValuesException.h"
+#include "geometry/VertexWelder.h"
 
 namespace pepr3d {
 
 /* -------------------- Commands -------------------- */
 
 Geometry::GeometryState Geometry::saveState() const {
-    // Save only necessary data to keep snapshot size low
-    std::vector<size_t> triangleColors;
-    triangleColors.reserve(mTriangles.size());
-    for(const DataTriangle& tri : mTriangles) {
-        triangleColors.push_back(tri.getColor());
+    const size_t chunkCount = (mTriangles.size() + sSnapshotChunkSize - 1) / sSnapshotChunkSize;
+
+    GeometryState state;
+    state.colorMap = ColorManager::ColorMap(mColorManager.getColorMap());
+
+    if(!mSnapshotBaseValid || mSnapshotBase.chunks.size() != chunkCount) {
+        state.chunks.reserve(chunkCount);
+        for(size_t chunkIdx = 0; chunkIdx < chunkCount; ++chunkIdx) {
+            state.chunks.push_back(saveStateChunk(chunkIdx, nullptr));
+        }
+    } else {
+        // Share everything with the last snapshot, copy only chunks with changed triangles
+        state.chunks = mSnapshotBase.chunks;
+        size_t lastSavedChunk = chunkCount;
+        for(const size_t triangleIdx : mSnapshotChangedTriangles) {
+            const size_t chunkIdx = triangleIdx / sSnapshotChunkSize;
+            if(chunkIdx != lastSavedChunk) {
+                state.chunks[chunkIdx] = saveStateChunk(chunkIdx, mSnapshotBase.chunks[chunkIdx].get());
+                lastSavedChunk = chunkIdx;
+            }
+        }
     }
 
-    return GeometryState{triangleColors, mTriangleDetails, ColorManager::ColorMap(mColorManager.getColorMap())};
+    mSnapshotBase = state;
+    mSnapshotBaseValid = true;
+    mSnapshotChangedTriangles.clear();
+
+    return state;
+}
+
+std::shared_ptr<const Geometry::GeometryState::Chunk> Geometry::saveStateChunk(
+    const size_t chunkIdx, const GeometryState::Chunk* previous) const {
+    const size_t begin = chunkIdx * sSnapshotChunkSize;
+    const size_t end = std::min(begin + sSnapshotChunkSize, mTriangles.size());
+
+    auto chunk = std::make_shared<GeometryState::Chunk>();
+    chunk->triangleColors.reserve(end - begin);
+    for(size_t triIdx = begin; triIdx < end; ++triIdx) {
+        chunk->triangleColors.push_back(mTriangles.getColor(triIdx));
+    }
+
+    for(size_t triIdx = begin; triIdx < end; ++triIdx) {
+        const TriangleDetail* detail = mTriangleDetails.find(triIdx);
+        if(detail == nullptr) {
+            continue;
+        }
+
+        if(previous != nullptr && mSnapshotChangedTriangles.find(triIdx) == mSnapshotChangedTriangles.end()) {
+            // Unchanged detail, keep sharing it with the previous snapshot
+            const auto previousIt = previous->triangleDetails.find(triIdx);
+            P_ASSERT(previousIt != previous->triangleDetails.end());
+            chunk->triangleDetails.emplace(triIdx, previousIt->second);
+        } else {
+            chunk->triangleDetails.emplace(triIdx, std::make_shared<const TriangleDetail>(*detail));
+        }
+    }
+
+    return chunk;
 }
 
 void Geometry::loadState(const GeometryState& state) {
     // mTriangles only possibly changes color
-    P_ASSERT(mTriangles.size() == state.triangleColors.size());
-    for(size_t triIdx = 0; triIdx < mTriangles.size(); triIdx++) {
-        mTriangles[triIdx].setColor(state.triangleColors[triIdx]);
+    const size_t chunkCount = (mTriangles.size() + sSnapshotChunkSize - 1) / sSnapshotChunkSize;
+    P_ASSERT(state.chunks.size() == chunkCount);
+    const bool baseValid = mSnapshotBaseValid && mSnapshotBase.chunks.size() == chunkCount;
+
+    // Chunks that differ between the current state and the loaded one
+    std::vector<bool> changedChunks(chunkCount, !baseValid);
+    if(baseValid) {
+        for(const size_t triangleIdx : mSnapshotChangedTriangles) {
+            changedChunks[triangleIdx / sSnapshotChunkSize] = true;
+        }
+        for(size_t chunkIdx = 0; chunkIdx < chunkCount; ++chunkIdx) {
+            if(mSnapshotBase.chunks[chunkIdx] != state.chunks[chunkIdx]) {
+                changedChunks[chunkIdx] = true;
+            }
+        }
+    }
+
+    for(size_t chunkIdx = 0; chunkIdx < chunkCount; ++chunkIdx) {
+        if(changedChunks[chunkIdx]) {
+            const GeometryState::Chunk* previous = baseValid ? mSnapshotBase.chunks[chunkIdx].get() : nullptr;
+            loadStateChunk(chunkIdx, *state.chunks[chunkIdx], previous);
+        }
     }
-    mTriangleDetails = state.triangleDetails;
 
-    mColorManager.replaceColors(state.colorMap.begin(), state.colorMap.end());
+    if(state.colorMap != mColorManager.getColorMap()) {
+        mColorManager.replaceColors(state.colorMap.begin(), state.colorMap.end());
+
+        // Set opengl state to dirty so it gets updated eventually
+        // Note: Updating straight away would hide this change from ModelView
+        invalidateOpenGlBuffers();
+    }
     P_ASSERT(!mColorManager.empty());
 
-    // Set opengl state to dirty so it gets updated eventually
-    // Note: Updating straight away would hide this change from ModelView
-    mOgl.isDirty = true;
+    mSnapshotBase = state;
+    mSnapshotBaseValid = true;
+    mSnapshotChangedTriangles.clear();
 
     // Tree is built from the original geometry, that is the same
     P_ASSERT(mTree->size() == mTriangles.size());
-    invalidateTemporaryDetailedData();
+}
+
+void Geometry::loadStateChunk(const size_t chunkIdx, const GeometryState::Chunk& chunk,
+                              const GeometryState::Chunk* previous) {
+    const size_t begin = chunkIdx * sSnapshotChunkSize;
+    P_ASSERT(begin + chunk.triangleColors.size() <= mTriangles.size());
+
+    for(size_t triIdx = begin; triIdx < begin + chunk.triangleColors.size(); ++triIdx) {
+        bool changed = false;
+        if(mTriangles.getColor(triIdx) != chunk.triangleColors[triIdx - begin]) {
+            mTriangles.setColor(triIdx, chunk.triangleColors[triIdx - begin]);
+            changed = true;
+        }
+
+        const auto savedIt = chunk.triangleDetails.find(triIdx);
+        const TriangleDetail* saved = savedIt == chunk.triangleDetails.end() ? nullptr : savedIt->second.get();
+
+        // The current detail is still the one in the previous snapshot, no need to copy the same one again
+        bool detailUnchanged = false;
+        if(previous != nullptr && mSnapshotChangedTriangles.find(triIdx) == mSnapshotChangedTriangles.end()) {
+            const auto previousIt = previous->triangleDetails.find(triIdx);
+            detailUnchanged =
+                (previousIt == previous->triangleDetails.end() ? nullptr : previousIt->second.get()) == saved;
+        }
+
+        if(!detailUnchanged) {
+            if(saved != nullptr) {
+                mTriangleDetails.insert_or_assign(triIdx, *saved);
+                markTriangleDetailChanged(triIdx);
+                changed = true;
+            } else if(mTriangleDetails.erase(triIdx)) {
+                markTriangleDetailChanged(triIdx);
+                changed = true;
+            }
+        }
+
+        if(changed) {
+            markTriangleDirty(triIdx);
+        }
+    }
+}
+
+size_t Geometry::GeometryState::getMemoryBytesExcluding(const GeometryState* other) const {
+    // Rough size of a node of std::map, pointers to parent and children plus the node color
+    constexpr size_t mapNodeOverhead = 4 * sizeof(void*);
+
+    if(other != nullptr && other->chunks.size() != chunks.size()) {
+        other = nullptr;  // States of different geometries do not share anything
+    }
+
+    size_t bytes = chunks.capacity() * sizeof(std::shared_ptr<const Chunk>) +
+                   colorMap.capacity() * sizeof(ColorManager::ColorMap::value_type);
+
+    for(size_t chunkIdx = 0; chunkIdx < chunks.size(); ++chunkIdx) {
+        const Chunk* chunk = chunks[chunkIdx].get();
+        const Chunk* otherChunk = other != nullptr ? other->chunks[chunkIdx].get() : nullptr;
+        if(chunk == otherChunk) {
+            continue;
+        }
+
+        bytes += sizeof(Chunk) + chunk->triangleColors.capacity() * sizeof(size_t) +
+                 chunk->triangleDetails.size() *
+                     (sizeof(std::pair<const size_t, std::shared_ptr<const TriangleDetail>>) + mapNodeOverhead);
+
+        for(const auto& detail : chunk->triangleDetails) {
+            if(otherChunk != nullptr) {
+                // Unchanged details are shared between chunks of both states
+                const auto otherIt = otherChunk->triangleDetails.find(detail.first);
+                if(otherIt != otherChunk->triangleDetails.end() && otherIt->second == detail.second) {
+                    continue;
+                }
+            }
+            bytes += detail.second->getApproximateMemoryBytes();
+        }
+    }
+
+    return bytes;
 }
 
 /* -------------------- Mesh loading -------------------- */
@@ -53,6 +205,9 @@ void Geometry::recomputeFromData() {
     P_ASSERT(mProgress->importRenderPercentage == 1.0f);
     P_ASSERT(mProgress->importComputePercentage == 1.0f);
 
+    /// The detailed mesh is built over the polyhedron, it has to be built from scratch as well
+    invalidateTemporaryDetailedData();
+
     /// Async build the polyhedron data structure
     auto buildPolyhedronFuture = threadPool.enqueue([this]() {
         P_ASSERT(!mPolyhedronData.vertices.empty());
@@ -96,8 +251,12 @@ void Geometry::recomputeFromData() {
     generateTriangleBounds();
 
     /// Wait for building the polyhedron and tree
-    buildTreeFuture.get();
-    buildPolyhedronFuture.get();
+    threadPool.wait(buildTreeFuture);
+    threadPool.wait(buildPolyhedronFuture);
+}
+
+::ThreadPool& Geometry::getThreadPool() {
+    return MainApplication::getThreadPool();
 }
 
 void Geometry::buildTree() {
@@ -118,17 +277,17 @@ void Geometry::loadNewGeometry(const std::string& fileName) {
     ModelImporter modelImporter(fileName, mProgress.get(), MainApplication::getThreadPool());  // only first mesh [0]
 
     if(modelImporter.isModelLoaded()) {
+        ModelImporter::Result result = std::move(modelImporter).takeResult();
+
         /// Fill triangle data to compute AABB
-        mTriangles = modelImporter.getTriangles();
+        mTriangles = std::move(result.triangles);
 
         /// Fill Polyhedron data to compute SurfaceMesh
-        mPolyhedronData.vertices.clear();
-        mPolyhedronData.indices.clear();
-        mPolyhedronData.vertices = modelImporter.getVertexBuffer();
-        mPolyhedronData.indices = modelImporter.getIndexBuffer();
+        mPolyhedronData.vertices = std::move(result.vertexBuffer);
+        mPolyhedronData.indices = std::move(result.indexBuffer);
 
         /// Get the generated color palette of the model, replace the current one
-        mColorManager = modelImporter.getColorManager();
+        mColorManager = std::move(result.palette);
         P_ASSERT(!mColorManager.empty());
 
         /// Do the computations in parallel
@@ -140,31 +299,32 @@ void Geometry::loadNewGeometry(const std::string& fileName) {
 }
 
 void Geometry::generateVertexBuffer() {
+    // Lay out details in slabs placed after the original triangles
+    mDetailSlabAllocator.reset(mTriangles.size());
+    mTriangleDetailBufferSlabs.clear();
+    for(const auto& it : mTriangleDetails) {
+        mTriangleDetailBufferSlabs.emplace(it.first, mDetailSlabAllocator.allocate(it.second.getTriangles().size()));
+    }
+
+    // Unused slots and original triangles replaced by details stay as dummy triangles to keep triangleIdx
+    // consistent with array position
     mOgl.vertexBuffer.clear();
-    mOgl.vertexBuffer.reserve(3 * mTriangles.size());
+    mOgl.vertexBuffer.resize(3 * mDetailSlabAllocator.getEnd(), glm::vec3{0, 0, 0});
 
-    for(size_t idx = 0; idx < mTriangles.size(); ++idx) {
-        const auto& triangle = mTriangles[idx];
+    // Positions are stored in the same layout as the buffer, only triangles with details are blanked out
+    const std::vector<glm::vec3>& positions = mTriangles.getPositions();
+    std::copy(positions.begin(), positions.end(), mOgl.vertexBuffer.begin());
 
-        if(isSimpleTriangle(idx)) {
-            mOgl.vertexBuffer.push_back(triangle.getVertex(0));
-            mOgl.vertexBuffer.push_back(triangle.getVertex(1));
-            mOgl.vertexBuffer.push_back(triangle.getVertex(2));
-        } else {
-            // Pass dummy triangle to keep triangleIdx consistent with array position
-            mOgl.vertexBuffer.push_back(glm::vec3{0, 0, 0});
-            mOgl.vertexBuffer.push_back(glm::vec3{0, 0, 0});
-            mOgl.vertexBuffer.push_back(glm::vec3{0, 0, 0});
-        }
-    }
+    for(const auto& it : mTriangleDetails) {
+        std::fill_n(mOgl.vertexBuffer.begin() + 3 * it.first, 3, glm::vec3{0, 0, 0});
 
-    for(auto& it : mTriangleDetails) {
         const auto& detailTriangles = it.second.getTriangles();
+        size_t vertexPosition = mTriangleDetailBufferSlabs.at(it.first).getFirstVertex();
 
         for(const auto& triangle : detailTriangles) {
-            mOgl.vertexBuffer.push_back(triangle.getVertex(0));
-            mOgl.vertexBuffer.push_back(triangle.getVertex(1));
-            mOgl.vertexBuffer.push_back(triangle.getVertex(2));
+            mOgl.vertexBuffer[vertexPosition++] = triangle.getVertex(0);
+            mOgl.vertexBuffer[vertexPosition++] = triangle.getVertex(1);
+            mOgl.vertexBuffer[vertexPosition++] = triangle.getVertex(2);
         }
     }
 }
@@ -180,26 +340,24 @@ void Geometry::generateIndexBuffer() {
 
 void Geometry::generateColorBuffer() {
     mOgl.colorBuffer.clear();
-    mOgl.colorBuffer.reserve(mOgl.vertexBuffer.size());
-    mTriangleDetailColorBufferStart.clear();
+    mOgl.colorBuffer.resize(mOgl.vertexBuffer.size(), 0);
 
     for(size_t idx = 0; idx < mTriangles.size(); ++idx) {
-        const auto& triangle = mTriangles[idx];
-        const ColorIndex triColorIndex = static_cast<ColorIndex>(triangle.getColor());
-        mOgl.colorBuffer.push_back(triColorIndex);
-        mOgl.colorBuffer.push_back(triColorIndex);
-        mOgl.colorBuffer.push_back(triColorIndex);
+        const ColorIndex triColorIndex = static_cast<ColorIndex>(mTriangles.getColor(idx));
+        mOgl.colorBuffer[3 * idx] = triColorIndex;
+        mOgl.colorBuffer[3 * idx + 1] = triColorIndex;
+        mOgl.colorBuffer[3 * idx + 2] = triColorIndex;
     }
 
-    for(auto& it : mTriangleDetails) {
+    for(const auto& it : mTriangleDetails) {
         const auto& detailTriangles = it.second.getTriangles();
+        size_t vertexPosition = mTriangleDetailBufferSlabs.at(it.first).getFirstVertex();
 
-        mTriangleDetailColorBufferStart[it.first] = mOgl.colorBuffer.size();
         for(const auto& triangle : detailTriangles) {
             const ColorIndex triColorIndex = static_cast<ColorIndex>(triangle.getColor());
-            mOgl.colorBuffer.push_back(triColorIndex);
-            mOgl.colorBuffer.push_back(triColorIndex);
-            mOgl.colorBuffer.push_back(triColorIndex);
+            mOgl.colorBuffer[vertexPosition++] = triColorIndex;
+            mOgl.colorBuffer[vertexPosition++] = triColorIndex;
+            mOgl.colorBuffer[vertexPosition++] = triColorIndex;
         }
     }
 
@@ -208,22 +366,21 @@ void Geometry::generateColorBuffer() {
 
 void Geometry::generateNormalBuffer() {
     mOgl.normalBuffer.clear();
-    mOgl.normalBuffer.reserve(mOgl.vertexBuffer.size());
+    mOgl.normalBuffer.resize(mOgl.vertexBuffer.size(), glm::vec3{0, 0, 0});
     for(size_t idx = 0; idx < mTriangles.size(); ++idx) {
-        const auto& triangle = mTriangles[idx];
-        mOgl.normalBuffer.push_back(triangle.getNormal());
-        mOgl.normalBuffer.push_back(triangle.getNormal());
-        mOgl.normalBuffer.push_back(triangle.getNormal());
+        const glm::vec3 normal = mTriangles.getNormal(idx);
+        mOgl.normalBuffer[3 * idx] = normal;
+        mOgl.normalBuffer[3 * idx + 1] = normal;
+        mOgl.normalBuffer[3 * idx + 2] = normal;
     }
 
-    for(auto& it : mTriangleDetails) {
+    for(const auto& it : mTriangleDetails) {
         const auto& detailTriangles = it.second.getTriangles();
-        glm::vec3 normal = it.second.getOriginal().getNormal();
+        const glm::vec3 normal = it.second.getOriginal().getNormal();
+        size_t vertexPosition = mTriangleDetailBufferSlabs.at(it.first).getFirstVertex();
 
-        for(const auto& triangle : detailTriangles) {
-            mOgl.normalBuffer.push_back(normal);
-            mOgl.normalBuffer.push_back(normal);
-            mOgl.normalBuffer.push_back(normal);
+        for(size_t i = 0; i < 3 * detailTriangles.size(); ++i) {
+            mOgl.normalBuffer[vertexPosition++] = normal;
         }
     }
     P_ASSERT(mOgl.normalBuffer.size() == mOgl.vertexBuffer.size());
@@ -233,54 +390,192 @@ void Geometry::generateHighlightBuffer() {
     std::set<size_t>& paintSet = mAreaHighlight.triangles;
     const BrushSettings& settings = mAreaHighlight.settings;
 
-    mOgl.highlightMask.clear();
-    // Mark all triangles with attribute assigned to vertex
-    mOgl.highlightMask.reserve(mTriangles.size() * 3);
-    for(size_t triangleIdx = 0; triangleIdx < mTriangles.size(); triangleIdx++) {
-        // Fill 3 vertices of a triangle
-        if(settings.continuous && paintSet.find(triangleIdx) == paintSet.end()) {
-            mOgl.highlightMask.emplace_back(0);
-            mOgl.highlightMask.emplace_back(0);
-            mOgl.highlightMask.emplace_back(0);
+    // Mark all triangles with attribute assigned to vertex, unused slots are never highlighted
+    mOgl.highlightMask.assign(mOgl.vertexBuffer.size(), 0);
+    mIsOglHighlightingAll = !settings.continuous;
+    mOglHighlightedTriangles.clear();
 
-        } else {
-            mOgl.highlightMask.emplace_back(1);
-            mOgl.highlightMask.emplace_back(1);
-            mOgl.highlightMask.emplace_back(1);
+    if(mIsOglHighlightingAll) {
+        for(size_t triangleIdx = 0; triangleIdx < mTriangles.size(); triangleIdx++) {
+            writeTriangleHighlight(triangleIdx, true);
+        }
+    } else {
+        for(const size_t triangleIdx : paintSet) {
+            writeTriangleHighlight(triangleIdx, true);
+        }
+        mOglHighlightedTriangles = paintSet;
+    }
+
+    P_ASSERT(mOgl.highlightMask.size() == mOgl.vertexBuffer.size());
+
+    mOgl.info.didHighlightUpdate = true;
+}
+
+void Geometry::updateHighlightBuffer() {
+    const BrushSettings& settings = mAreaHighlight.settings;
+    if(mIsOglHighlightingAll || !settings.continuous || mOgl.highlightMask.size() > mOgl.vertexBuffer.size()) {
+        generateHighlightBuffer();
+        return;
+    }
+
+    // Buffers grew with new detail slabs, which start without any highlight
+    mOgl.highlightMask.resize(mOgl.vertexBuffer.size(), 0);
+
+    // Slots of triangles rewritten since the last update get their current highlight again
+    for(const size_t triangleIdx : mOglDirtyTriangles) {
+        writeTriangleHighlight(triangleIdx, mOglHighlightedTriangles.count(triangleIdx) > 0);
+    }
+
+    const std::set<size_t>& paintSet = mAreaHighlight.triangles;
+    for(const size_t triangleIdx : mOglHighlightedTriangles) {
+        if(paintSet.count(triangleIdx) == 0) {
+            writeTriangleHighlight(triangleIdx, false);
+        }
+    }
+    for(const size_t triangleIdx : paintSet) {
+        if(mOglHighlightedTriangles.count(triangleIdx) == 0) {
+            writeTriangleHighlight(triangleIdx, true);
         }
     }
+    mOglHighlightedTriangles = paintSet;
+
+    mOgl.info.didHighlightUpdate = true;
+}
+
+void Geometry::writeTriangleHighlight(const size_t triangleIdx, const bool isHighlighted) {
+    const GLint value = isHighlighted ? 1 : 0;
+    P_ASSERT(3 * triangleIdx + 2 < mOgl.highlightMask.size());
+    mOgl.highlightMask[3 * triangleIdx] = value;
+    mOgl.highlightMask[3 * triangleIdx + 1] = value;
+    mOgl.highlightMask[3 * triangleIdx + 2] = value;
 
     // If the original triangle has highlight enabled also enable for detail
-    for(auto& it : mTriangleDetails) {
-        const size_t triangleIdx = it.first;
-        const auto& detailTriangles = it.second.getTriangles();
+    const TriangleDetail* detail = mTriangleDetails.find(triangleIdx);
+    const DetailSlabAllocator::Slab* slab = mTriangleDetailBufferSlabs.find(triangleIdx);
+    if(detail == nullptr || slab == nullptr || detail->needsTriangulation()) {
+        return;  // No detail or the detail is not in the buffers yet, or it is rewritten with the next buffer update
+    }
 
-        const bool enableHighlight = !settings.continuous || paintSet.find(triangleIdx) != paintSet.end();
+    // Unused rest of the slab is never highlighted
+    const auto firstVertex = mOgl.highlightMask.begin() + slab->getFirstVertex();
+    const auto slabEnd = mOgl.highlightMask.begin() + 3 * (slab->firstTriangle + slab->capacity);
+    const auto detailEnd = firstVertex + 3 * detail->getTriangles().size();
+    P_ASSERT(detailEnd <= slabEnd);
+    std::fill(firstVertex, detailEnd, value);
+    std::fill(detailEnd, slabEnd, 0);
+}
 
-        for(const auto& triangle : detailTriangles) {
-            if(enableHighlight) {
-                mOgl.highlightMask.emplace_back(1);
-                mOgl.highlightMask.emplace_back(1);
-                mOgl.highlightMask.emplace_back(1);
-            } else {
-                mOgl.highlightMask.emplace_back(0);
-                mOgl.highlightMask.emplace_back(0);
-                mOgl.highlightMask.emplace_back(0);
+void Geometry::updateDirtyBufferSlots() {
+    for(const size_t triangleIdx : mOglDirtyTriangles) {
+        P_ASSERT(triangleIdx < mTriangles.size());
+        DetailSlabAllocator::Slab* slab = mTriangleDetailBufferSlabs.find(triangleIdx);
+        const TriangleDetail* detail = mTriangleDetails.find(triangleIdx);
+
+        if(detail == nullptr) {
+            // Detail was removed, its slab can be reused
+            if(slab != nullptr) {
+                clearBufferSlab(*slab);
+                mDetailSlabAllocator.release(*slab);
+                mTriangleDetailBufferSlabs.erase(triangleIdx);
             }
+        } else {
+            const size_t detailTriangleCount = detail->getTriangles().size();
+
+            // Detail outgrew its slab, move it into a bigger one
+            if(slab != nullptr && slab->capacity < detailTriangleCount) {
+                clearBufferSlab(*slab);
+                mDetailSlabAllocator.release(*slab);
+                mTriangleDetailBufferSlabs.erase(triangleIdx);
+                slab = nullptr;
+            }
+
+            if(slab == nullptr) {
+                slab = mTriangleDetailBufferSlabs
+                           .emplace(triangleIdx, mDetailSlabAllocator.allocate(detailTriangleCount))
+                           .first;
+                resizeBuffersToSlabs();
+            }
+
+            writeDetailToBuffers(*detail, *slab);
         }
+
+        writeTriangleToBuffers(triangleIdx);
     }
 
-    P_ASSERT(mOgl.highlightMask.size() == mOgl.vertexBuffer.size());
+    P_ASSERT(mOgl.vertexBuffer.size() == 3 * mDetailSlabAllocator.getEnd());
+}
 
-    mOgl.info.didHighlightUpdate = true;
+void Geometry::writeTriangleToBuffers(const size_t triangleIdx) {
+    const bool isSimple = isSimpleTriangle(triangleIdx);
+    const ColorIndex triColorIndex = static_cast<ColorIndex>(mTriangles.getColor(triangleIdx));
+    const glm::vec3 normal = mTriangles.getNormal(triangleIdx);
+
+    for(size_t i = 0; i < 3; ++i) {
+        const size_t vertexPosition = 3 * triangleIdx + i;
+        // Pass dummy triangle when the triangle is rendered by its detail
+        mOgl.vertexBuffer[vertexPosition] = isSimple ? mTriangles.getVertex(triangleIdx, i) : glm::vec3{0, 0, 0};
+        mOgl.colorBuffer[vertexPosition] = triColorIndex;
+        mOgl.normalBuffer[vertexPosition] = normal;
+    }
+}
+
+void Geometry::writeDetailToBuffers(const TriangleDetail& detail, const DetailSlabAllocator::Slab& slab) {
+    const auto& detailTriangles = detail.getTriangles();
+    P_ASSERT(detailTriangles.size() <= slab.capacity);
+    P_ASSERT(3 * (slab.firstTriangle + slab.capacity) <= mOgl.vertexBuffer.size());
+
+    const glm::vec3 normal = detail.getOriginal().getNormal();
+    size_t vertexPosition = slab.getFirstVertex();
+
+    for(const auto& triangle : detailTriangles) {
+        const ColorIndex triColorIndex = static_cast<ColorIndex>(triangle.getColor());
+        for(size_t i = 0; i < 3; ++i) {
+            mOgl.vertexBuffer[vertexPosition] = triangle.getVertex(i);
+            mOgl.colorBuffer[vertexPosition] = triColorIndex;
+            mOgl.normalBuffer[vertexPosition] = normal;
+            ++vertexPosition;
+        }
+    }
+
+    // Unused rest of the slab
+    const size_t slabEnd = 3 * (slab.firstTriangle + slab.capacity);
+    std::fill(mOgl.vertexBuffer.begin() + vertexPosition, mOgl.vertexBuffer.begin() + slabEnd, glm::vec3{0, 0, 0});
+}
+
+void Geometry::clearBufferSlab(const DetailSlabAllocator::Slab& slab) {
+    const size_t firstVertex = slab.getFirstVertex();
+    const size_t slabEnd = 3 * (slab.firstTriangle + slab.capacity);
+    P_ASSERT(slabEnd <= mOgl.vertexBuffer.size());
+    std::fill(mOgl.vertexBuffer.begin() + firstVertex, mOgl.vertexBuffer.begin() + slabEnd, glm::vec3{0, 0, 0});
+    if(slabEnd <= mOgl.highlightMask.size()) {
+        std::fill(mOgl.highlightMask.begin() + firstVertex, mOgl.highlightMask.begin() + slabEnd, 0);
+    }
+}
+
+void Geometry::resizeBuffersToSlabs() {
+    const size_t vertexCount = 3 * mDetailSlabAllocator.getEnd();
+    if(vertexCount <= mOgl.vertexBuffer.size()) {
+        return;
+    }
+
+    mOgl.vertexBuffer.resize(vertexCount, glm::vec3{0, 0, 0});
+    mOgl.colorBuffer.resize(vertexCount, 0);
+    mOgl.normalBuffer.resize(vertexCount, glm::vec3{0, 0, 0});
+
+    mOgl.indexBuffer.reserve(vertexCount);
+    for(size_t i = mOgl.indexBuffer.size(); i < vertexCount; ++i) {
+        mOgl.indexBuffer.push_back(static_cast<uint32_t>(i));
+    }
 }
 
 void Geometry::generateTriangleBounds() {
     mTriangleBounds.clear();
-    for(const DataTriangle& dataTri : mTriangles) {
-        const auto& tri = dataTri.getTri();
-        mTriangleBounds.push_back(GeometryUtils::getBoundingSphere(tri));
+    mTriangleBounds.reserve(mTriangles.size());
+    for(size_t triIdx = 0; triIdx < mTriangles.size(); ++triIdx) {
+        mTriangleBounds.push_back(GeometryUtils::getBoundingSphere(mTriangles.getCgalTriangle(triIdx)));
     }
+
+    mTriangleBoundsTree.build(mTriangleBounds);
 }
 
 /* -------------------- Tool support -------------------- */
@@ -329,40 +624,54 @@ std::optional<size_t> Geometry::intersectMesh(const ci::Ray& ray, glm::vec3& out
 }
 
 std::optional<DetailedTriangleId> Geometry::intersectDetailedMesh(const ci::Ray& ray) {
-    if(mTree->empty()) {
+    // Details cover exactly their original triangle, so the original tree finds the hit triangle
+    const std::optional<size_t> baseTriangle = intersectMesh(ray);
+    if(!baseTriangle) {
         return {};
     }
 
-    if(!isTemporaryDetailedDataValid()) {
-        updateTemporaryDetailedData();
-        P_ASSERT(mTreeDetailed);
+    // Detail ids have to stay the same until they are used, e.g. by a bucket fill
+    if(!isTemporaryDetailedDataValid() && !updateTemporaryDetailedData()) {
+        return {};
     }
 
-    const glm::vec3 source = ray.getOrigin();
-    const glm::vec3 direction = ray.getDirection();
+    if(isSimpleTriangle(*baseTriangle)) {
+        return DetailedTriangleId(*baseTriangle);
+    }
 
-    const pepr3d::Geometry::Ray rayQuery(pepr3d::DataTriangle::Point(source.x, source.y, source.z),
-                                         pepr3d::Geometry::Direction(direction.x, direction.y, direction.z));
+    const auto& detailTriangles = getTriangleDetail(*baseTriangle)->getTriangles();
+    P_ASSERT(!detailTriangles.empty());
+    for(size_t detailIdx = 0; detailIdx < detailTriangles.size(); detailIdx++) {
+        if(GeometryUtils::triangleRayIntersection(detailTriangles[detailIdx], ray)) {
+            return DetailedTriangleId(*baseTriangle, detailIdx);
+        }
+    }
 
-    // Find the two intersection parameters - place and triangle
-    Ray_intersection intersection = mTreeDetailed->first_intersection(rayQuery);
-    if(intersection) {
-        // The intersected triangle
-        const DetailedTriangleId triangleId = boost::get<DataTriangleAABBPrimitive::Id>(intersection->second).second;
+    /// No intersection detected, e.g. the ray passed between the detail triangles due to rounding.
+    return {};
+}
 
-        P_ASSERT(triangleId.getBaseId() < mTriangles.size());
-        P_ASSERT(!(triangleId.getDetailId() && isSimpleTriangle(triangleId.getBaseId())));
+std::vector<size_t> Geometry::getConnectedComponent(const size_t startTriangle) {
+    return bucket(startTriangle, SpreadEverywhere());
+}
 
-        if(!isSimpleTriangle(triangleId.getBaseId())) {
-            P_ASSERT(triangleId.getDetailId());
-            P_ASSERT(triangleId.getDetailId() < getTriangleDetailCount(triangleId.getBaseId()));
-        }
+std::vector<DetailedTriangleId> Geometry::getConnectedComponent(const DetailedTriangleId startTriangle) {
+    // Details always cover their whole original triangle, so the components are the same
+    const std::vector<size_t> baseTriangles = getConnectedComponent(startTriangle.getBaseId());
 
-        return triangleId;
+    std::vector<DetailedTriangleId> result;
+    result.reserve(baseTriangles.size());
+    for(const size_t baseId : baseTriangles) {
+        const size_t detailCount = getTriangleDetailCount(baseId);
+        if(detailCount == 0) {
+            result.emplace_back(baseId);
+        } else {
+            for(size_t detailId = 0; detailId < detailCount; ++detailId) {
+                result.emplace_back(baseId, detailId);
+            }
+        }
     }
-
-    /// No intersection detected.
-    return {};
+    return result;
 }
 
 std::vector<size_t> Geometry::getTrianglesUnderBrush(const glm::vec3& originPoint, const glm::vec3& insideDirection,
@@ -376,12 +685,11 @@ std::vector<size_t> Geometry::getTrianglesUnderBrush(const glm::vec3& originPoin
         if(triId == startTriangle)
             return true;
 
-        const auto& tri = getTriangle(triId);
-        const auto a = tri.getVertex(0);
-        const auto b = tri.getVertex(1);
-        const auto c = tri.getVertex(2);
+        const glm::vec3 a = getTriangleVertex(triId, 0);
+        const glm::vec3 b = getTriangleVertex(triId, 1);
+        const glm::vec3 c = getTriangleVertex(triId, 2);
 
-        if(!settings.paintBackfaces && glm::dot(tri.getNormal(), insideDirection) > 0.f)
+        if(!settings.paintBackfaces && glm::dot(getTriangleNormal(triId), insideDirection) > 0.f)
             return false;  // stop on triangles facing away from the ray
 
         // If triangle's bounding sphere is out of range no need to test further
@@ -440,10 +748,10 @@ void Geometry::highlightArea(const ci::Ray& ray, const BrushSettings& settings)
         mAreaHighlight.enabled = true;
         mAreaHighlight.dirty = true;
 
-        // Generate highlight buffer only if our openGlBuffers are valid
-        // Otherwise delay until everything is generated again
+        // Update highlight buffer only if our openGlBuffers are valid
+        // Otherwise delay until the buffers are updated again
         if(!mOgl.isDirty) {
-            generateHighlightBuffer();
+            updateHighlightBuffer();
         }
 
         // TODO: Improvement: Try to avoid doing all this if we are highlighting the same triangle with the same
@@ -454,41 +762,34 @@ void Geometry::highlightArea(const ci::Ray& ray, const BrushSettings& settings)
 }
 
 void Geometry::paintWithShape(const ci::Ray& ray, const std::vector<Point3>& shape, size_t color, bool paintBackfaces) {
-    const std::pair<Point3, double> shapeBounds = GeometryUtils::getBoundingSphere(shape);
-    const auto rd = ray.getDirection();
-    const Line3 rayLine(shapeBounds.first, Vector3(rd.x, rd.y, rd.z));
-
-    std::vector<size_t> trianglesInCylinder = getTrianglesInRadius(rayLine, shapeBounds.second);
-
-    // Gather all the TriangleDetails that we want to update
-    std::vector<size_t> detailsToUpdate;
-    for(size_t triIdx : trianglesInCylinder) {
-        const auto& cgalTri = getTriangle(triIdx).getTri();
-
-        if(glm::dot(rd, getTriangle(triIdx).getNormal()) > 0 && !paintBackfaces) {
-            continue;  // Skip triangles facing away
-        }
+    paintWithShapes({ray}, {shape}, color, paintBackfaces);
+}
 
-        if(isSimpleTriangle(triIdx) && getTriangleColor(triIdx) == color) {
-            continue;  // Do not paint simple triangles of the same color
+void Geometry::paintWithShapes(const std::vector<ci::Ray>& rays, const std::vector<std::vector<Point3>>& shapes,
+                               size_t color, bool paintBackfaces) {
+    P_ASSERT(rays.size() == shapes.size());
+
+    // Gather the shapes that touch each triangle
+    std::vector<TriangleDetail::PeprVector3> directions;
+    directions.reserve(rays.size());
+    std::map<size_t, std::vector<size_t>> dabsOfTriangles;
+    for(size_t dabIdx = 0; dabIdx < rays.size(); ++dabIdx) {
+        const std::pair<Point3, double> shapeBounds = GeometryUtils::getBoundingSphere(shapes[dabIdx]);
+        const auto rd = rays[dabIdx].getDirection();
+        const Line3 rayLine(shapeBounds.first, Vector3(rd.x, rd.y, rd.z));
+        directions.push_back(rayLine.direction().vector());
+
+        for(size_t triIdx : getTrianglesInRadius(rayLine, shapeBounds.second)) {
+            if(glm::dot(rd, getTriangleNormal(triIdx)) > 0 && !paintBackfaces) {
+                continue;  // Skip triangles facing away
+            }
+            dabsOfTriangles[triIdx].push_back(dabIdx);
         }
-
-        detailsToUpdate.emplace_back(triIdx);
-        getTriangleDetail(triIdx);  // Make sure triangle detail is created
     }
 
-    if(!detailsToUpdate.empty()) {
-        invalidateTemporaryDetailedData();
-    }
-
-    // Update in parallel
-    auto& threadPool = MainApplication::getThreadPool();
-    threadPool.parallel_for(detailsToUpdate.begin(), detailsToUpdate.end(),
-                            [this, &shape, color, &rayLine](size_t triIdx) {
-                                getTriangleDetail(triIdx)->paintShape(shape, rayLine.direction().vector(), color);
-                            });
-
-    mOgl.isDirty = true;
+    paintDabs(dabsOfTriangles, color, [&shapes, &directions](const TriangleDetail& detail, size_t dabIdx) {
+        return detail.projectShapeToPolygon(shapes[dabIdx], directions[dabIdx]);
+    });
 }
 
 void Geometry::paintWithShape(const ci::Ray& ray, const std::vector<DataTriangle::Triangle>& triangles, size_t color) {
@@ -507,9 +808,7 @@ void Geometry::paintWithShape(const ci::Ray& ray, const std::vector<DataTriangle
     // Gather all the TriangleDetails that we want to update
     std::vector<size_t> detailsToUpdate;
     for(size_t triIdx : trianglesInCylinder) {
-        const auto& cgalTri = getTriangle(triIdx).getTri();
-
-        if(glm::dot(rd, getTriangle(triIdx).getNormal()) >= 0) {
+        if(glm::dot(rd, getTriangleNormal(triIdx)) >= 0) {
             continue;  // Skip triangles facing away
         }
 
@@ -519,11 +818,10 @@ void Geometry::paintWithShape(const ci::Ray& ray, const std::vector<DataTriangle
 
         detailsToUpdate.emplace_back(triIdx);
         getTriangleDetail(triIdx);  // Make sure triangle detail is created
+        markTriangleDirty(triIdx);
+        markTriangleDetailChanged(triIdx);
     }
     CI_LOG_I(std::string("Triangles to paint: ") + std::to_string(detailsToUpdate.size()));
-    if(!detailsToUpdate.empty()) {
-        invalidateTemporaryDetailedData();
-    }
 
     // Update in parallel
     try {
@@ -537,80 +835,112 @@ void Geometry::paintWithShape(const ci::Ray& ray, const std::vector<DataTriangle
         CI_LOG_E(e.what());
         throw;
     }
-
-    mOgl.isDirty = true;
 }
 
 void Geometry::paintAreaWithSphere(const ci::Ray& ray, const BrushSettings& settings) {
-    glm::vec3 intersectionPoint{};
-    auto intersectedTri = intersectMesh(ray, intersectionPoint);
+    paintAreaWithSpheres({ray}, settings);
+}
 
-    if(!intersectedTri) {
-        return;
-    }
+void Geometry::paintAreaWithSpheres(const std::vector<ci::Ray>& rays, const BrushSettings& settings) {
+    // Gather the dabs that touch each triangle
+    std::vector<Sphere> dabs;
+    std::map<size_t, std::vector<size_t>> dabsOfTriangles;
+    std::set<size_t> paintedWhole;
+    for(const ci::Ray& ray : rays) {
+        glm::vec3 intersectionPoint{};
+        auto intersectedTri = intersectMesh(ray, intersectionPoint);
 
-    const auto trisInBrush = getTrianglesUnderBrush(intersectionPoint, ray.getDirection(), *intersectedTri, settings);
+        if(!intersectedTri) {
+            continue;
+        }
 
-    std::vector<size_t> detailsToUpdate;
+        const size_t dabIdx = dabs.size();
+        dabs.emplace_back(Point3(intersectionPoint.x, intersectionPoint.y, intersectionPoint.z),
+                          settings.size * settings.size);
 
-    for(const size_t triangleIdx : trisInBrush) {
-        const auto& cgalTri = getTriangle(triangleIdx).getTri();
+        const auto trisInBrush =
+            getTrianglesUnderBrush(intersectionPoint, ray.getDirection(), *intersectedTri, settings);
+        for(const size_t triangleIdx : trisInBrush) {
+            const auto cgalTri = getCgalTriangle(triangleIdx);
 
-        if(GeometryUtils::isFullyInsideASphere(cgalTri, intersectionPoint, settings.size)) {
-            // Triangles fully inside are colored whole
-            setTriangleColor(triangleIdx, settings.color);
-        } else {
-            if(settings.respectOriginalTriangles) {
+            if(GeometryUtils::isFullyInsideASphere(cgalTri, intersectionPoint, settings.size)) {
+                // Triangles fully inside are colored whole
+                paintedWhole.insert(triangleIdx);
+            } else if(settings.respectOriginalTriangles) {
                 if(settings.paintOuterRing) {
-                    setTriangleColor(triangleIdx, settings.color);
+                    paintedWhole.insert(triangleIdx);
                 }
-
             } else {
-                // Do not paint triangles that are already the same color
-                if(!isSimpleTriangle(triangleIdx) || getTriangle(triangleIdx).getColor() != settings.color) {
-                    detailsToUpdate.emplace_back(triangleIdx);
-                    getTriangleDetail(triangleIdx);  // Create triangle detail so that we dont modify
-                }
+                dabsOfTriangles[triangleIdx].push_back(dabIdx);
             }
         }
     }
 
-    if(!detailsToUpdate.empty()) {
-        invalidateTemporaryDetailedData();
+    // Painting the whole triangle covers all dabs on it, no matter their order
+    for(const size_t triangleIdx : paintedWhole) {
+        setTriangleColor(triangleIdx, settings.color);
+        dabsOfTriangles.erase(triangleIdx);
     }
 
-    const Sphere brushShape(Point3(intersectionPoint.x, intersectionPoint.y, intersectionPoint.z),
-                            settings.size * settings.size);
+    paintDabs(dabsOfTriangles, settings.color, [&dabs, &settings](const TriangleDetail& detail, size_t dabIdx) {
+        return detail.polygonFromSphere(dabs[dabIdx], settings.segments);
+    });
+}
+
+void Geometry::paintDabs(const std::map<size_t, std::vector<size_t>>& dabsOfTriangles, size_t color,
+                         const std::function<TriangleDetail::Polygon(const TriangleDetail&, size_t)>& getDabPolygon) {
+    // Gather all the TriangleDetails that we want to update
+    std::vector<size_t> detailsToUpdate;
+    for(const auto& triangleDabs : dabsOfTriangles) {
+        const size_t triIdx = triangleDabs.first;
+        if(isSimpleTriangle(triIdx) && getTriangleColor(triIdx) == color) {
+            continue;  // Do not paint simple triangles of the same color
+        }
+
+        detailsToUpdate.emplace_back(triIdx);
+        getTriangleDetail(triIdx);  // Make sure triangle detail is created
+        markTriangleDirty(triIdx);
+        markTriangleDetailChanged(triIdx);
+    }
 
+    // Update in parallel, each detail is retriangulated once with the union of all its dabs
     try {
         auto& threadPool = MainApplication::getThreadPool();
-        threadPool.parallel_for(
-            detailsToUpdate.begin(), detailsToUpdate.end(), [this, &brushShape, &settings](size_t triIdx) {
-                getTriangleDetail(triIdx)->paintSphere(brushShape, settings.segments, settings.color);
-            });
+        threadPool.parallel_for(detailsToUpdate.begin(), detailsToUpdate.end(), [&](size_t triIdx) {
+            TriangleDetail* detail = getTriangleDetail(triIdx);
+            const std::vector<size_t>& dabIndices = dabsOfTriangles.at(triIdx);
+
+            std::vector<TriangleDetail::Polygon> polygons;
+            polygons.reserve(dabIndices.size());
+            for(const size_t dabIdx : dabIndices) {
+                polygons.push_back(getDabPolygon(*detail, dabIdx));
+            }
+            detail->paintPolygons(polygons, color);
+        });
     } catch(const std::exception& e) {
         CI_LOG_E(e.what());
         throw;
     }
-
-    mOgl.isDirty = true;
 }
 
 TriangleDetail* Geometry::createTriangleDetail(size_t triangleIdx) {
     auto result = mTriangleDetails.emplace(triangleIdx, TriangleDetail(getTriangle(triangleIdx)));
+    markTriangleDirty(triangleIdx);
+    markTriangleDetailChanged(triangleIdx);
 
-    return &(result.first->second);
+    return result.first;
 }
 
 void Geometry::removeTriangleDetail(const size_t triangleIndex) {
-    mOgl.isDirty = true;
     mTriangleDetails.erase(triangleIndex);
+    markTriangleDirty(triangleIndex);
 
-    // Chaning triangle detail invalidates detailed tree and mesh
-    invalidateTemporaryDetailedData();
+    // The detail faces are replaced by the original triangle in the detailed mesh
+    markTriangleDetailChanged(triangleIndex);
 }
 
 void Geometry::setTriangleColor(const size_t triangleIndex, const size_t newColor) {
+    markTriangleChanged(triangleIndex);
     if(isSimpleTriangle(triangleIndex)) {
         if(!mOgl.isDirty) {
             // Change it in the buffer
@@ -625,6 +955,8 @@ void Geometry::setTriangleColor(const size_t triangleIndex, const size_t newColo
             mOgl.colorBuffer[vertexPosition + 1] = newColorIndex;
             mOgl.colorBuffer[vertexPosition + 2] = newColorIndex;
             mOgl.info.didColorUpdate = true;
+        } else {
+            markTriangleDirty(triangleIndex);
         }
     } else {
         removeTriangleDetail(triangleIndex);
@@ -632,7 +964,7 @@ void Geometry::setTriangleColor(const size_t triangleIndex, const size_t newColo
 
     /// Change it in the triangle soup
     P_ASSERT(triangleIndex < mTriangles.size());
-    mTriangles[triangleIndex].setColor(newColor);
+    mTriangles.setColor(triangleIndex, newColor);
 }
 
 void Geometry::setTriangleColor(const DetailedTriangleId triangleId, const size_t newColor) {
@@ -646,15 +978,18 @@ void Geometry::setTriangleColor(const DetailedTriangleId triangleId, const size_
 
         TriangleDetail* detail = getTriangleDetail(baseId);
         detail->setColor(detailId, newColor);
+        markTriangleChanged(baseId);
 
         if(!mOgl.isDirty) {
-            const size_t vertexPosition =
-                mTriangleDetailColorBufferStart[triangleId.getBaseId()] + 3 * (*triangleId.getDetailId());
+            const size_t vertexPosition = mTriangleDetailBufferSlabs.at(baseId).getFirstVertex() + 3 * detailId;
+            P_ASSERT(vertexPosition + 2 < mOgl.colorBuffer.size());
             ColorIndex newColorIndex = static_cast<ColorIndex>(newColor);
             mOgl.colorBuffer[vertexPosition] = newColorIndex;
             mOgl.colorBuffer[vertexPosition + 1] = newColorIndex;
             mOgl.colorBuffer[vertexPosition + 2] = newColorIndex;
             mOgl.info.didColorUpdate = true;
+        } else {
+            markTriangleDirty(baseId);
         }
     } else {
         // No detail ID, do the baseID behavior
@@ -670,6 +1005,7 @@ void Geometry::buildPolyhedron() {
     mPolyhedronData.isSdfComputed = false;
     mPolyhedronData.valid = false;
     mPolyhedronData.mFaceDescs.clear();
+    mPolyhedronData.adjacency.clear();
 
     std::vector<PolyhedronData::vertex_descriptor> vertDescs;
     vertDescs.reserve(mPolyhedronData.vertices.size());
@@ -716,37 +1052,60 @@ void Geometry::buildPolyhedron() {
         mPolyhedronData.mIdMap[face] = i;
         ++i;
     }
+
+    // Neighbours for bucket spreading
+    buildAdjacency();
+
     CI_LOG_I("Polyhedral mesh built, vertices: " + std::to_string(mPolyhedronData.vertices.size()) +
              ", faces: " + std::to_string(mPolyhedronData.indices.size()));
     mPolyhedronData.valid = true;
     mProgress->polyhedronPercentage = 1.0f;
 }
 
-void Geometry::buildDetailedTree() {
-    mTreeDetailed = std::make_unique<Tree>();
-
-    for(size_t triangleIdx = 0; triangleIdx < mTriangles.size(); triangleIdx++) {
-        if(isSimpleTriangle(triangleIdx)) {
-            // Insert Original triangle
-            mTreeDetailed->insert(DataTriangleAABBPrimitive(this, DetailedTriangleId(triangleIdx)));
-        } else {
-            // Insert all detail triangles for this tri
-            const TriangleDetail* detail = getTriangleDetail(triangleIdx);
-            P_ASSERT(detail);
-            const auto& detailTriangles = detail->getTriangles();
-            for(size_t detailIdx = 0; detailIdx < detailTriangles.size(); detailIdx++) {
-                mTreeDetailed->insert(DataTriangleAABBPrimitive(this, DetailedTriangleId(triangleIdx, detailIdx)));
+namespace {
+/// Plain data copy of the triangles of one TriangleDetail, with its vertices welded
+struct DetailMeshSnapshot {
+    /// Welding keys, the same float positions the original vertices are welded by
+    std::vector<glm::vec3> keys;
+
+    /// Full precision positions of the welded vertices
+    std::vector<glm::dvec3> positions;
+
+    std::vector<std::array<size_t, 3>> indices;
+};
+
+DetailMeshSnapshot getDetailMeshSnapshot(const TriangleDetail& detail) {
+    const auto& detailTriangles = detail.getTriangles();
+    DetailMeshSnapshot snapshot;
+    snapshot.indices.reserve(detailTriangles.size());
+
+    VertexWelder welder(detailTriangles.size() + 2);
+    for(const DataTriangle& detailTriangle : detailTriangles) {
+        P_ASSERT(!detailTriangle.getTri().is_degenerate());
+
+        std::array<size_t, 3> triangleIndices;
+        for(int i = 0; i < 3; i++) {
+            // Runs on many threads at once: CGAL objects are ref counted, so no copies of them are made here, the
+            // vertex is taken by reference and only its double coordinates are read
+            const auto& vertex = detailTriangle.getTri().vertex(i);
+            const glm::dvec3 position(vertex.x(), vertex.y(), vertex.z());
+            triangleIndices[i] = welder.addVertex(glm::vec3(position));
+            if(triangleIndices[i] == snapshot.positions.size()) {
+                snapshot.positions.push_back(position);
             }
         }
+        snapshot.indices.push_back(triangleIndices);
     }
+    snapshot.keys = welder.takeVertices();
 
-    mTreeDetailed->build();
+    return snapshot;
 }
+}  // namespace
 
-void Geometry::buildDetailedMesh() {
+bool Geometry::buildDetailedMesh() {
     if(!mPolyhedronData.valid) {
         CI_LOG_E("Attempted to build detailed mesh when basic mash is not available");
-        return;
+        return false;
     }
 
     mMeshDetailed = std::make_unique<PolyhedronData::Mesh>();
@@ -756,89 +1115,175 @@ void Geometry::buildDetailedMesh() {
     boost::tie(mMeshDetailedIdMap, created) =
         mMeshDetailed->add_property_map<PolyhedronData::face_descriptor, DetailedTriangleId>("f:idOfEachTriangle",
                                                                                              DetailedTriangleId());
+    P_ASSERT(created);
+
     /**
      *  Yes, we are about to hash floating point values.
      *  These values come from CGAL exact kernel, so they should be bit-equal and safe to hash.
      *  There is no betters way to get indices before this, as different color parts are stored in different polygons.
      */
-    auto hashFunc = [](const glm::vec3& vec) {
-        return std::hash<float>{}(vec.x) ^ std::hash<float>{}(vec.y) ^ std::hash<float>{}(vec.z);
-    };
-
-    std::unordered_map<glm::vec3, PolyhedronData::vertex_descriptor, decltype(hashFunc)> ptToVertexDesc(
-        3 * mTriangles.size(), hashFunc);
-
-    P_ASSERT(created);
-    std::vector<PolyhedronData::vertex_descriptor> vertDescs;
-    vertDescs.reserve(mPolyhedronData.vertices.size());
+    // A triangulated detail rarely has more vertices than triangles plus two, so the lookup should not need to grow
+    size_t vertexCount = mPolyhedronData.vertices.size();
+    for(const auto& triDetailIt : mTriangleDetails) {
+        vertexCount += triDetailIt.second.getTriangles().size() + 2;
+    }
+    mMeshDetailedVertexLookup.clear();
+    mMeshDetailedVertexLookup.reserve(vertexCount);
 
     // Add original vertices
     for(const auto& vertex : mPolyhedronData.vertices) {
         PolyhedronData::vertex_descriptor v =
             mMeshDetailed->add_vertex(DataTriangle::Point(vertex.x, vertex.y, vertex.z));
-        ptToVertexDesc[vertex] = v;
-        vertDescs.push_back(v);
+        mMeshDetailedVertexLookup.emplace(vertex + glm::vec3(0.0f), v);
     }
 
-    // Add original simple faces
-    for(size_t i = 0; i < mPolyhedronData.indices.size(); i++) {
-        const auto& tri = mPolyhedronData.indices[i];
-
-        if(isSimpleTriangle(i)) {
-            auto f = mMeshDetailed->add_face(vertDescs[tri[0]], vertDescs[tri[1]], vertDescs[tri[2]]);
-            if(f == PolyhedronData::Mesh::null_face()) {
-                // Adding a non-valid face, the model is wrong and we stop.
-                mMeshDetailed.reset();
-                return;
-            } else {
-                P_ASSERT(f != PolyhedronData::Mesh::null_face());
-                mMeshDetailedFaceDescs[DetailedTriangleId(i)] = f;
-                mMeshDetailedIdMap[f] = DetailedTriangleId(i);
-            }
+    std::vector<size_t> triangles(mPolyhedronData.indices.size());
+    std::iota(triangles.begin(), triangles.end(), 0);
+    return addDetailedFaces(triangles);
+}
+
+bool Geometry::updateDetailedMesh() {
+    P_ASSERT(mMeshDetailed);
+
+    for(const size_t triangleIdx : mMeshDetailedChangedTriangles) {
+        removeDetailedFaces(triangleIdx);
+    }
+
+    // Removed elements are reused by the added ones, so the mesh does not need a garbage collection
+    return addDetailedFaces(
+        std::vector<size_t>(mMeshDetailedChangedTriangles.begin(), mMeshDetailedChangedTriangles.end()));
+}
+
+void Geometry::removeDetailedFaces(const size_t triangleIdx) {
+    P_ASSERT(mMeshDetailed);
+    auto& mesh = *mMeshDetailed;
+
+    // Either the original triangle, or detail triangles numbered from 0
+    std::vector<DetailedTriangleId> faceIds = {DetailedTriangleId(triangleIdx)};
+    for(size_t detailIdx = 0;
+        mMeshDetailedFaceDescs.find(DetailedTriangleId(triangleIdx, detailIdx)) != mMeshDetailedFaceDescs.end();
+        detailIdx++) {
+        faceIds.emplace_back(triangleIdx, detailIdx);
+    }
+
+    std::vector<PolyhedronData::vertex_descriptor> faceVertices;
+    for(const DetailedTriangleId& faceId : faceIds) {
+        const auto faceIt = mMeshDetailedFaceDescs.find(faceId);
+        if(faceIt == mMeshDetailedFaceDescs.end()) {
+            continue;
+        }
+
+        const PolyhedronData::face_descriptor face = faceIt->second;
+        for(const PolyhedronData::vertex_descriptor vertex : CGAL::vertices_around_face(mesh.halfedge(face), mesh)) {
+            faceVertices.push_back(vertex);
         }
+        CGAL::Euler::remove_face(mesh.halfedge(face), mesh);
+        mMeshDetailedFaceDescs.erase(faceIt);
     }
 
-    // Add detailed faces
-    for(const auto& triDetailIt : mTriangleDetails) {
-        const size_t triangleId = triDetailIt.first;
-        const auto& detailTriangles = triDetailIt.second.getTriangles();
+    // Isolated vertices were removed together with the faces, new faces must not be joined with them
+    for(const PolyhedronData::vertex_descriptor vertex : faceVertices) {
+        if(!mesh.is_removed(vertex)) {
+            continue;
+        }
+        const auto& point = mesh.point(vertex);
+        const glm::vec3 key = glm::vec3(glm::dvec3(point.x(), point.y(), point.z())) + glm::vec3(0.0f);
+        const PolyhedronData::vertex_descriptor* lookupVertex = mMeshDetailedVertexLookup.find(key);
+        if(lookupVertex != nullptr && *lookupVertex == vertex) {
+            mMeshDetailedVertexLookup.erase(key);
+        }
+    }
+}
 
-        // Add detail triangles while combining common vertices
-        for(size_t detailTriangleIdx = 0; detailTriangleIdx < detailTriangles.size(); detailTriangleIdx++) {
-            const DataTriangle& detail = detailTriangles[detailTriangleIdx];
+bool Geometry::addDetailedFaces(const std::vector<size_t>& triangles) {
+    P_ASSERT(mMeshDetailed);
 
-            P_ASSERT(!detail.getTri().is_degenerate());
+    /// Snapshot and weld every detail in parallel, details only need to be triangulated
+    std::vector<std::pair<size_t, const TriangleDetail*>> details;
+    for(const size_t triangleIdx : triangles) {
+        if(const TriangleDetail* detail = mTriangleDetails.find(triangleIdx)) {
+            P_ASSERT(!detail->needsTriangulation());
+            details.emplace_back(triangleIdx, detail);
+        }
+    }
 
-            // Vertex descriptors of current detail triangle
-            std::array<PolyhedronData::vertex_descriptor, 3> vertDescriptors;
+    std::vector<size_t> detailIndices(details.size());
+    std::iota(detailIndices.begin(), detailIndices.end(), 0);
+    std::vector<DetailMeshSnapshot> snapshots(details.size());
+    MainApplication::getThreadPool().parallel_for(
+        detailIndices.begin(), detailIndices.end(),
+        [&details, &snapshots](size_t i) { snapshots[i] = getDetailMeshSnapshot(*details[i].second); });
 
-            for(int i = 0; i < 3; i++) {
-                // Get iterator to vertex ID for current vertex
-                auto it = ptToVertexDesc.find(detail.getVertex(i));
-                if(it == ptToVertexDesc.end()) {
-                    auto vertexDesc = mMeshDetailed->add_vertex(detail.getTri().vertex(i));
-                    P_ASSERT(vertexDesc != PolyhedronData::Mesh::null_vertex());
-                    it = ptToVertexDesc.insert(std::make_pair(detail.getVertex(i), vertexDesc)).first;
-                }
+    size_t detailVertexCount = 0;
+    for(const DetailMeshSnapshot& snapshot : snapshots) {
+        detailVertexCount += snapshot.keys.size();
+    }
+    mMeshDetailedVertexLookup.reserve(mMeshDetailedVertexLookup.size() + detailVertexCount);
 
-                vertDescriptors[i] = it->second;
-            }
+    // Find the vertex with this welding key in the mesh, or add it
+    const auto getVertex = [this](const glm::vec3& key, const glm::dvec3& position) {
+        const PolyhedronData::vertex_descriptor* vertexDesc = mMeshDetailedVertexLookup.find(key);
+        if(vertexDesc != nullptr) {
+            return *vertexDesc;
+        }
+        auto newVertexDesc = mMeshDetailed->add_vertex(DataTriangle::Point(position.x, position.y, position.z));
+        P_ASSERT(newVertexDesc != PolyhedronData::Mesh::null_vertex());
+        mMeshDetailedVertexLookup.emplace(key, newVertexDesc);
+        return newVertexDesc;
+    };
+
+    // Add original simple faces
+    for(const size_t triangleIdx : triangles) {
+        if(!isSimpleTriangle(triangleIdx)) {
+            continue;
+        }
+
+        std::array<PolyhedronData::vertex_descriptor, 3> vertices;
+        for(size_t i = 0; i < 3; i++) {
+            const glm::vec3& vertex = mPolyhedronData.vertices[mPolyhedronData.indices[triangleIdx][i]];
+            vertices[i] = getVertex(vertex + glm::vec3(0.0f), glm::dvec3(vertex));
+        }
 
-            auto faceDesc = mMeshDetailed->add_face(vertDescriptors);
+        auto f = mMeshDetailed->add_face(vertices[0], vertices[1], vertices[2]);
+        if(f == PolyhedronData::Mesh::null_face()) {
+            // Adding a non-valid face, the model is wrong and we stop.
+            invalidateTemporaryDetailedData();
+            return false;
+        } else {
+            mMeshDetailedFaceDescs[DetailedTriangleId(triangleIdx)] = f;
+            mMeshDetailedIdMap[f] = DetailedTriangleId(triangleIdx);
+        }
+    }
+
+    // Add detailed faces in the order of the details, so that the mesh does not depend on the scheduling
+    for(size_t snapshotIdx = 0; snapshotIdx < snapshots.size(); snapshotIdx++) {
+        const size_t triangleId = details[snapshotIdx].first;
+        const DetailMeshSnapshot& snapshot = snapshots[snapshotIdx];
+
+        // Join the vertices of this detail with the vertices of the rest of the mesh
+        std::vector<PolyhedronData::vertex_descriptor> localToMesh(snapshot.keys.size());
+        for(size_t localIdx = 0; localIdx < snapshot.keys.size(); localIdx++) {
+            localToMesh[localIdx] = getVertex(snapshot.keys[localIdx], snapshot.positions[localIdx]);
+        }
+
+        for(size_t detailTriangleIdx = 0; detailTriangleIdx < snapshot.indices.size(); detailTriangleIdx++) {
+            const std::array<size_t, 3>& indices = snapshot.indices[detailTriangleIdx];
+            auto faceDesc =
+                mMeshDetailed->add_face(localToMesh[indices[0]], localToMesh[indices[1]], localToMesh[indices[2]]);
             P_ASSERT(faceDesc != PolyhedronData::Mesh::null_face());
             if(faceDesc != PolyhedronData::Mesh::null_face()) {
                 mMeshDetailedFaceDescs.insert(
                     std::make_pair(DetailedTriangleId(triangleId, detailTriangleIdx), faceDesc));
                 mMeshDetailedIdMap[faceDesc] = DetailedTriangleId(triangleId, detailTriangleIdx);
             } else {
-                const double sqrdArea = detail.getTri().squared_area();
                 CI_LOG_E("A null face was generated in the detailed mesh. This should not happen");
-                CI_LOG_E(std::to_string(sqrdArea));
-                mMeshDetailed.reset();
-                return;
+                invalidateTemporaryDetailedData();
+                return false;
             }
         }
     }
+
+    return true;
 }
 
 void Geometry::correctSharedVertices() {
@@ -849,107 +1294,147 @@ void Geometry::correctSharedVertices() {
 
     auto startTime = std::chrono::high_resolution_clock::now();
 
-    // We must fix every edge that connects from a TriangleDetail to other triangle
-
-    // Array of details that will need to be converted back to triangles
-    // This can be done in parallel
-    std::set<size_t> detailsToTriangulate;
-
-    const auto& mesh = mPolyhedronData.mMesh;
-
-    for(const PolyhedronData::edge_descriptor edge : mesh.edges()) {
-        const auto firstHalfEdge = mesh.halfedge(edge, 0);
-        const auto secondHalfEdge = mesh.halfedge(edge, 1);
-
-        if(firstHalfEdge == PolyhedronData::Mesh::null_halfedge() ||
-           secondHalfEdge == PolyhedronData::Mesh::null_halfedge()) {
-            continue;
+    // We must fix every edge that connects from a TriangleDetail to other triangle.
+    // Edges between unchanged triangles were already fixed by an earlier update, unless the mesh is built from scratch.
+    std::vector<std::pair<size_t, size_t>> edges;
+    const auto addEdgesOf = [this, &edges](const size_t triIdx) {
+        for(const int32_t neighbour : mPolyhedronData.adjacency[triIdx]) {
+            if(neighbour >= 0) {
+                edges.emplace_back(std::min<size_t>(triIdx, neighbour), std::max<size_t>(triIdx, neighbour));
+            }
         }
+    };
 
-        const auto firstFace = mesh.face(firstHalfEdge);
-        const auto secondFace = mesh.face(secondHalfEdge);
-        if(firstFace == PolyhedronData::Mesh::null_face() || secondFace == PolyhedronData::Mesh::null_face()) {
-            continue;
+    if(mMeshDetailed) {
+        for(const size_t triIdx : mMeshDetailedChangedTriangles) {
+            addEdgesOf(triIdx);
         }
+    } else {
+        for(const auto& triDetailIt : mTriangleDetails) {
+            addEdgesOf(triDetailIt.first);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
 
-        const size_t firstTriIdx = mPolyhedronData.mIdMap[firstFace];
-        const size_t secondTriIdx = mPolyhedronData.mIdMap[secondFace];
+    // Stays serial: the exact kernel points are ref counted handles, which correcting copies between the details.
+    // Details that do not share an edge can still share the handles, e.g. all details around a vertex, so even
+    // correcting edges without a common detail in parallel would race on them.
+    for(const auto& edge : edges) {
+        const size_t firstTriIdx = edge.first;
+        const size_t secondTriIdx = edge.second;
 
         if(!isSimpleTriangle(firstTriIdx) || !isSimpleTriangle(secondTriIdx)) {
             std::pair<bool, bool> didAdd =
                 getTriangleDetail(firstTriIdx)->correctSharedVertices(*getTriangleDetail(secondTriIdx));
 
-            // Mark to triangulate later if any points added
+            // Details with added points are triangulated again by the next flushDetails()
             if(didAdd.first) {
-                detailsToTriangulate.insert(firstTriIdx);
+                markTriangleDirty(firstTriIdx);
+                markTriangleDetailChanged(firstTriIdx);
             }
 
             if(didAdd.second) {
-                detailsToTriangulate.insert(secondTriIdx);
+                markTriangleDirty(secondTriIdx);
+                markTriangleDetailChanged(secondTriIdx);
             }
         }
     }
 
-    // Triangulate details in parallel
-    std::vector<std::future<void>> tasks;
-    ThreadPool& threadPool = MainApplication::getThreadPool();
-    for(size_t triIdx : detailsToTriangulate) {
-        tasks.emplace_back(threadPool.enqueue([](TriangleDetail* detail) { detail->updateTrianglesFromPolygons(); },
-                                              getTriangleDetail(triIdx)));
-    }
-
-    std::for_each(tasks.begin(), tasks.end(), [](auto& t) { t.get(); });
-
     const auto endTime = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> timeMs = endTime - startTime;
 
-    mOgl.isDirty = true;
-    CI_LOG_I("Correcting shared vertices took " + std::to_string(timeMs.count()) + " ms");
+    CI_LOG_I("Correcting shared vertices of " + std::to_string(edges.size()) + " edges took " +
+             std::to_string(timeMs.count()) + " ms");
 }
 
-void Geometry::updateTemporaryDetailedData() {
+bool Geometry::updateTemporaryDetailedData() {
     const auto start = std::chrono::high_resolution_clock::now();
 
     correctSharedVertices();
-    // Important! Do this in a single thread. Epeck kernel used by TriangleDetail
-    // is not thread safe even for read-only access
-    buildDetailedMesh();
-    buildDetailedTree();
+    flushDetails();
+
+    // The mesh is built in this thread, only the snapshots of the triangulated details are taken in parallel
+    bool isBuilt = false;
+    if(mMeshDetailed) {
+        isBuilt = updateDetailedMesh();
+        if(!isBuilt) {
+            // The failed update reset the detailed mesh, building it from scratch does not depend on the old faces
+            CI_LOG_W("Updating the detailed mesh failed, building it again");
+            isBuilt = buildDetailedMesh();
+        }
+    } else {
+        isBuilt = buildDetailedMesh();
+    }
+
+    if(!isBuilt) {
+        CI_LOG_E("The detailed mesh could not be built");
+        return false;
+    }
+    mMeshDetailedChangedTriangles.clear();
 
     const auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> timeMs = end - start;
     CI_LOG_I("Updating temporary detailed data took " + std::to_string(timeMs.count()) + " ms");
+    return true;
+}
+
+void Geometry::flushDetails() {
+    std::vector<TriangleDetail*> details;
+    for(const auto& it : mTriangleDetails) {
+        if(it.second.needsTriangulation()) {
+            details.push_back(&it.second);
+        }
+    }
+
+    if(details.empty()) {
+        return;
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    MainApplication::getThreadPool().parallel_for(details.begin(), details.end(),
+                                                  [](TriangleDetail* detail) { detail->flushTriangles(); });
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> timeMs = end - start;
+    CI_LOG_I("Triangulating " + std::to_string(details.size()) + " details took " + std::to_string(timeMs.count()) +
+             " ms");
 }
 
 void Geometry::invalidateTemporaryDetailedData() {
-    mTreeDetailed.reset();
     mMeshDetailed.reset();
+    mMeshDetailedFaceDescs.clear();
+    mMeshDetailedVertexLookup.clear();
+    mMeshDetailedChangedTriangles.clear();
 }
 
-std::array<int, 3> Geometry::gatherNeighbours(const size_t triIndex) const {
+void Geometry::buildAdjacency() {
     const auto& faceDescriptors = mPolyhedronData.mFaceDescs;
     const auto& mesh = mPolyhedronData.mMesh;
-    P_ASSERT(triIndex < faceDescriptors.size());
-    std::array<int, 3> returnValue = {-1, -1, -1};
-    const PolyhedronData::face_descriptor face = faceDescriptors[triIndex];
-    const auto edge = mesh.halfedge(face);
-    auto itEdge = edge;
 
-    for(int i = 0; i < 3; ++i) {
-        const auto oppositeEdge = mesh.opposite(itEdge);
-        if(oppositeEdge.is_valid() && !mesh.is_border(oppositeEdge)) {
-            const PolyhedronData::Mesh::Face_index neighbourFace = mesh.face(oppositeEdge);
-            const size_t neighbourFaceId = mPolyhedronData.mIdMap[neighbourFace];
-            P_ASSERT(neighbourFaceId < mTriangles.size());
-            returnValue[i] = static_cast<int>(neighbourFaceId);
-        }
+    mPolyhedronData.adjacency.assign(faceDescriptors.size(), {-1, -1, -1});
+    for(size_t triIndex = 0; triIndex < faceDescriptors.size(); ++triIndex) {
+        std::array<int32_t, 3>& neighbours = mPolyhedronData.adjacency[triIndex];
+        const PolyhedronData::face_descriptor face = faceDescriptors[triIndex];
+        const auto edge = mesh.halfedge(face);
+        auto itEdge = edge;
+
+        for(int i = 0; i < 3; ++i) {
+            const auto oppositeEdge = mesh.opposite(itEdge);
+            if(oppositeEdge.is_valid() && !mesh.is_border(oppositeEdge)) {
+                const PolyhedronData::Mesh::Face_index neighbourFace = mesh.face(oppositeEdge);
+                const size_t neighbourFaceId = mPolyhedronData.mIdMap[neighbourFace];
+                P_ASSERT(neighbourFaceId < mTriangles.size());
+                neighbours[i] = static_cast<int32_t>(neighbourFaceId);
+            }
 
-        itEdge = mesh.next(itEdge);
+            itEdge = mesh.next(itEdge);
+        }
+        P_ASSERT(edge == itEdge);
     }
-    P_ASSERT(edge == itEdge);
-
-    return returnValue;
 }
+
 std::array<std::optional<DetailedTriangleId>, 3> Geometry::gatherNeighbours(const DetailedTriangleId triId) const {
     P_ASSERT(mMeshDetailed);
 
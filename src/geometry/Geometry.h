@@ -12,24 +12,47 @@
 #include <cereal/types/vector.hpp>
 #include "cinder/Log.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <optional>
+#include <set>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+#include "ThreadPool.h"
+
+#include "geometry/BoundingSphereTree.h"
 #include "geometry/ColorManager.h"
+#include "geometry/DetailSlabAllocator.h"
 #include "geometry/GeometryProgress.h"
 #include "geometry/GlmSerialization.h"
 #include "geometry/ModelImporter.h"
 #include "geometry/PolyhedronData.h"
+#include "geometry/PositionMap.h"
 #include "geometry/Triangle.h"
 #include "geometry/TriangleDetail.h"
+#include "geometry/TriangleSlotTable.h"
 #include "geometry/TrianglePrimitive.h"
+#include "geometry/TriangleStore.h"
 #include "peprassert.h"
 #include "tools/Brush.h"
 
 namespace pepr3d {
 
+/// Stopping conditions of bucket spreading that only read the Geometry and their own state can declare
+/// `static constexpr bool isPure = true;`. Such conditions may be evaluated concurrently by the parallel spread.
+template <typename StoppingCondition, typename = void>
+struct IsPureStoppingCondition : std::false_type {};
+
+template <typename StoppingCondition>
+struct IsPureStoppingCondition<StoppingCondition, std::void_t<decltype(StoppingCondition::isPure)>>
+    : std::bool_constant<StoppingCondition::isPure> {};
+
 /// The whole geometry of a model that the user is painting
 class Geometry {
    public:
@@ -103,33 +126,46 @@ class Geometry {
     };
 
    private:
-    /// Triangle soup of the original model mesh, containing CGAL::Triangle_3 data for AABB tree.
-    std::vector<DataTriangle> mTriangles;
+    /// Triangle soup of the original model mesh, CGAL::Triangle_3 data for AABB tree is built from it on demand.
+    TriangleStore mTriangles;
 
     /// Stores a rough collision sphere for each triangle
     /// in a form of a center point + radius.
     /// Used to speed up capsule/cylinder querries on original triangles.
     std::vector<std::pair<Point3, double>> mTriangleBounds;
 
-    /// Map of triangle details. (Detailed triangles that replace the original)
-    std::map<size_t, TriangleDetail> mTriangleDetails;
+    /// Hierarchy over mTriangleBounds, answers radius queries without scanning all triangles
+    BoundingSphereTree mTriangleBoundsTree;
+
+    /// Triangle details of original triangles. (Detailed triangles that replace the original)
+    TriangleSlotTable<TriangleDetail> mTriangleDetails;
+
+    /// baseTriangleId -> Range of detail triangle slots in mOgl buffers
+    TriangleSlotTable<DetailSlabAllocator::Slab> mTriangleDetailBufferSlabs;
 
-    /// Map of baseTriangleId -> Index of first detail triangle color in mOgl.colorBuffer
-    std::map<size_t, size_t> mTriangleDetailColorBufferStart;
+    /// Allocator of detail triangle ranges, placed after the original triangles in mOgl buffers
+    DetailSlabAllocator mDetailSlabAllocator;
 
     /// All open GL buffers
     OpenGlData mOgl;
 
+    /// Original triangles whose OpenGL data changed since the last buffer update
+    std::set<size_t> mOglDirtyTriangles;
+
+    /// Original triangles that are set in mOgl.highlightMask, together with their details.
+    /// Unused if mIsOglHighlightingAll, in which case every triangle is set.
+    std::set<size_t> mOglHighlightedTriangles;
+    bool mIsOglHighlightingAll = false;
+
+    /// OpenGL buffers need to be regenerated from scratch instead of patching mOglDirtyTriangles
+    bool mOglNeedsFullRebuild{true};
+
     /// Polyhedron structure
     PolyhedronData mPolyhedronData;
 
     /// AABB tree from the CGAL library, to find intersections with rays generated by user mouse clicks and the mesh.
     std::unique_ptr<Tree> mTree;
 
-    /// AABB tree built over all triangles, including details. This tree is invalidated on every operation that changes
-    /// triangleDetail topology.
-    std::unique_ptr<Tree> mTreeDetailed;
-
     // ----- Detailed Mesh Data ------
 
     /// Surface mesh with detail triangles included
@@ -140,6 +176,13 @@ class Geometry {
     /// Map converting a face_descriptor into an ID
     PolyhedronData::Mesh::Property_map<PolyhedronData::face_descriptor, DetailedTriangleId> mMeshDetailedIdMap;
 
+    /// Vertices of mMeshDetailed by their welding key, kept between updates to join re-added faces with the rest
+    PositionMap<PolyhedronData::vertex_descriptor> mMeshDetailedVertexLookup;
+
+    /// Original triangles whose faces in mMeshDetailed are out of date, because their detail was created, changed or
+    /// removed since the last update
+    std::set<size_t> mMeshDetailedChangedTriangles;
+
     // ----- END of Detailed Mesh Data ------
 
     /// AABB of the whole mesh
@@ -154,19 +197,62 @@ class Geometry {
     /// Current progress of import, tree, polyhedron building, export, etc.
     std::unique_ptr<GeometryProgress> mProgress;
 
+    /// Snapshot of everything that commands can change.
+    /// Original triangles are split into chunks, chunks without changes are shared with the previous snapshot.
     struct GeometryState {
-        std::vector<size_t> triangleColors;
-        std::map<size_t, TriangleDetail> triangleDetails;
+        /// Colors and details of a continuous range of sSnapshotChunkSize original triangles
+        struct Chunk {
+            std::vector<size_t> triangleColors;
+
+            /// Details of triangles in this chunk, shared with other chunks until the triangle changes
+            std::map<size_t, std::shared_ptr<const TriangleDetail>> triangleDetails;
+        };
+
+        std::vector<std::shared_ptr<const Chunk>> chunks;
         ColorManager::ColorMap colorMap;
+
+        /// Approximate memory used by this state
+        size_t getMemoryBytes() const {
+            return getMemoryBytesExcluding(nullptr);
+        }
+
+        /// Approximate memory used by this state that is not shared with the other state
+        size_t getMemoryBytesExcluding(const GeometryState& other) const {
+            return getMemoryBytesExcluding(&other);
+        }
+
+        /// Chunks are saved with full copies of their details, sharing is not preserved
+        template <class Archive>
+        void save(Archive& archive) const;
+
+        template <class Archive>
+        void load(Archive& archive);
+
+       private:
+        size_t getMemoryBytesExcluding(const GeometryState* other) const;
     };
 
+    /// Number of original triangles in one GeometryState::Chunk
+    static const size_t sSnapshotChunkSize = 1024;
+
+    /// The last saved or loaded state, new snapshots share all unchanged chunks and details with it
+    mutable GeometryState mSnapshotBase;
+
+    /// Does mSnapshotBase match the current state, except for mSnapshotChangedTriangles
+    mutable bool mSnapshotBaseValid{false};
+
+    /// Original triangles whose color or detail changed since mSnapshotBase
+    mutable std::set<size_t> mSnapshotChangedTriangles;
+
     friend class cereal::access;
 
    public:
     /// Empty constructor
     Geometry() : mTree(std::make_unique<Tree>()), mProgress(std::make_unique<GeometryProgress>()) {}
 
-    Geometry(std::vector<DataTriangle>&& triangles)
+    Geometry(std::vector<DataTriangle>&& triangles) : Geometry(TriangleStore(triangles)) {}
+
+    Geometry(TriangleStore&& triangles)
         : mTriangles(std::move(triangles)), mProgress(std::make_unique<GeometryProgress>()) {
         generateVertexBuffer();
         generateTriangleBounds();
@@ -175,7 +261,6 @@ class Geometry {
         generateNormalBuffer();
         P_ASSERT(mOgl.indexBuffer.size() == mOgl.vertexBuffer.size());
         buildTree();
-        buildDetailedTree();
 
         P_ASSERT(mTree->size() == mTriangles.size());
         if(!mTree->empty()) {
@@ -183,6 +268,17 @@ class Geometry {
         }
     }
 
+    /// Construct the geometry from a triangle soup together with its joined vertices and the indices of every triangle
+    /// into them, building the polyhedron as well
+    Geometry(std::vector<DataTriangle>&& triangles, std::vector<glm::vec3>&& vertices,
+             std::vector<std::array<size_t, 3>>&& indices)
+        : Geometry(std::move(triangles)) {
+        P_ASSERT(indices.size() == mTriangles.size());
+        mPolyhedronData.vertices = std::move(vertices);
+        mPolyhedronData.indices = std::move(indices);
+        buildPolyhedron();
+    }
+
     std::vector<glm::vec3>& getVertexBuffer() {
         return mOgl.vertexBuffer;
     }
@@ -195,6 +291,16 @@ class Geometry {
         return mPolyhedronData.vertices.size();
     }
 
+    /// Vertices joined by their position, empty if the geometry was constructed without them
+    const std::vector<glm::vec3>& getPolyhedronVertices() const {
+        return mPolyhedronData.vertices;
+    }
+
+    /// Indices of every triangle into getPolyhedronVertices, empty if the geometry was constructed without them
+    const std::vector<std::array<size_t, 3>>& getPolyhedronIndices() const {
+        return mPolyhedronData.indices;
+    }
+
     const OpenGlData& getOpenGlData() const {
         // Since we use a new vertex for each triangle, we should have vertices == triangles
         P_ASSERT(mOgl.indexBuffer.size() == mOgl.vertexBuffer.size());
@@ -206,17 +312,28 @@ class Geometry {
     }
 
     /// Update buffers used by openGl. Should only be called when they are dirty
+    /// Only the triangles changed since the last update are rewritten, unless a full rebuild was requested.
     void updateOpenGlBuffers() {
         P_ASSERT(mOgl.isDirty);  // Called unnecessarily. Most likely by error.
 
         const auto start = std::chrono::high_resolution_clock::now();
+        const bool fullRebuild = mOglNeedsFullRebuild;
 
-        generateVertexBuffer();
-        generateIndexBuffer();
-        generateColorBuffer();
-        generateNormalBuffer();
-        generateHighlightBuffer();
+        flushDetails();
+
+        if(fullRebuild) {
+            generateVertexBuffer();
+            generateIndexBuffer();
+            generateColorBuffer();
+            generateNormalBuffer();
+            generateHighlightBuffer();
+        } else {
+            updateDirtyBufferSlots();
+            updateHighlightBuffer();
+        }
 
+        mOglDirtyTriangles.clear();
+        mOglNeedsFullRebuild = false;
         mOgl.isDirty = false;
         mOgl.info.didColorUpdate = false;
         mOgl.info.didHighlightUpdate = false;
@@ -224,15 +341,28 @@ class Geometry {
         const auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double, std::milli> timeMs = end - start;
 
-        CI_LOG_I("Generating buffers took " + std::to_string(timeMs.count()) + " ms");
+        CI_LOG_I(std::string(fullRebuild ? "Generating" : "Patching") + " buffers took " +
+                 std::to_string(timeMs.count()) + " ms");
     }
 
-    /// Update temporary detailed data like detailed AABB tree and detailed Mesh
-    /// This is a slow operation
-    void updateTemporaryDetailedData();
+    /// Force the next updateOpenGlBuffers() to regenerate all buffers from scratch
+    void invalidateOpenGlBuffers() {
+        mOglNeedsFullRebuild = true;
+        mOgl.isDirty = true;
+    }
+
+    /// Update temporary detailed data like the detailed mesh.
+    /// Only faces of triangles changed since the last update are replaced, the first update builds everything.
+    /// A failed update is retried once by building everything again.
+    /// @return false if the detailed mesh could not be built, e.g. the model is damaged, the data stay invalid then
+    bool updateTemporaryDetailedData();
+
+    /// Triangulate all triangle details whose polygons changed since their last triangulation, in parallel
+    /// Called before anything reads the detail triangles in bulk, e.g. buffer updates and detailed mesh builds
+    void flushDetails();
 
     bool isTemporaryDetailedDataValid() const {
-        return mMeshDetailed && mTreeDetailed;
+        return mMeshDetailed && mMeshDetailedChangedTriangles.empty();
     }
 
     glm::vec3 getBoundingBoxMin() const {
@@ -257,12 +387,15 @@ class Geometry {
         mAreaHighlight.enabled = false;
     }
 
-    const DataTriangle& getTriangle(const size_t triangleIndex) const {
+    /// Get a copy of the triangle, built from the packed triangle data.
+    /// Original triangles are not stored as DataTriangle, so there is nothing to return a reference to. Loops over
+    /// many triangles should use getTriangleVertex, getTriangleColor, getTriangleNormal and getCgalTriangle instead.
+    DataTriangle getTriangle(const size_t triangleIndex) const {
         P_ASSERT(triangleIndex < mTriangles.size());
         return mTriangles[triangleIndex];
     }
 
-    const DataTriangle& getTriangle(const DetailedTriangleId triangleId) const {
+    DataTriangle getTriangle(const DetailedTriangleId triangleId) const {
         const size_t baseId = triangleId.getBaseId();
         const std::optional<size_t> detailId = triangleId.getDetailId();
 
@@ -276,12 +409,52 @@ class Geometry {
         }
     }
 
+    /// Get a detail triangle without copying it, triangleId has to refer to a detail triangle
+    const DataTriangle& getDetailTriangle(const DetailedTriangleId triangleId) const {
+        const std::optional<size_t> detailId = triangleId.getDetailId();
+        P_ASSERT(detailId);
+        P_ASSERT(*detailId < getTriangleDetailCount(triangleId.getBaseId()));
+        return mTriangleDetails.at(triangleId.getBaseId()).getTriangles()[*detailId];
+    }
+
+    glm::vec3 getTriangleVertex(const size_t triangleIndex, const size_t vertexIdx) const {
+        return mTriangles.getVertex(triangleIndex, vertexIdx);
+    }
+
+    glm::vec3 getTriangleVertex(const DetailedTriangleId triangleId, const size_t vertexIdx) const {
+        if(triangleId.getDetailId()) {
+            return getDetailTriangle(triangleId).getVertex(vertexIdx);
+        } else {
+            return mTriangles.getVertex(triangleId.getBaseId(), vertexIdx);
+        }
+    }
+
     size_t getTriangleColor(const size_t triangleIndex) const {
-        return getTriangle(triangleIndex).getColor();
+        return mTriangles.getColor(triangleIndex);
     }
 
     size_t getTriangleColor(const DetailedTriangleId triangleId) const {
-        return getTriangle(triangleId).getColor();
+        if(triangleId.getDetailId()) {
+            return getDetailTriangle(triangleId).getColor();
+        } else {
+            return mTriangles.getColor(triangleId.getBaseId());
+        }
+    }
+
+    glm::vec3 getTriangleNormal(const size_t triangleIndex) const {
+        return mTriangles.getNormal(triangleIndex);
+    }
+
+    glm::vec3 getTriangleNormal(const DetailedTriangleId triangleId) const {
+        if(triangleId.getDetailId()) {
+            return getDetailTriangle(triangleId).getNormal();
+        } else {
+            return mTriangles.getNormal(triangleId.getBaseId());
+        }
+    }
+
+    DataTriangle::Triangle getCgalTriangle(const size_t triangleIndex) const {
+        return mTriangles.getCgalTriangle(triangleIndex);
     }
 
     /// Return the number of triangles in the whole mesh
@@ -299,8 +472,7 @@ class Geometry {
 
     bool isSimpleTriangle(size_t triangleIdx) const {
         // Triangle is single color when it has no detail triangles
-        auto it = mTriangleDetails.find(triangleIdx);
-        return it == mTriangleDetails.end();
+        return !mTriangleDetails.contains(triangleIdx);
     }
 
     const GeometryProgress& getProgress() const {
@@ -362,30 +534,41 @@ class Geometry {
     /// @param triangles Triangles in world space representing the shape
     void paintWithShape(const ci::Ray& ray, const std::vector<DataTriangle::Triangle>& triangles, size_t color);
 
+    /// Paint a whole stroke of shaped dabs at once, each touched triangle detail is retriangulated only once
+    /// @param rays Ray along which to project each shape, using orthogonal projection
+    /// @param shapes Points in world space representing a polygonal shape, one shape for each ray
+    void paintWithShapes(const std::vector<ci::Ray>& rays, const std::vector<std::vector<Point3>>& shapes,
+                         size_t color, bool paintBackfaces = false);
+
     /// Paint continuous spherical area with a brush of specified size
     void paintAreaWithSphere(const ci::Ray& ray, const BrushSettings& settings);
 
+    /// Paint a whole stroke of spherical dabs at once, each touched triangle detail is retriangulated only once
+    void paintAreaWithSpheres(const std::vector<ci::Ray>& rays, const BrushSettings& settings);
+
     /// Change all color ID's from one to another
     /// @param ColorFunc functor of type size_t func(size_t originalColor), that returns the new color ID
     template <typename ColorFunc>
     void changeColorIds(const ColorFunc& colorFunc) {
         for(size_t i = 0; i < getTriangleCount(); ++i) {
             if(isSimpleTriangle(i)) {
-                const auto& triangle = getTriangle(i);
-                setTriangleColor(i, colorFunc(triangle.getColor()));
+                setTriangleColor(i, colorFunc(getTriangleColor(i)));
             } else {
                 TriangleDetail* triDetail = getTriangleDetail(i);
                 triDetail->changeColorIds(colorFunc);
             }
         }
 
-        mOgl.isDirty = true;
+        mSnapshotBaseValid = false;
+        invalidateOpenGlBuffers();
     }
 
     /// Save current state into a struct so that it can be restored later (CommandManager target requirement)
+    /// Only chunks changed since the last saved or loaded state are copied, the rest is shared with that state.
     GeometryState saveState() const;
 
     /// Load previous state from a struct (CommandManager target requirement)
+    /// Only triangles that differ from the current state are restored.
     void loadState(const GeometryState&);
 
     /// Spreads as BFS, starting from startTriangle to wherever it can reach.
@@ -401,24 +584,33 @@ class Geometry {
     template <typename StoppingCondition>
     std::vector<size_t> bucket(const std::vector<size_t>& startTriangles, const StoppingCondition& stopFunctor);
 
+    /// Get all triangles connected to the startTriangle without evaluating any stopping condition
+    std::vector<size_t> getConnectedComponent(const size_t startTriangle);
+
+    /// Get all triangles, including detail triangles, connected to the startTriangle.
+    /// Does not need the detailed mesh, the component is gathered on the original mesh.
+    std::vector<DetailedTriangleId> getConnectedComponent(const DetailedTriangleId startTriangle);
+
     /// Spread as BFS from starting triangle, until the limits of brush settings are reached
     std::vector<size_t> getTrianglesUnderBrush(const glm::vec3& originPoint, const glm::vec3& insideDirection,
                                                size_t startTriangle, const struct BrushSettings& settings);
 
+    /// Paint dabs of a stroke onto the details of the triangles they touch
+    /// All dabs of a triangle are joined and applied together, so that each detail is retriangulated only once
+    /// @param dabsOfTriangles Indices of the dabs touching each triangle
+    /// @param getDabPolygon Polygon of a dab projected onto the given triangle detail, called from multiple threads
+    void paintDabs(const std::map<size_t, std::vector<size_t>>& dabsOfTriangles, size_t color,
+                   const std::function<TriangleDetail::Polygon(const TriangleDetail&, size_t)>& getDabPolygon);
+
     /// Get all triangles that are closer to the object than radius
     /// This function operates on spherical bounds of triangles and may therefore return false positives
     /// @param object CGAL Object - point, line, etc
     template <typename Object>
     std::vector<size_t> getTrianglesInRadius(const Object& object, double radius) const {
         P_ASSERT(mTriangleBounds.size() == mTriangles.size());
-        std::vector<size_t> result;
+        P_ASSERT(mTriangleBoundsTree.size() == mTriangleBounds.size());
 
-        for(size_t triIdx = 0; triIdx < mTriangleBounds.size(); ++triIdx) {
-            if(isTriangleInRadius(object, radius, triIdx))
-                result.push_back(triIdx);
-        }
-
-        return result;
+        return mTriangleBoundsTree.query(mTriangleBounds, object, radius);
     }
 
     /// Test if distance from object to spherical boundary of a triangle is closer than radius
@@ -476,17 +668,32 @@ class Geometry {
     void recomputeFromData();
 
     /// Get number of detailed triangles for this baseId
-    size_t getTriangleDetailCount(const DetailedTriangleId triangleIndex) const {
+    size_t getTriangleDetailCount(const DetailedTriangleId triangleIndex) {
         return getTriangleDetailCount(triangleIndex.getBaseId());
     }
 
     /// Get number of detailed triangles for this baseId
+    size_t getTriangleDetailCount(const DetailedTriangleId triangleIndex) const {
+        return getTriangleDetailCount(triangleIndex.getBaseId());
+    }
+
+    /// Get number of detailed triangles for this baseId, the detail is triangulated first if it changed
+    size_t getTriangleDetailCount(const size_t triangleIndex) {
+        TriangleDetail* detail = mTriangleDetails.find(triangleIndex);
+        if(detail == nullptr) {
+            return 0;
+        } else {
+            return detail->getTriangles().size();
+        }
+    }
+
+    /// Get number of detailed triangles for this baseId, the detail has to be triangulated, e.g. by flushDetails()
     size_t getTriangleDetailCount(const size_t triangleIndex) const {
-        auto it = mTriangleDetails.find(triangleIndex);
-        if(it == mTriangleDetails.end()) {
+        const TriangleDetail* detail = mTriangleDetails.find(triangleIndex);
+        if(detail == nullptr) {
             return 0;
         } else {
-            return it->second.getTriangles().size();
+            return detail->getTriangles().size();
         }
     }
 
@@ -512,7 +719,58 @@ class Geometry {
     /// Generate a buffer of highlight information. Saves per-triangle data to each vertex
     void generateHighlightBuffer();
 
-    /// Generate spherical bounds for each original triangle. Used to speed up capsule querries.
+    /// Rewrite the highlight of only the triangles that entered or left mAreaHighlight since the last update.
+    /// Falls back to generateHighlightBuffer() when the mask does not match the buffers or everything is highlighted.
+    void updateHighlightBuffer();
+
+    /// Set the highlight of the vertices of an original triangle and of its whole detail slab
+    void writeTriangleHighlight(size_t triangleIdx, bool isHighlighted);
+
+    /// Rewrite only the buffer slots of mOglDirtyTriangles, moving details to a new slab when they outgrow theirs
+    void updateDirtyBufferSlots();
+
+    /// Write vertices, colors and normals of an original triangle into its slot.
+    /// Triangles replaced by a detail get a degenerate dummy triangle.
+    void writeTriangleToBuffers(size_t triangleIdx);
+
+    /// Write all detail triangles into the slab, padding the unused slots with degenerate triangles
+    void writeDetailToBuffers(const TriangleDetail& detail, const DetailSlabAllocator::Slab& slab);
+
+    /// Fill all slots of the slab with degenerate triangles so that nothing is rendered there
+    void clearBufferSlab(const DetailSlabAllocator::Slab& slab);
+
+    /// Grow all per-vertex buffers so that they cover every slab handed out by mDetailSlabAllocator
+    void resizeBuffersToSlabs();
+
+    /// Remember that OpenGL data of this original triangle (or its detail) changed
+    void markTriangleDirty(const size_t triangleIdx) {
+        mOglDirtyTriangles.insert(triangleIdx);
+        mOgl.isDirty = true;
+        markTriangleChanged(triangleIdx);
+    }
+
+    /// Remember that the detail of this original triangle was created, changed or removed, so that its faces in the
+    /// detailed mesh are replaced by the next updateTemporaryDetailedData()
+    void markTriangleDetailChanged(const size_t triangleIdx) {
+        mMeshDetailedChangedTriangles.insert(triangleIdx);
+    }
+
+    /// Remember that color or detail of this original triangle changed since the last snapshot
+    void markTriangleChanged(const size_t triangleIdx) {
+        mSnapshotChangedTriangles.insert(triangleIdx);
+    }
+
+    /// Create a snapshot chunk from the current state
+    /// @param previous the same chunk in mSnapshotBase, its details are reused for unchanged triangles
+    std::shared_ptr<const GeometryState::Chunk> saveStateChunk(size_t chunkIdx,
+                                                               const GeometryState::Chunk* previous) const;
+
+    /// Restore triangles of a snapshot chunk, only triangles that differ from the current state are touched
+    /// @param previous the same chunk in mSnapshotBase, nullptr if the base is not valid
+    void loadStateChunk(size_t chunkIdx, const GeometryState::Chunk& chunk, const GeometryState::Chunk* previous);
+
+    /// Generate spherical bounds for each original triangle and a hierarchy over them. Used to speed up capsule
+    /// querries.
     void generateTriangleBounds();
 
     /// Build the CGAL Polyhedron construct in mPolyhedronData. Takes a bit of time to rebuild.
@@ -521,35 +779,52 @@ class Geometry {
     /// Builds AABB tree over the original mesh
     void buildTree();
 
-    /// Build AABB Tree over all triangles including details.
-    void buildDetailedTree();
-
     /// Build a CGAL mesh over detailed triangles
-    void buildDetailedMesh();
+    /// @return false if the faces do not form a valid mesh, the detailed mesh is reset then
+    bool buildDetailedMesh();
+
+    /// Replace the faces of triangles in mMeshDetailedChangedTriangles in the existing detailed mesh
+    /// @return false if the faces do not form a valid mesh, the detailed mesh is reset then
+    bool updateDetailedMesh();
+
+    /// Remove all faces of an original triangle or its detail from the detailed mesh, vertices left without a face
+    /// are removed as well
+    void removeDetailedFaces(size_t triangleIdx);
+
+    /// Add the faces of the original triangles, or of their details, to the detailed mesh
+    /// @return false if the faces do not form a valid mesh, the detailed mesh is reset then
+    bool addDetailedFaces(const std::vector<size_t>& triangles);
 
     /// Fixes T-junctions and unmatched vertices on edges of TriangleDetails
-    /// by creating a matching vertex on the neighbouring triangle
+    /// by creating a matching vertex on the neighbouring triangle.
+    /// Only edges of triangles in mMeshDetailedChangedTriangles are checked while the detailed mesh exists.
     void correctSharedVertices();
 
-    /// Invalidate temporary detailed data like detailed AABB tree and mesh.
+    /// Invalidate temporary detailed data, the next update builds the detailed mesh from scratch.
     void invalidateTemporaryDetailedData();
 
     TriangleDetail* createTriangleDetail(size_t triangleIdx);
 
     TriangleDetail* getTriangleDetail(const size_t triangleIndex) {
-        auto it = mTriangleDetails.find(triangleIndex);
-        if(it == mTriangleDetails.end()) {
+        TriangleDetail* detail = mTriangleDetails.find(triangleIndex);
+        if(detail == nullptr) {
             return createTriangleDetail(triangleIndex);
         } else {
-            return &(it->second);
+            return detail;
         }
     }
 
     void removeTriangleDetail(size_t triangleIndex);
 
-    /// Used by BFS in bucket painting. Aggregates the neighbours of the triangle at triIndex by looking
-    /// into the CGAL Polyhedron construct.
-    std::array<int, 3> gatherNeighbours(const size_t triIndex) const;
+    /// Used by BFS in bucket painting. Returns the neighbours of the triangle at triIndex from the adjacency
+    /// precomputed by buildPolyhedron(), -1 for no neighbour.
+    const std::array<int32_t, 3>& gatherNeighbours(const size_t triIndex) const {
+        P_ASSERT(triIndex < mPolyhedronData.adjacency.size());
+        return mPolyhedronData.adjacency[triIndex];
+    }
+
+    /// Fill mPolyhedronData.adjacency by walking the halfedges of every face of the CGAL Polyhedron construct
+    void buildAdjacency();
 
     /// Used by BFS in bucket painting. Aggregates the neighbours of the triangle at triIndex by looking
     /// into the CGAL Polyhedron construct.
@@ -557,8 +832,8 @@ class Geometry {
 
     /// Used by BFS in bucket painting. Manages the queue used to search through the graph.
     template <typename StoppingCondition>
-    void addNeighboursToQueue(const size_t currentVertex, std::unordered_set<size_t>& alreadyVisited,
-                              std::deque<size_t>& toVisit, const StoppingCondition& stopFunctor) const;
+    void addNeighboursToQueue(const size_t currentVertex, std::vector<bool>& alreadyVisited,
+                              std::vector<size_t>& toVisit, const StoppingCondition& stopFunctor) const;
 
     /// Used by BFS in bucket painting. Manages the queue used to search through the graph.
     template <typename StoppingCondition>
@@ -581,8 +856,31 @@ class Geometry {
     void load(Archive& loadArchive);
 
     template <typename StoppingCondition>
-    std::vector<size_t> bucketSpread(const StoppingCondition& stopFunctor, std::deque<size_t>& toVisit,
-                                     std::unordered_set<size_t>& alreadyVisited);
+    std::vector<size_t> bucketSpread(const StoppingCondition& stopFunctor,
+                                     const std::vector<size_t>& startingTriangles);
+
+    /// Level-synchronous BFS expanding each frontier on the thread pool. StoppingCondition has to be pure.
+    template <typename StoppingCondition>
+    std::vector<size_t> bucketSpreadParallel(const StoppingCondition& stopFunctor,
+                                             const std::vector<size_t>& startingTriangles);
+
+    /// Meshes with fewer triangles are spread on a single thread
+    static constexpr size_t sParallelBucketMinTriangles = 100000;
+
+    /// Frontiers with fewer triangles are expanded on the calling thread
+    static constexpr size_t sParallelFrontierMinTriangles = 4096;
+
+    /// Stopping condition that accepts every neighbour
+    struct SpreadEverywhere {
+        static constexpr bool isPure = true;
+
+        bool operator()(const size_t, const size_t) const {
+            return true;
+        }
+    };
+
+    /// Thread pool of the application, used by templated parallel algorithms
+    static ::ThreadPool& getThreadPool();
 
     template <typename StoppingCondition>
     std::vector<DetailedTriangleId> bucketSpread(const StoppingCondition& stopFunctor,
@@ -591,31 +889,113 @@ class Geometry {
 };
 
 template <typename StoppingCondition>
-std::vector<size_t> Geometry::bucketSpread(const StoppingCondition& stopFunctor, std::deque<size_t>& toVisit,
-                                           std::unordered_set<size_t>& alreadyVisited) {
+std::vector<size_t> Geometry::bucketSpread(const StoppingCondition& stopFunctor,
+                                           const std::vector<size_t>& startingTriangles) {
+    const size_t triangleCount = mPolyhedronData.adjacency.size();
+    P_ASSERT(triangleCount == mTriangles.size());
+
+    // Every triangle enters the queue at most once, so the result itself is used as the BFS queue
     std::vector<size_t> trianglesToColor;
-    P_ASSERT(mPolyhedronData.indices.size() == mTriangles.size());
+    std::vector<bool> alreadyVisited(triangleCount, false);
 
-    while(!toVisit.empty()) {
-        // Remove yourself from queue and mark visited
-        const size_t currentVertex = toVisit.front();
-        toVisit.pop_front();
-        P_ASSERT(alreadyVisited.find(currentVertex) != alreadyVisited.end());
-        P_ASSERT(currentVertex < mTriangles.size());
-        P_ASSERT(toVisit.size() < mTriangles.size());
+    for(const size_t startTriangle : startingTriangles) {
+        P_ASSERT(startTriangle < triangleCount);
+        if(!alreadyVisited[startTriangle]) {
+            alreadyVisited[startTriangle] = true;
+            trianglesToColor.push_back(startTriangle);
+        }
+    }
 
-        // Catching because of unpredictable CGAL errors
-        try {
+    // Catching because of unpredictable CGAL errors
+    try {
+        for(size_t queueHead = 0; queueHead < trianglesToColor.size(); ++queueHead) {
             // Manage neighbours and grow the queue
-            addNeighboursToQueue(currentVertex, alreadyVisited, toVisit, stopFunctor);
-        } catch(CGAL::Assertion_exception& excp) {
-            CI_LOG_E("Exception caught. Returning immediately. " + excp.expression() + " " + excp.message());
-            throw std::runtime_error("Bucket spread failed inside the CGAL library.");
+            addNeighboursToQueue(trianglesToColor[queueHead], alreadyVisited, trianglesToColor, stopFunctor);
         }
+    } catch(CGAL::Assertion_exception& excp) {
+        CI_LOG_E("Exception caught. Returning immediately. " + excp.expression() + " " + excp.message());
+        throw std::runtime_error("Bucket spread failed inside the CGAL library.");
+    }
 
-        // Add the triangle to the list
-        trianglesToColor.push_back(currentVertex);
+    P_ASSERT(trianglesToColor.size() <= triangleCount);
+    return trianglesToColor;
+}
+
+template <typename StoppingCondition>
+std::vector<size_t> Geometry::bucketSpreadParallel(const StoppingCondition& stopFunctor,
+                                                   const std::vector<size_t>& startingTriangles) {
+    static_assert(IsPureStoppingCondition<StoppingCondition>::value,
+                  "Only pure stopping conditions can be evaluated concurrently");
+    const size_t triangleCount = mPolyhedronData.adjacency.size();
+    P_ASSERT(triangleCount == mTriangles.size());
+
+    // Value-initialized to false
+    std::unique_ptr<std::atomic<bool>[]> alreadyVisited(new std::atomic<bool>[triangleCount]());
+
+    std::vector<size_t> trianglesToColor;
+    std::vector<size_t> frontier;
+    for(const size_t startTriangle : startingTriangles) {
+        P_ASSERT(startTriangle < triangleCount);
+        if(!alreadyVisited[startTriangle].exchange(true)) {
+            frontier.push_back(startTriangle);
+        }
+    }
+
+    // Expand part of the frontier, the atomic exchange makes sure each triangle is claimed by a single thread
+    auto expandFrontier = [this, &stopFunctor, &alreadyVisited, &frontier](const size_t begin, const size_t end,
+                                                                          std::vector<size_t>& nextFrontier) {
+        for(size_t i = begin; i < end; ++i) {
+            const size_t currentTriangle = frontier[i];
+            for(const int32_t neighbourId : gatherNeighbours(currentTriangle)) {
+                if(neighbourId == -1) {
+                    continue;
+                }
+                const size_t neighbour = static_cast<size_t>(neighbourId);
+                if(alreadyVisited[neighbour].load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                if(stopFunctor(neighbour, currentTriangle) && !alreadyVisited[neighbour].exchange(true)) {
+                    nextFrontier.push_back(neighbour);
+                }
+            }
+        }
+    };
+
+    const size_t chunkCount = std::max<size_t>(1, 4 * std::thread::hardware_concurrency());
+    std::vector<std::vector<size_t>> nextFrontiers(chunkCount);
+    std::vector<size_t> chunkIds(chunkCount);
+    std::iota(chunkIds.begin(), chunkIds.end(), 0);
+
+    try {
+        while(!frontier.empty()) {
+            trianglesToColor.insert(trianglesToColor.end(), frontier.begin(), frontier.end());
+
+            if(frontier.size() < sParallelFrontierMinTriangles) {
+                std::vector<size_t> nextFrontier;
+                expandFrontier(0, frontier.size(), nextFrontier);
+                frontier = std::move(nextFrontier);
+                continue;
+            }
+
+            getThreadPool().parallel_for(chunkIds.begin(), chunkIds.end(),
+                                         [&frontier, &nextFrontiers, &expandFrontier, chunkCount](size_t chunk) {
+                                             const size_t begin = frontier.size() * chunk / chunkCount;
+                                             const size_t end = frontier.size() * (chunk + 1) / chunkCount;
+                                             nextFrontiers[chunk].clear();
+                                             expandFrontier(begin, end, nextFrontiers[chunk]);
+                                         });
+
+            frontier.clear();
+            for(const auto& nextFrontier : nextFrontiers) {
+                frontier.insert(frontier.end(), nextFrontier.begin(), nextFrontier.end());
+            }
+        }
+    } catch(CGAL::Assertion_exception& excp) {
+        CI_LOG_E("Exception caught. Returning immediately. " + excp.expression() + " " + excp.message());
+        throw std::runtime_error("Bucket spread failed inside the CGAL library.");
     }
+
+    P_ASSERT(trianglesToColor.size() <= triangleCount);
     return trianglesToColor;
 }
 
@@ -656,9 +1036,8 @@ std::vector<DetailedTriangleId> Geometry::bucket(const DetailedTriangleId startT
         return {};
     }
 
-    if(!isTemporaryDetailedDataValid()) {
-        updateTemporaryDetailedData();
-        P_ASSERT(mMeshDetailed);
+    if(!isTemporaryDetailedDataValid() && !updateTemporaryDetailedData()) {
+        return {};
     }
 
     std::deque<DetailedTriangleId> toVisit;
@@ -673,18 +1052,7 @@ std::vector<DetailedTriangleId> Geometry::bucket(const DetailedTriangleId startT
 
 template <typename StoppingCondition>
 std::vector<size_t> Geometry::bucket(const size_t startTriangle, const StoppingCondition& stopFunctor) {
-    if(mPolyhedronData.mMesh.is_empty()) {
-        return {};
-    }
-
-    std::deque<size_t> toVisit;
-    const size_t startingFace = startTriangle;
-    toVisit.push_back(startingFace);
-
-    std::unordered_set<size_t> alreadyVisited;
-    alreadyVisited.insert(startingFace);
-
-    return bucketSpread(stopFunctor, toVisit, alreadyVisited);
+    return bucket(std::vector<size_t>{startTriangle}, stopFunctor);
 }
 
 template <typename StoppingCondition>
@@ -694,30 +1062,29 @@ std::vector<size_t> Geometry::bucket(const std::vector<size_t>& startingTriangle
         return {};
     }
 
-    std::deque<size_t> toVisit;
-    std::unordered_set<size_t> alreadyVisited;
-
-    for(const size_t startTriangle : startingTriangles) {
-        toVisit.push_back(startTriangle);
-        alreadyVisited.insert(startTriangle);
+    if constexpr(IsPureStoppingCondition<StoppingCondition>::value) {
+        if(mTriangles.size() >= sParallelBucketMinTriangles) {
+            return bucketSpreadParallel(stopFunctor, startingTriangles);
+        }
     }
 
-    return bucketSpread(stopFunctor, toVisit, alreadyVisited);
+    return bucketSpread(stopFunctor, startingTriangles);
 }
 
 template <typename StoppingCondition>
-void Geometry::addNeighboursToQueue(const size_t currentVertex, std::unordered_set<size_t>& alreadyVisited,
-                                    std::deque<size_t>& toVisit, const StoppingCondition& stopFunctor) const {
-    const std::array<int, 3> neighbours = gatherNeighbours(currentVertex);
+void Geometry::addNeighboursToQueue(const size_t currentVertex, std::vector<bool>& alreadyVisited,
+                                    std::vector<size_t>& toVisit, const StoppingCondition& stopFunctor) const {
+    const std::array<int32_t, 3>& neighbours = gatherNeighbours(currentVertex);
     for(int i = 0; i < 3; ++i) {
         if(neighbours[i] == -1) {
             continue;
         } else {
-            if(alreadyVisited.find(neighbours[i]) == alreadyVisited.end()) {
+            const size_t neighbour = static_cast<size_t>(neighbours[i]);
+            if(!alreadyVisited[neighbour]) {
                 // New vertex -> visit it.
-                if(stopFunctor(neighbours[i], currentVertex)) {
-                    toVisit.push_back(neighbours[i]);
-                    alreadyVisited.insert(neighbours[i]);
+                if(stopFunctor(neighbour, currentVertex)) {
+                    toVisit.push_back(neighbour);
+                    alreadyVisited[neighbour] = true;
                 }
             }
         }
@@ -747,6 +1114,44 @@ void Geometry::addNeighboursToQueue(const DetailedTriangleId currentVertex,
 
 /* -------------------- Serialization -------------------- */
 
+template <class Archive>
+void Geometry::GeometryState::save(Archive& saveArchive) const {
+    saveArchive(colorMap);
+    saveArchive(chunks.size());
+    for(const auto& chunk : chunks) {
+        saveArchive(chunk->triangleColors);
+        saveArchive(chunk->triangleDetails.size());
+        for(const auto& detail : chunk->triangleDetails) {
+            saveArchive(detail.first, *detail.second);
+        }
+    }
+}
+
+template <class Archive>
+void Geometry::GeometryState::load(Archive& loadArchive) {
+    loadArchive(colorMap);
+    size_t chunkCount = 0;
+    loadArchive(chunkCount);
+
+    chunks.clear();
+    chunks.reserve(chunkCount);
+    for(size_t chunkIdx = 0; chunkIdx < chunkCount; ++chunkIdx) {
+        auto chunk = std::make_shared<Chunk>();
+        loadArchive(chunk->triangleColors);
+
+        size_t detailCount = 0;
+        loadArchive(detailCount);
+        for(size_t i = 0; i < detailCount; ++i) {
+            size_t triangleIdx = 0;
+            auto detail = std::make_shared<TriangleDetail>();
+            loadArchive(triangleIdx, *detail);
+            chunk->triangleDetails.emplace(triangleIdx, std::move(detail));
+        }
+
+        chunks.push_back(std::move(chunk));
+    }
+}
+
 template <class Archive>
 void Geometry::save(Archive& saveArchive) const {
     saveArchive(mColorManager);
@@ -763,6 +1168,7 @@ void Geometry::load(Archive& loadArchive) {
     loadArchive(mTriangleDetails);
     loadArchive(mPolyhedronData.vertices);
     loadArchive(mPolyhedronData.indices);
+    mSnapshotBaseValid = false;
 
     // Reset progress
     mProgress->resetLoad();
@@ -771,7 +1177,10 @@ void Geometry::load(Archive& loadArchive) {
     mProgress->importRenderPercentage = 1.0f;
     mProgress->importComputePercentage = 1.0f;
 
-    updateTemporaryDetailedData();
+    invalidateTemporaryDetailedData();
+    if(!updateTemporaryDetailedData()) {
+        CI_LOG_W("Loaded geometry has no detailed mesh, it is built again when needed");
+    }
 
     P_ASSERT(!mTriangles.empty());
     P_ASSERT(!mColorManager.empty());
@@ -2,7 +2,22 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <set>
+#include <stdexcept>
+
+#include "commands/CmdPaintBrush.h"
+#include "commands/CmdPaintSingleColor.h"
+#include "commands/CommandManager.h"
 #include "geometry/Geometry.h"
+#include "geometry/GeometryUtils.h"
 
 /// Return a simple testing geometry of a cube
 pepr3d::Geometry getGeometryWithCube() {
@@ -35,6 +50,76 @@ pepr3d::Geometry getGeometryWithCube() {
     return pepr3d::Geometry(std::move(triangles));
 }
 
+/// Return a flat square grid in the XZ plane, facing +Y, made of 2 * quadsPerSide^2 triangles.
+/// The grid has its polyhedron built, so bucket spreading works on it.
+pepr3d::Geometry getGeometryWithGrid(const size_t quadsPerSide) {
+    std::vector<pepr3d::DataTriangle> triangles;
+    std::vector<glm::vec3> vertices;
+    std::vector<std::array<size_t, 3>> indices;
+    triangles.reserve(2 * quadsPerSide * quadsPerSide);
+    indices.reserve(2 * quadsPerSide * quadsPerSide);
+    vertices.reserve((quadsPerSide + 1) * (quadsPerSide + 1));
+
+    const float step = 1.f / static_cast<float>(quadsPerSide);
+    for(size_t x = 0; x <= quadsPerSide; ++x) {
+        for(size_t z = 0; z <= quadsPerSide; ++z) {
+            vertices.emplace_back(x * step, 0, z * step);
+        }
+    }
+
+    auto vertexIndex = [quadsPerSide](size_t x, size_t z) { return x * (quadsPerSide + 1) + z; };
+    for(size_t x = 0; x < quadsPerSide; ++x) {
+        for(size_t z = 0; z < quadsPerSide; ++z) {
+            const size_t a = vertexIndex(x, z);
+            const size_t b = vertexIndex(x + 1, z);
+            const size_t c = vertexIndex(x + 1, z + 1);
+            const size_t d = vertexIndex(x, z + 1);
+            triangles.emplace_back(vertices[a], vertices[d], vertices[b], glm::vec3(0, 1, 0), 0);
+            indices.push_back({a, d, b});
+            triangles.emplace_back(vertices[b], vertices[d], vertices[c], glm::vec3(0, 1, 0), 0);
+            indices.push_back({b, d, c});
+        }
+    }
+    return pepr3d::Geometry(std::move(triangles), std::move(vertices), std::move(indices));
+}
+
+/// Return a flat fan in the XZ plane, facing +Y, of triangles around a single vertex shared by all of them.
+/// The fan has its polyhedron built, so the detailed mesh can be built on it.
+pepr3d::Geometry getGeometryWithFan(const size_t triangleCount) {
+    std::vector<pepr3d::DataTriangle> triangles;
+    std::vector<glm::vec3> vertices = {glm::vec3(0, 0, 0)};
+    std::vector<std::array<size_t, 3>> indices;
+    for(size_t i = 0; i < triangleCount; ++i) {
+        const float angle = 2.f * glm::pi<float>() * i / triangleCount;
+        vertices.emplace_back(std::cos(angle), 0, std::sin(angle));
+    }
+
+    for(size_t i = 0; i < triangleCount; ++i) {
+        const size_t rim = 1 + i;
+        const size_t nextRim = 1 + (i + 1) % triangleCount;
+        triangles.emplace_back(vertices[0], vertices[nextRim], vertices[rim], glm::vec3(0, 1, 0), 0);
+        indices.push_back({0, nextRim, rim});
+    }
+    return pepr3d::Geometry(std::move(triangles), std::move(vertices), std::move(indices));
+}
+
+/// Return all rendered triangles (vertices and color) from the OpenGL buffers in a sorted order.
+/// Dummy degenerate triangles are skipped, so that buffers with a different layout can be compared.
+std::vector<std::array<float, 10>> getRenderedTriangles(const pepr3d::Geometry::OpenGlData& ogl) {
+    std::vector<std::array<float, 10>> result;
+    for(size_t i = 0; i + 2 < ogl.vertexBuffer.size(); i += 3) {
+        const glm::vec3 a = ogl.vertexBuffer[i];
+        const glm::vec3 b = ogl.vertexBuffer[i + 1];
+        const glm::vec3 c = ogl.vertexBuffer[i + 2];
+        if(a == b && b == c) {
+            continue;
+        }
+        result.push_back({a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z, static_cast<float>(ogl.colorBuffer[i])});
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
 TEST(Geometry, initialize) {
     /**
      * Test initializing the Geometry class with custom geometry
@@ -107,4 +192,580 @@ TEST(Geometry, setColor) {
         EXPECT_EQ(colorBuffer.at(i), colorIndex);
     }
 }
-#endif
\ No newline at end of file
+
+TEST(Geometry, incrementalBufferUpdate) {
+    /**
+     * Test that patching only the changed triangles produces the same picture as regenerating all buffers
+     */
+
+    pepr3d::Geometry geo(getGeometryWithCube());
+    geo.updateOpenGlBuffers();
+
+    pepr3d::BrushSettings settings;
+    settings.color = 2;
+    settings.size = 0.3f;
+    geo.paintAreaWithSphere(ci::Ray(glm::vec3(0.1f, 2.f, 0.1f), glm::vec3(0, -1, 0)), settings);
+    ASSERT_TRUE(geo.getOpenGlData().isDirty);
+    ASSERT_FALSE(geo.isSimpleTriangle(0) && geo.isSimpleTriangle(1));
+
+    geo.updateOpenGlBuffers();
+    const auto patched = getRenderedTriangles(geo.getOpenGlData());
+    geo.invalidateOpenGlBuffers();
+    geo.updateOpenGlBuffers();
+    EXPECT_EQ(patched, getRenderedTriangles(geo.getOpenGlData()));
+
+    // Removing the details returns their slabs
+    geo.setTriangleColor(0, 1);
+    geo.setTriangleColor(1, 1);
+    geo.updateOpenGlBuffers();
+    const auto patchedRemoved = getRenderedTriangles(geo.getOpenGlData());
+    EXPECT_EQ(patchedRemoved.size(), 12);
+    geo.invalidateOpenGlBuffers();
+    geo.updateOpenGlBuffers();
+    EXPECT_EQ(patchedRemoved, getRenderedTriangles(geo.getOpenGlData()));
+}
+
+TEST(Geometry, incrementalHighlight) {
+    /**
+     * Test that updating only the triangles entering and leaving the highlight gives the same mask as generating it
+     */
+
+    pepr3d::Geometry geo(getGeometryWithCube());
+    geo.updateOpenGlBuffers();
+
+    pepr3d::BrushSettings settings;
+    settings.color = 2;
+    settings.size = 0.3f;
+    settings.continuous = true;
+    const ci::Ray topRay(glm::vec3(0.1f, 2.f, 0.1f), glm::vec3(0, -1, 0));
+    geo.highlightArea(topRay, settings);
+    const auto& topMask = geo.getOpenGlData().highlightMask;
+    EXPECT_EQ(std::count(topMask.begin(), topMask.end(), 1), 6);  // both triangles of the top side
+
+    // Details of the highlighted triangles get their own slabs, the highlight then moves to another side
+    geo.paintAreaWithSphere(topRay, settings);
+    geo.highlightArea(ci::Ray(glm::vec3(2.f, 0.1f, 0.1f), glm::vec3(-1, 0, 0)), settings);
+    geo.updateOpenGlBuffers();
+    const std::vector<GLint> updated = geo.getOpenGlData().highlightMask;
+
+    geo.invalidateOpenGlBuffers();
+    geo.updateOpenGlBuffers();
+    EXPECT_EQ(updated, geo.getOpenGlData().highlightMask);
+
+    geo.highlightArea(topRay, settings);
+    const std::vector<GLint> movedBack = geo.getOpenGlData().highlightMask;
+    geo.invalidateOpenGlBuffers();
+    geo.updateOpenGlBuffers();
+    EXPECT_EQ(movedBack, geo.getOpenGlData().highlightMask);
+    EXPECT_GT(std::count(movedBack.begin(), movedBack.end(), 1), 6);  // with the vertices of the details
+}
+
+TEST(Geometry, DISABLED_benchmarkBufferUpdate) {
+    /**
+     * Compare full and incremental buffer regeneration after a single brush dab on a 1M triangle mesh
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(708));
+    geo.updateOpenGlBuffers();
+
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.01f;
+    geo.paintAreaWithSphere(ci::Ray(glm::vec3(0.5f, 1.f, 0.5f), glm::vec3(0, -1, 0)), settings);
+
+    auto timeUpdate = [&geo]() {
+        const auto start = std::chrono::high_resolution_clock::now();
+        geo.updateOpenGlBuffers();
+        const auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    const double incrementalMs = timeUpdate();
+    geo.invalidateOpenGlBuffers();
+    const double fullMs = timeUpdate();
+
+    std::cout << "Triangles: " << geo.getTriangleCount() << ", full: " << fullMs
+              << " ms, incremental: " << incrementalMs << " ms" << std::endl;
+}
+
+/// Total area of the rendered triangles of each color
+std::map<size_t, double> getColorAreas(const pepr3d::Geometry::OpenGlData& ogl) {
+    std::map<size_t, double> areas;
+    for(const auto& tri : getRenderedTriangles(ogl)) {
+        const glm::vec3 a(tri[0], tri[1], tri[2]);
+        const glm::vec3 b(tri[3], tri[4], tri[5]);
+        const glm::vec3 c(tri[6], tri[7], tri[8]);
+        areas[static_cast<size_t>(tri[9])] += 0.5 * glm::length(glm::cross(b - a, c - a));
+    }
+    return areas;
+}
+
+/// Rays of a brush stroke going diagonally over the grid from getGeometryWithGrid
+std::vector<ci::Ray> getStrokeRays(const size_t dabCount) {
+    std::vector<ci::Ray> rays;
+    for(size_t i = 0; i < dabCount; ++i) {
+        const float t = 0.2f + 0.6f * static_cast<float>(i) / static_cast<float>(dabCount);
+        rays.emplace_back(glm::vec3(t, 1.f, 0.3f + 0.4f * t), glm::vec3(0, -1, 0));
+    }
+    return rays;
+}
+
+TEST(Geometry, batchedStroke) {
+    /**
+     * Test that painting a whole stroke at once paints the same area as painting its dabs one by one
+     */
+
+    const std::vector<ci::Ray> rays = getStrokeRays(40);
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.08f;
+
+    for(const bool spherical : {true, false}) {
+        pepr3d::Geometry separate(getGeometryWithGrid(10));
+        pepr3d::Geometry batched(getGeometryWithGrid(10));
+
+        if(spherical) {
+            for(const ci::Ray& ray : rays) {
+                separate.paintAreaWithSphere(ray, settings);
+            }
+            batched.paintAreaWithSpheres(rays, settings);
+        } else {
+            std::vector<std::vector<pepr3d::Geometry::Point3>> shapes;
+            for(const ci::Ray& ray : rays) {
+                const glm::vec3 ro = ray.getOrigin();
+                const pepr3d::Geometry::Circle circle(pepr3d::Geometry::Point3(ro.x, ro.y, ro.z),
+                                                      settings.size * settings.size,
+                                                      pepr3d::Geometry::Vector3(0, -1, 0));
+                shapes.push_back(pepr3d::GeometryUtils::pointsOnCircle(circle, settings.segments));
+                separate.paintWithShape(ray, shapes.back(), settings.color);
+            }
+            batched.paintWithShapes(rays, shapes, settings.color);
+        }
+
+        for(size_t i = 0; i < separate.getTriangleCount(); ++i) {
+            ASSERT_EQ(separate.isSimpleTriangle(i), batched.isSimpleTriangle(i));
+            if(separate.isSimpleTriangle(i)) {
+                ASSERT_EQ(separate.getTriangleColor(i), batched.getTriangleColor(i));
+            }
+        }
+
+        separate.updateOpenGlBuffers();
+        batched.updateOpenGlBuffers();
+        const auto separateAreas = getColorAreas(separate.getOpenGlData());
+        const auto batchedAreas = getColorAreas(batched.getOpenGlData());
+        ASSERT_EQ(separateAreas.size(), 2);
+        ASSERT_EQ(batchedAreas.size(), 2);
+        for(const auto& colorArea : separateAreas) {
+            EXPECT_NEAR(colorArea.second, batchedAreas.at(colorArea.first), 1e-5);
+        }
+    }
+}
+
+TEST(Geometry, DISABLED_benchmarkBatchedStroke) {
+    /**
+     * Compare painting a stroke of 200 dabs one by one and all at once
+     */
+
+    const std::vector<ci::Ray> rays = getStrokeRays(200);
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.05f;
+
+    pepr3d::Geometry separate(getGeometryWithGrid(20));
+    const auto separateStart = std::chrono::high_resolution_clock::now();
+    for(const ci::Ray& ray : rays) {
+        separate.paintAreaWithSphere(ray, settings);
+    }
+    const auto separateEnd = std::chrono::high_resolution_clock::now();
+
+    pepr3d::Geometry batched(getGeometryWithGrid(20));
+    const auto batchedStart = std::chrono::high_resolution_clock::now();
+    batched.paintAreaWithSpheres(rays, settings);
+    const auto batchedEnd = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Stroke of " << rays.size() << " dabs took: "
+              << std::chrono::duration<double, std::milli>(separateEnd - separateStart).count()
+              << " ms dab by dab, " << std::chrono::duration<double, std::milli>(batchedEnd - batchedStart).count()
+              << " ms batched" << std::endl;
+}
+
+TEST(Geometry, DISABLED_benchmarkLazyTriangulation) {
+    /**
+     * Compare triangulating the details after every dab of a 100 dab stroke and only once at the end
+     */
+
+    const std::vector<ci::Ray> rays = getStrokeRays(100);
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.05f;
+
+    for(const bool flushEveryDab : {true, false}) {
+        pepr3d::Geometry geo(getGeometryWithGrid(20));
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(const ci::Ray& ray : rays) {
+            geo.paintAreaWithSphere(ray, settings);
+            if(flushEveryDab) {
+                geo.flushDetails();
+            }
+        }
+        geo.flushDetails();
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << "Stroke of " << rays.size() << " dabs took: "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms, triangulating "
+                  << (flushEveryDab ? "after every dab" : "once") << std::endl;
+    }
+}
+
+TEST(Geometry, DISABLED_benchmarkDetailedMeshRebuild) {
+    /**
+     * Build the detailed mesh of a grid, whose vertices repeat the same coordinates in swapped order, with most of its
+     * triangles covered by details. Compare with PositionMap.DISABLED_benchmarkSymmetricPositions for the lookup alone.
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(100));
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.006f;
+    settings.segments = 8;
+
+    std::vector<ci::Ray> rays;
+    for(size_t x = 0; x < 100; ++x) {
+        for(size_t z = 0; z < 100; ++z) {
+            rays.emplace_back(glm::vec3((x + 0.5f) / 100.f, 1.f, (z + 0.5f) / 100.f), glm::vec3(0, -1, 0));
+        }
+    }
+    geo.paintAreaWithSpheres(rays, settings);
+    geo.flushDetails();
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    geo.updateTemporaryDetailedData();
+    const auto end = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(geo.isTemporaryDetailedDataValid());
+
+    std::cout << "Building detailed mesh of " << geo.getMeshDetailed()->number_of_faces() << " faces took: "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+}
+
+TEST(Geometry, bucket) {
+    /**
+     * Test spreading over the adjacency of the polyhedron
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(10));
+    ASSERT_TRUE(geo.polyhedronValid());
+
+    const auto all = geo.bucket(size_t(0), [](size_t, size_t) { return true; });
+    EXPECT_EQ(all.size(), geo.getTriangleCount());
+    EXPECT_EQ(all.front(), 0);
+    EXPECT_EQ(std::set<size_t>(all.begin(), all.end()).size(), all.size());
+
+    // Triangles 2 * (10 * x + z) and 2 * (10 * x + z) + 1 make up the quad at x, z. Stop at the x = 5 column.
+    auto leftHalf = [](size_t triangle, size_t) { return triangle / 20 < 5; };
+    const auto left = geo.bucket(size_t(0), leftHalf);
+    EXPECT_EQ(left.size(), geo.getTriangleCount() / 2);
+    for(size_t triangle : left) {
+        EXPECT_LT(triangle / 20, 5);
+    }
+
+    // Seeds in both halves reach everything, duplicated seeds are visited once
+    auto sameHalf = [](size_t a, size_t b) { return a / 100 == b / 100; };
+    const auto both = geo.bucket(std::vector<size_t>{0, 0, 199}, sameHalf);
+    EXPECT_EQ(both.size(), geo.getTriangleCount());
+}
+
+TEST(Geometry, DISABLED_benchmarkBucket) {
+    /**
+     * Flood fill a 1M triangle mesh
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(708));
+    ASSERT_TRUE(geo.polyhedronValid());
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    const auto all = geo.bucket(size_t(0), [](size_t, size_t) { return true; });
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    EXPECT_EQ(all.size(), geo.getTriangleCount());
+    std::cout << "Bucket over " << all.size()
+              << " triangles took: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms"
+              << std::endl;
+}
+
+/// Pure criterion spreading only over the quads with x < 100 of a grid with 224 quads per side
+struct GridLeftPart {
+    static constexpr bool isPure = true;
+
+    bool operator()(size_t triangle, size_t) const {
+        return triangle / (2 * 224) < 100;
+    }
+};
+
+TEST(Geometry, parallelBucket) {
+    /**
+     * Test that the parallel spread used for pure criteria on big meshes reaches the same triangles
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(224));
+    ASSERT_TRUE(geo.polyhedronValid());
+    ASSERT_TRUE(pepr3d::IsPureStoppingCondition<GridLeftPart>::value);
+
+    // Lambdas are not marked pure and are spread serially
+    auto serialCriterion = [](size_t triangle, size_t current) { return GridLeftPart()(triangle, current); };
+
+    auto parallel = geo.bucket(size_t(0), GridLeftPart());
+    auto serial = geo.bucket(size_t(0), serialCriterion);
+    EXPECT_EQ(parallel.size(), 2 * 224 * 100);
+    std::sort(parallel.begin(), parallel.end());
+    std::sort(serial.begin(), serial.end());
+    EXPECT_EQ(parallel, serial);
+
+    auto component = geo.getConnectedComponent(size_t(5));
+    EXPECT_EQ(component.size(), geo.getTriangleCount());
+    std::sort(component.begin(), component.end());
+    EXPECT_EQ(std::unique(component.begin(), component.end()), component.end());
+
+    const auto detailedComponent = geo.getConnectedComponent(pepr3d::DetailedTriangleId(5));
+    EXPECT_EQ(detailedComponent.size(), geo.getTriangleCount());
+}
+
+TEST(Geometry, detailedMesh) {
+    /**
+     * Test that the detailed mesh built from parallel snapshots of the details contains every triangle once and
+     * joins the details with the rest of the mesh
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(10));
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.08f;
+    geo.paintAreaWithSpheres(getStrokeRays(20), settings);
+    geo.updateTemporaryDetailedData();
+    ASSERT_TRUE(geo.isTemporaryDetailedDataValid());
+
+    size_t triangleCount = 0;
+    for(size_t i = 0; i < geo.getTriangleCount(); ++i) {
+        triangleCount += geo.isSimpleTriangle(i) ? 1 : geo.getTriangleDetailCount(i);
+    }
+    const auto* mesh = geo.getMeshDetailed();
+    ASSERT_NE(mesh, nullptr);
+    EXPECT_EQ(mesh->number_of_faces(), triangleCount);
+    EXPECT_EQ(geo.getMeshDetailedFaceDescs().size(), triangleCount);
+    EXPECT_TRUE(mesh->is_valid());
+
+    for(const auto& idAndFace : geo.getMeshDetailedFaceDescs()) {
+        ASSERT_EQ(geo.getMeshDetailedIdMap()[idAndFace.second], idAndFace.first);
+    }
+
+    // Details share their vertices with the neighbouring triangles, the grid stays a disc with one boundary loop
+    EXPECT_EQ(mesh->number_of_vertices() - mesh->number_of_edges() + mesh->number_of_faces(), 1);
+}
+
+TEST(Geometry, detailCountAfterPainting) {
+    /**
+     * Test that counting the triangles of a detail painted since the last triangulation triangulates it first, and
+     * that the const query refuses to return out of date triangles
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(10));
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.08f;
+    geo.paintAreaWithSpheres(getStrokeRays(20), settings);
+
+    size_t painted = 0;
+    while(geo.isSimpleTriangle(painted)) {
+        ASSERT_LT(++painted, geo.getTriangleCount());
+    }
+    const pepr3d::Geometry& constGeo = geo;
+    EXPECT_THROW(constGeo.getTriangleDetailCount(painted), std::logic_error);
+
+    const size_t detailCount = geo.getTriangleDetailCount(painted);
+    EXPECT_GT(detailCount, 0);
+    EXPECT_EQ(constGeo.getTriangleDetailCount(painted), detailCount);
+
+    const auto component = geo.getConnectedComponent(pepr3d::DetailedTriangleId(painted, 0));
+    for(const pepr3d::DetailedTriangleId& triangleId : component) {
+        if(triangleId.getDetailId()) {
+            ASSERT_LT(*triangleId.getDetailId(), constGeo.getTriangleDetailCount(triangleId.getBaseId()));
+        }
+    }
+}
+
+TEST(Geometry, stressSharedVertex) {
+    /**
+     * Paint again and again over a vertex shared by many triangles, so that many details exchange their shared
+     * points around it. Checks that the details stay matched, and is meant to be run with ThreadSanitizer too, since
+     * the details are triangulated in parallel afterwards.
+     */
+
+    pepr3d::Geometry geo(getGeometryWithFan(64));
+    std::mt19937 generator(11);
+    std::uniform_real_distribution<float> offsetDistribution(-0.05f, 0.05f);
+
+    for(size_t round = 0; round < 50; ++round) {
+        pepr3d::BrushSettings settings;
+        settings.color = round % 4;
+        settings.size = 0.02f + 0.01f * (round % 5);
+        settings.segments = 12;
+
+        std::vector<ci::Ray> rays;
+        for(size_t i = 0; i < 4; ++i) {
+            const glm::vec3 origin(offsetDistribution(generator), 1.f, offsetDistribution(generator));
+            rays.emplace_back(origin, glm::vec3(0, -1, 0));
+        }
+        geo.paintAreaWithSpheres(rays, settings);
+        ASSERT_TRUE(geo.updateTemporaryDetailedData());
+
+        // Details share all their points with the neighbours, the fan stays a disc with one boundary loop
+        const auto* mesh = geo.getMeshDetailed();
+        ASSERT_NE(mesh, nullptr);
+        ASSERT_TRUE(mesh->is_valid());
+        ASSERT_EQ(mesh->number_of_vertices() - mesh->number_of_edges() + mesh->number_of_faces(), 1);
+    }
+}
+
+TEST(Geometry, incrementalDetailedMesh) {
+    /**
+     * Test that the detailed mesh updated in place after more painting matches the details, and that picking finds
+     * the painted detail triangles
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(10));
+    pepr3d::BrushSettings settings;
+    settings.color = 1;
+    settings.size = 0.08f;
+    geo.paintAreaWithSpheres(getStrokeRays(20), settings);
+    geo.updateTemporaryDetailedData();
+    ASSERT_TRUE(geo.isTemporaryDetailedDataValid());
+    const auto* mesh = geo.getMeshDetailed();
+    ASSERT_NE(mesh, nullptr);
+
+    // Crossing stroke, and one detail replaced by a simple triangle again
+    std::vector<ci::Ray> crossingRays;
+    for(const ci::Ray& ray : getStrokeRays(20)) {
+        const glm::vec3 origin = ray.getOrigin();
+        crossingRays.emplace_back(glm::vec3(origin.z, origin.y, origin.x), ray.getDirection());
+    }
+    settings.color = 2;
+    geo.paintAreaWithSpheres(crossingRays, settings);
+    size_t recolored = 0;
+    while(geo.isSimpleTriangle(recolored)) {
+        ASSERT_LT(++recolored, geo.getTriangleCount());
+    }
+    geo.setTriangleColor(recolored, 3);
+    EXPECT_FALSE(geo.isTemporaryDetailedDataValid());
+
+    geo.updateTemporaryDetailedData();
+    ASSERT_TRUE(geo.isTemporaryDetailedDataValid());
+    ASSERT_EQ(geo.getMeshDetailed(), mesh);  // updated in place
+
+    size_t triangleCount = 0;
+    for(size_t i = 0; i < geo.getTriangleCount(); ++i) {
+        triangleCount += geo.isSimpleTriangle(i) ? 1 : geo.getTriangleDetailCount(i);
+    }
+    EXPECT_EQ(mesh->number_of_faces(), triangleCount);
+    EXPECT_EQ(geo.getMeshDetailedFaceDescs().size(), triangleCount);
+    EXPECT_TRUE(mesh->is_valid());
+
+    for(const auto& idAndFace : geo.getMeshDetailedFaceDescs()) {
+        ASSERT_FALSE(mesh->is_removed(idAndFace.second));
+        ASSERT_EQ(geo.getMeshDetailedIdMap()[idAndFace.second], idAndFace.first);
+        if(idAndFace.first.getDetailId()) {
+            ASSERT_LT(*idAndFace.first.getDetailId(), geo.getTriangleDetailCount(idAndFace.first.getBaseId()));
+        } else {
+            ASSERT_TRUE(geo.isSimpleTriangle(idAndFace.first.getBaseId()));
+        }
+    }
+
+    // No duplicate or isolated vertices were left behind by the removed faces
+    EXPECT_EQ(mesh->number_of_vertices() - mesh->number_of_edges() + mesh->number_of_faces(), 1);
+
+    // Dab centers are painted, the picked detail triangle has the color of the dab
+    for(const ci::Ray& ray : crossingRays) {
+        const auto hit = geo.intersectDetailedMesh(ray);
+        ASSERT_TRUE(hit);
+        EXPECT_EQ(geo.getTriangleColor(*hit), hit->getBaseId() == recolored ? 3 : 2);
+    }
+}
+
+TEST(Geometry, paintSingleColorMemory) {
+    /**
+     * Test that the history accounts for the triangle ids held by a large single color command, e.g. a bucket fill
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(100));
+    pepr3d::CommandManager<pepr3d::Geometry> commandManager(geo);
+    const size_t historyBytes = commandManager.getHistoryMemoryBytes();
+
+    std::vector<size_t> triangleIds(geo.getTriangleCount());
+    std::iota(triangleIds.begin(), triangleIds.end(), 0);
+    commandManager.execute(std::make_unique<pepr3d::CmdPaintSingleColor>(std::move(triangleIds), 1));
+
+    EXPECT_GE(commandManager.getHistoryMemoryBytes(),
+              historyBytes + geo.getTriangleCount() * sizeof(pepr3d::DetailedTriangleId));
+}
+
+TEST(Geometry, undoRedoHistory) {
+    /**
+     * Replay a long brush session and check that undo and redo restore the same states from the delta snapshots
+     */
+
+    pepr3d::Geometry geo(getGeometryWithGrid(100));
+    pepr3d::CommandManager<pepr3d::Geometry> commandManager(geo);
+
+    auto getRenderedState = [&geo]() {
+        if(geo.getOpenGlData().isDirty) {
+            geo.updateOpenGlBuffers();
+        }
+        return getRenderedTriangles(geo.getOpenGlData());
+    };
+
+    const size_t commandCount = 1000;
+    const size_t checkpointFrequency = 100;
+    std::vector<std::vector<std::array<float, 10>>> checkpoints{getRenderedState()};
+
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> positionDistribution(0.05f, 0.95f);
+    for(size_t i = 1; i <= commandCount; ++i) {
+        pepr3d::BrushSettings settings;
+        settings.color = i % 4;
+        settings.size = 0.02f;
+        settings.segments = 8;
+
+        // Mostly whole triangle strokes, every few strokes creates triangle details
+        settings.respectOriginalTriangles = i % 25 != 0;
+        settings.paintOuterRing = true;
+
+        const glm::vec3 origin(positionDistribution(generator), 1.f, positionDistribution(generator));
+        commandManager.execute(std::make_unique<pepr3d::CmdPaintBrush>(ci::Ray(origin, glm::vec3(0, -1, 0)), settings));
+
+        if(i % checkpointFrequency == 0) {
+            checkpoints.push_back(getRenderedState());
+        }
+    }
+    ASSERT_NE(checkpoints.front(), checkpoints.back());
+
+    // Snapshots share unchanged chunks and details, full copies of the state would take much more
+    const size_t fullStateBytes = geo.saveState().getMemoryBytes();
+    EXPECT_LT(commandManager.getHistoryMemoryBytes(), commandCount * fullStateBytes / 4);
+
+    for(size_t i = commandCount; i > 0; --i) {
+        ASSERT_TRUE(commandManager.canUndo());
+        commandManager.undo();
+        if((i - 1) % checkpointFrequency == 0) {
+            EXPECT_EQ(getRenderedState(), checkpoints[(i - 1) / checkpointFrequency]);
+        }
+    }
+    EXPECT_FALSE(commandManager.canUndo());
+
+    for(size_t i = 1; i <= commandCount; ++i) {
+        ASSERT_TRUE(commandManager.canRedo());
+        commandManager.redo();
+        if(i % checkpointFrequency == 0) {
+            EXPECT_EQ(getRenderedState(), checkpoints[i / checkpointFrequency]);
+        }
+    }
+    EXPECT_FALSE(commandManager.canRedo());
+}
+#endif
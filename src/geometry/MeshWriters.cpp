@@ -0,0 +1,491 @@
+#include "geometry/MeshWriters.h"
+
+#include <cinder/Log.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include "peprassert.h"
+
+namespace pepr3d {
+
+namespace {
+/// Short line of text built in place, so that it can be written at once
+class TextLine {
+   public:
+    TextLine& operator<<(const char* text) {
+        const size_t length = std::strlen(text);
+        P_ASSERT(mSize + length <= mText.size());
+        std::memcpy(mText.data() + mSize, text, length);
+        mSize += length;
+        return *this;
+    }
+
+    TextLine& operator<<(const std::string& text) {
+        return *this << text.c_str();
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral<T>::value>>
+    TextLine& operator<<(const T value) {
+        const std::to_chars_result result = std::to_chars(mText.data() + mSize, mText.data() + mText.size(), value);
+        P_ASSERT(result.ec == std::errc());
+        mSize = result.ptr - mText.data();
+        return *this;
+    }
+
+    /// Nine significant digits read back as the same float.
+    /// std::to_chars of floating point values is missing in older standard libraries, so snprintf is used instead.
+    TextLine& operator<<(const float value) {
+        const int length =
+            std::snprintf(mText.data() + mSize, mText.size() - mSize, "%.9g", static_cast<double>(value));
+        P_ASSERT(length > 0 && mSize + length < mText.size());
+        mSize += length;
+        return *this;
+    }
+
+    const char* data() const {
+        return mText.data();
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+   private:
+    std::array<char, 256> mText;
+    size_t mSize = 0;
+};
+
+bool seekFile(std::FILE* file, uint64_t position) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(position), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(position), SEEK_SET) == 0;
+#endif
+}
+
+/// -0.0 and 0.0 have to end up in the same vertex
+glm::vec3 getPositionKey(const glm::vec3& position) {
+    return glm::vec3(position.x + 0.0f, position.y + 0.0f, position.z + 0.0f);
+}
+
+/// Index of the value, written as a new line "<prefix>x<beforeY>y<beforeZ>z<suffix>" if it was not seen yet
+template <typename Writer>
+uint32_t writeIndexed(Writer& writer, PositionMap<uint32_t>& lookup, const glm::vec3& value,
+                      const std::array<const char*, 4>& labels, uint32_t firstIndex) {
+    const auto inserted = lookup.emplace(getPositionKey(value), static_cast<uint32_t>(lookup.size() + firstIndex));
+    if(inserted.second) {
+        TextLine line;
+        line << labels[0] << value.x << labels[1] << value.y << labels[2] << value.z << labels[3];
+        writer.write(line.data(), line.size());
+    }
+    return *inserted.first;
+}
+
+template <typename T>
+void appendValue(std::vector<char>& bytes, const T value) {
+    const char* const begin = reinterpret_cast<const char*>(&value);
+    bytes.insert(bytes.end(), begin, begin + sizeof(T));
+}
+
+/// ZIP stores the modification time in the MS-DOS format, all entries get the earliest date it can hold
+const uint16_t sDosTime = 0;
+const uint16_t sDosDate = (1 << 5) | 1;  // 1980-01-01
+
+/// Version 2.0, the lowest with directories and stored entries
+const uint16_t sZipVersion = 20;
+}  // namespace
+
+BufferedFileWriter::BufferedFileWriter(const std::string& path) : mPath(path) {
+    mFile = std::fopen(path.c_str(), "wb");
+    if(mFile == nullptr) {
+        fail("Could not open file for writing");
+    }
+    mBuffer.reserve(sBufferSize);
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+    if(mFile != nullptr) {
+        std::fclose(mFile);
+    }
+}
+
+void BufferedFileWriter::write(const void* data, size_t size) {
+    P_ASSERT(mFile != nullptr);
+    if(mBuffer.size() + size > sBufferSize) {
+        flush();
+    }
+    if(size >= sBufferSize) {
+        if(std::fwrite(data, 1, size, mFile) != size) {
+            fail("Could not write to file");
+        }
+        mFlushedSize += size;
+    } else {
+        const char* const bytes = static_cast<const char*>(data);
+        mBuffer.insert(mBuffer.end(), bytes, bytes + size);
+    }
+}
+
+void BufferedFileWriter::overwrite(uint64_t position, const void* data, size_t size) {
+    P_ASSERT(mFile != nullptr);
+    P_ASSERT(position + size <= getSize());
+    if(position >= mFlushedSize) {
+        std::memcpy(mBuffer.data() + (position - mFlushedSize), data, size);
+        return;
+    }
+
+    flush();
+    if(!seekFile(mFile, position) || std::fwrite(data, 1, size, mFile) != size ||
+       std::fseek(mFile, 0, SEEK_END) != 0) {
+        fail("Could not write to file");
+    }
+}
+
+void BufferedFileWriter::close() {
+    P_ASSERT(mFile != nullptr);
+    flush();
+    const int result = std::fclose(mFile);
+    mFile = nullptr;
+    if(result != 0) {
+        fail("Could not finish writing file");
+    }
+}
+
+void BufferedFileWriter::flush() {
+    if(mBuffer.empty()) {
+        return;
+    }
+    if(std::fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) != mBuffer.size()) {
+        fail("Could not write to file");
+    }
+    mFlushedSize += mBuffer.size();
+    mBuffer.clear();
+}
+
+void BufferedFileWriter::fail(const std::string& what) const {
+    CI_LOG_E(what + " " + mPath);
+    throw std::runtime_error(what + " " + mPath);
+}
+
+StlWriter::StlWriter(const std::string& path) : mFile(path) {
+    std::array<char, sHeaderSize> header{};
+    const char text[] = "Binary STL exported by Pepr3D";
+    std::memcpy(header.data(), text, sizeof(text) - 1);
+    mFile.write(header.data(), header.size());
+    mFile.writeValue(mFacetCount);  // filled in by close()
+}
+
+void StlWriter::addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& normals) {
+    if(mFacetCount == std::numeric_limits<uint32_t>::max()) {
+        CI_LOG_E("Too many triangles for a binary STL file");
+        throw std::runtime_error("Too many triangles for a binary STL file");
+    }
+
+    // Same as aiVector3D::NormalizeSafe of the sum, which Assimp used to write
+    glm::vec3 normal = normals[0] + normals[1] + normals[2];
+    const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+    if(length > 0.0f) {
+        const float inverseLength = 1.0f / length;
+        normal = glm::vec3(normal.x * inverseLength, normal.y * inverseLength, normal.z * inverseLength);
+    }
+
+    // Normal, 3 vertices and 2 attribute bytes
+    std::array<char, 50> facet{};
+    std::memcpy(facet.data(), &normal.x, 3 * sizeof(float));
+    for(size_t i = 0; i < 3; ++i) {
+        std::memcpy(facet.data() + 12 * (i + 1), &vertices[i].x, 3 * sizeof(float));
+    }
+    mFile.write(facet.data(), facet.size());
+    ++mFacetCount;
+}
+
+void StlWriter::close() {
+    mFile.overwrite(sHeaderSize, &mFacetCount, sizeof(mFacetCount));
+    mFile.close();
+}
+
+ObjWriter::ObjWriter(const std::string& path, const std::string& objectName, const glm::vec4& color) : mFile(path) {
+    const size_t extensionStart = path.find_last_of('.');
+    const std::string materialPath = path.substr(0, extensionStart) + ".mtl";
+    const size_t nameStart = materialPath.find_last_of("/\\");
+    const std::string materialFileName =
+        nameStart == std::string::npos ? materialPath : materialPath.substr(nameStart + 1);
+
+    {
+        BufferedFileWriter materialFile(materialPath);
+        materialFile.write("newmtl " + objectName + "\n");
+        TextLine line;
+        line << "Kd " << color.r << " " << color.g << " " << color.b << "\nd " << color.a << "\n";
+        materialFile.write(line.data(), line.size());
+        materialFile.close();
+    }
+
+    mFile.write("# Exported by Pepr3D\nmtllib " + materialFileName + "\no " + objectName + "\nusemtl " + objectName +
+                "\n");
+}
+
+void ObjWriter::addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& normals) {
+    std::array<uint32_t, 3> vertexIndices;
+    std::array<uint32_t, 3> normalIndices;
+    for(size_t i = 0; i < 3; ++i) {
+        // OBJ indices start at 1
+        vertexIndices[i] = writeIndexed(mFile, mVertexLookup, vertices[i], {"v ", " ", " ", "\n"}, 1);
+        normalIndices[i] = writeIndexed(mFile, mNormalLookup, normals[i], {"vn ", " ", " ", "\n"}, 1);
+    }
+
+    TextLine line;
+    line << "f";
+    for(size_t i = 0; i < 3; ++i) {
+        line << " " << vertexIndices[i] << "//" << normalIndices[i];
+    }
+    line << "\n";
+    mFile.write(line.data(), line.size());
+}
+
+void ObjWriter::close() {
+    mFile.close();
+}
+
+void ZipWriter::beginEntry(const std::string& name) {
+    if(mIsEntryOpen) {
+        endEntry();
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.headerOffset = mFile.getSize();
+    checkLimit(entry.headerOffset);
+
+    // Sizes and checksum are not known yet, the header is written again by endEntry()
+    const std::vector<char> header = getLocalHeader(entry);
+    mFile.write(header.data(), header.size());
+    mFile.write(name);
+
+    mEntries.push_back(std::move(entry));
+    mIsEntryOpen = true;
+}
+
+void ZipWriter::write(const void* data, size_t size) {
+    P_ASSERT(mIsEntryOpen);
+    Entry& entry = mEntries.back();
+    entry.crc = updateCrc32(entry.crc, data, size);
+    entry.size += size;
+    mFile.write(data, size);
+}
+
+void ZipWriter::endEntry() {
+    P_ASSERT(mIsEntryOpen);
+    const Entry& entry = mEntries.back();
+    checkLimit(entry.size);
+    const std::vector<char> header = getLocalHeader(entry);
+    mFile.overwrite(entry.headerOffset, header.data(), header.size());
+    mIsEntryOpen = false;
+}
+
+void ZipWriter::close() {
+    if(mIsEntryOpen) {
+        endEntry();
+    }
+
+    const uint64_t directoryOffset = mFile.getSize();
+    checkLimit(directoryOffset);
+    for(const Entry& entry : mEntries) {
+        std::vector<char> header;
+        appendValue<uint32_t>(header, 0x02014b50);
+        appendValue<uint16_t>(header, sZipVersion);  // made by
+        appendValue<uint16_t>(header, sZipVersion);  // needed to extract
+        appendValue<uint16_t>(header, 0);            // flags
+        appendValue<uint16_t>(header, 0);            // stored
+        appendValue<uint16_t>(header, sDosTime);
+        appendValue<uint16_t>(header, sDosDate);
+        appendValue<uint32_t>(header, entry.crc);
+        appendValue<uint32_t>(header, static_cast<uint32_t>(entry.size));  // compressed
+        appendValue<uint32_t>(header, static_cast<uint32_t>(entry.size));  // uncompressed
+        appendValue<uint16_t>(header, static_cast<uint16_t>(entry.name.size()));
+        appendValue<uint16_t>(header, 0);  // extra field length
+        appendValue<uint16_t>(header, 0);  // comment length
+        appendValue<uint16_t>(header, 0);  // disk number
+        appendValue<uint16_t>(header, 0);  // internal attributes
+        appendValue<uint32_t>(header, 0);  // external attributes
+        appendValue<uint32_t>(header, static_cast<uint32_t>(entry.headerOffset));
+        mFile.write(header.data(), header.size());
+        mFile.write(entry.name);
+    }
+    const uint64_t directorySize = mFile.getSize() - directoryOffset;
+    checkLimit(directorySize);
+
+    std::vector<char> end;
+    appendValue<uint32_t>(end, 0x06054b50);
+    appendValue<uint16_t>(end, 0);  // this disk
+    appendValue<uint16_t>(end, 0);  // disk with the central directory
+    appendValue<uint16_t>(end, static_cast<uint16_t>(mEntries.size()));
+    appendValue<uint16_t>(end, static_cast<uint16_t>(mEntries.size()));
+    appendValue<uint32_t>(end, static_cast<uint32_t>(directorySize));
+    appendValue<uint32_t>(end, static_cast<uint32_t>(directoryOffset));
+    appendValue<uint16_t>(end, 0);  // comment length
+    mFile.write(end.data(), end.size());
+    mFile.close();
+}
+
+uint32_t ZipWriter::updateCrc32(uint32_t crc, const void* data, size_t size) {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> result;
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for(int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+
+    const unsigned char* const bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::vector<char> ZipWriter::getLocalHeader(const Entry& entry) const {
+    std::vector<char> header;
+    appendValue<uint32_t>(header, 0x04034b50);
+    appendValue<uint16_t>(header, sZipVersion);
+    appendValue<uint16_t>(header, 0);  // flags
+    appendValue<uint16_t>(header, 0);  // stored
+    appendValue<uint16_t>(header, sDosTime);
+    appendValue<uint16_t>(header, sDosDate);
+    appendValue<uint32_t>(header, entry.crc);
+    appendValue<uint32_t>(header, static_cast<uint32_t>(entry.size));  // compressed
+    appendValue<uint32_t>(header, static_cast<uint32_t>(entry.size));  // uncompressed
+    appendValue<uint16_t>(header, static_cast<uint16_t>(entry.name.size()));
+    appendValue<uint16_t>(header, 0);  // extra field length
+    return header;
+}
+
+void ZipWriter::checkLimit(uint64_t value) const {
+    if(value >= std::numeric_limits<uint32_t>::max() || mEntries.size() >= std::numeric_limits<uint16_t>::max()) {
+        CI_LOG_E("The exported ZIP archive would be larger than 4 GB");
+        throw std::runtime_error("The exported file would be larger than 4 GB, which is not supported.");
+    }
+}
+
+ThreeMfWriter::ThreeMfWriter(const std::string& path, const std::vector<glm::vec4>& colors) : mZip(path) {
+    P_ASSERT(!colors.empty());
+
+    mZip.beginEntry("[Content_Types].xml");
+    mZip.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+        "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+        "</Types>\n");
+
+    mZip.beginEntry("_rels/.rels");
+    mZip.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+        "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" "
+        "Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+        "</Relationships>\n");
+
+    mZip.beginEntry("3D/3dmodel.model");
+    mZip.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<model unit=\"millimeter\" xml:lang=\"en-US\" "
+        "xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+        "<resources>\n");
+
+    TextLine materialsLine;
+    materialsLine << "<basematerials id=\"" << sMaterialsId << "\">\n";
+    mZip.write(materialsLine.data(), materialsLine.size());
+    for(size_t i = 0; i < colors.size(); ++i) {
+        std::array<char, 10> displayColor;
+        const auto toByte = [](float channel) {
+            return static_cast<unsigned>(std::lround(std::clamp(channel, 0.0f, 1.0f) * 255.0f));
+        };
+        std::snprintf(displayColor.data(), displayColor.size(), "#%02X%02X%02X%02X", toByte(colors[i].r),
+                      toByte(colors[i].g), toByte(colors[i].b), toByte(colors[i].a));
+
+        TextLine line;
+        line << "<base name=\"Color " << i + 1 << "\" displaycolor=\"" << displayColor.data() << "\"/>\n";
+        mZip.write(line.data(), line.size());
+    }
+    mZip.write("</basematerials>\n");
+}
+
+void ThreeMfWriter::beginObject(size_t colorIdx) {
+    P_ASSERT(!mIsObjectOpen);
+    mIsObjectOpen = true;
+    mObjectColor = colorIdx;
+    mVertexLookup.clear();
+    mVertices.clear();
+    mTriangles.clear();
+}
+
+void ThreeMfWriter::addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>&) {
+    P_ASSERT(mIsObjectOpen);
+    std::array<uint32_t, 3> triangle;
+    for(size_t i = 0; i < 3; ++i) {
+        const auto inserted =
+            mVertexLookup.emplace(getPositionKey(vertices[i]), static_cast<uint32_t>(mVertices.size()));
+        if(inserted.second) {
+            mVertices.push_back(vertices[i]);
+        }
+        triangle[i] = *inserted.first;
+    }
+
+    // 3MF does not allow triangles with a repeated vertex, e.g. sides of an extrusion with zero depth
+    if(triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[2] != triangle[0]) {
+        mTriangles.push_back(triangle);
+    }
+}
+
+void ThreeMfWriter::endObject() {
+    P_ASSERT(mIsObjectOpen);
+    mIsObjectOpen = false;
+
+    // 3MF does not allow objects without triangles, e.g. of a color that is not used
+    if(mTriangles.empty()) {
+        return;
+    }
+    ++mObjectCount;
+
+    TextLine header;
+    header << "<object id=\"" << sMaterialsId + mObjectCount << "\" type=\"model\" pid=\"" << sMaterialsId
+           << "\" pindex=\"" << mObjectColor << "\">\n<mesh>\n<vertices>\n";
+    mZip.write(header.data(), header.size());
+    for(const glm::vec3& vertex : mVertices) {
+        TextLine line;
+        line << "<vertex x=\"" << vertex.x << "\" y=\"" << vertex.y << "\" z=\"" << vertex.z << "\"/>\n";
+        mZip.write(line.data(), line.size());
+    }
+    mZip.write("</vertices>\n<triangles>\n");
+    for(const std::array<uint32_t, 3>& triangle : mTriangles) {
+        TextLine line;
+        line << "<triangle v1=\"" << triangle[0] << "\" v2=\"" << triangle[1] << "\" v3=\"" << triangle[2] << "\"/>\n";
+        mZip.write(line.data(), line.size());
+    }
+    mZip.write("</triangles>\n</mesh>\n</object>\n");
+}
+
+void ThreeMfWriter::close() {
+    P_ASSERT(!mIsObjectOpen);
+    mZip.write("</resources>\n<build>\n");
+    for(size_t i = 1; i <= mObjectCount; ++i) {
+        TextLine line;
+        line << "<item objectid=\"" << sMaterialsId + i << "\"/>\n";
+        mZip.write(line.data(), line.size());
+    }
+    mZip.write("</build>\n</model>\n");
+    mZip.close();
+}
+
+}  // namespace pepr3d
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "geometry/PositionMap.h"
+
+namespace pepr3d {
+
+/// Receives the triangles of a single exported object one by one, so that the object never has to be held in memory
+/// as a whole.
+class TriangleSink {
+   public:
+    virtual ~TriangleSink() = default;
+
+    /// Vertices are in counter-clockwise order, every vertex has its own normal
+    virtual void addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& normals) = 0;
+
+    /// Triangle of an extrusion, its vertices are at vertices[j] - depth * offsets[j].
+    /// Sinks that keep the offsets can move the vertices to another depth later.
+    virtual void addExtrudedTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& offsets,
+                                     float depth, const std::array<glm::vec3, 3>& normals) {
+        addTriangle({vertices[0] - depth * offsets[0], vertices[1] - depth * offsets[1],
+                     vertices[2] - depth * offsets[2]},
+                    normals);
+    }
+
+    /// Extruded triangle facing the other way, its corners are given in the order of the triangle it was extruded
+    /// from, so they are counter-clockwise as vertices[2], vertices[1], vertices[0].
+    /// Sinks that index their vertices can keep the given order and reverse only the face.
+    virtual void addReversedExtrudedTriangle(const std::array<glm::vec3, 3>& vertices,
+                                             const std::array<glm::vec3, 3>& offsets, float depth,
+                                             const std::array<glm::vec3, 3>& normals) {
+        addExtrudedTriangle({vertices[2], vertices[1], vertices[0]}, {offsets[2], offsets[1], offsets[0]}, depth,
+                            {normals[2], normals[1], normals[0]});
+    }
+};
+
+/// Writes a file through a large buffer.
+/// All methods throw std::runtime_error when the file cannot be written.
+class BufferedFileWriter {
+   public:
+    explicit BufferedFileWriter(const std::string& path);
+
+    /// Closes the file if close() was not called, e.g. during stack unwinding, without reporting errors
+    ~BufferedFileWriter();
+
+    BufferedFileWriter(const BufferedFileWriter&) = delete;
+    BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+    void write(const void* data, size_t size);
+
+    void write(const std::string& text) {
+        write(text.data(), text.size());
+    }
+
+    /// Write the bytes of the value as they are, all platforms we build for are little endian
+    template <typename T>
+    void writeValue(const T& value) {
+        write(&value, sizeof(T));
+    }
+
+    /// Number of bytes written so far
+    uint64_t getSize() const {
+        return mFlushedSize + mBuffer.size();
+    }
+
+    /// Replace bytes that were already written, e.g. a count in a header that is known only at the end
+    void overwrite(uint64_t position, const void* data, size_t size);
+
+    /// Write the rest of the buffer and close the file
+    void close();
+
+   private:
+    static const size_t sBufferSize = 1 << 20;
+
+    void flush();
+
+    [[noreturn]] void fail(const std::string& what) const;
+
+    std::string mPath;
+    std::FILE* mFile = nullptr;
+    std::vector<char> mBuffer;
+
+    /// Number of bytes already passed to the file
+    uint64_t mFlushedSize = 0;
+};
+
+/// Writes a binary STL file, facet normals are the normalized sums of the vertex normals, as in Assimp
+class StlWriter : public TriangleSink {
+   public:
+    explicit StlWriter(const std::string& path);
+
+    void addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& normals) override;
+
+    /// Write the number of facets into the header and close the file
+    void close();
+
+   private:
+    static const size_t sHeaderSize = 80;
+
+    BufferedFileWriter mFile;
+    uint32_t mFacetCount = 0;
+};
+
+/// Writes an ASCII OBJ file with a single object and a MTL file with its color next to it.
+/// Identical vertices and normals are written only once.
+class ObjWriter : public TriangleSink {
+   public:
+    /// @param path of the OBJ file, the MTL file gets the same path with the .mtl extension
+    ObjWriter(const std::string& path, const std::string& objectName, const glm::vec4& color);
+
+    void addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& normals) override;
+
+    void close();
+
+   private:
+    BufferedFileWriter mFile;
+    PositionMap<uint32_t> mVertexLookup;
+    PositionMap<uint32_t> mNormalLookup;
+};
+
+/// Writes the uncompressed entries of a ZIP archive one after another, each of them streamed
+class ZipWriter {
+   public:
+    explicit ZipWriter(const std::string& path) : mFile(path) {}
+
+    /// Start a new entry, finishing the previous one
+    void beginEntry(const std::string& name);
+
+    /// Append data to the current entry
+    void write(const void* data, size_t size);
+
+    void write(const std::string& text) {
+        write(text.data(), text.size());
+    }
+
+    /// Finish the last entry, write the central directory and close the file
+    void close();
+
+    static uint32_t updateCrc32(uint32_t crc, const void* data, size_t size);
+
+   private:
+    struct Entry {
+        std::string name;
+        uint64_t headerOffset = 0;
+        uint64_t size = 0;
+        uint32_t crc = 0;
+    };
+
+    void endEntry();
+
+    /// Fixed part of the local file header
+    std::vector<char> getLocalHeader(const Entry& entry) const;
+
+    /// Offsets and sizes have to fit into 32 bits without the ZIP64 extension
+    void checkLimit(uint64_t value) const;
+
+    BufferedFileWriter mFile;
+    std::vector<Entry> mEntries;
+    bool mIsEntryOpen = false;
+};
+
+/// Writes a single 3MF file with a separate object of its own material for every exported color.
+/// Identical vertices of an object are joined, so that the objects are indexed meshes as 3MF requires.
+class ThreeMfWriter : public TriangleSink {
+   public:
+    /// @param colors materials of the objects, objects refer to them by their index
+    ThreeMfWriter(const std::string& path, const std::vector<glm::vec4>& colors);
+
+    /// Start a new object, following triangles belong to it until endObject()
+    void beginObject(size_t colorIdx);
+
+    void addTriangle(const std::array<glm::vec3, 3>& vertices, const std::array<glm::vec3, 3>& normals) override;
+
+    /// Writes the object, objects without any triangles are left out
+    void endObject();
+
+    /// Add all objects to the build and close the file
+    void close();
+
+   private:
+    /// Material group with the colors has this id, objects are numbered after it
+    static const size_t sMaterialsId = 1;
+
+    ZipWriter mZip;
+    size_t mObjectCount = 0;
+    bool mIsObjectOpen = false;
+
+    /// The current object is kept until endObject(), when it is known whether it has any triangles
+    size_t mObjectColor = 0;
+    PositionMap<uint32_t> mVertexLookup;
+    std::vector<glm::vec3> mVertices;
+    std::vector<std::array<uint32_t, 3>> mTriangles;
+};
+
+}  // namespace pepr3d
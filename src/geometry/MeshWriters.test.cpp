@@ -0,0 +1,198 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/MeshWriters.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pepr3d {
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+T readValue(const std::string& data, size_t offset) {
+    T value;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+/// Two triangles of a unit square facing +Z, sharing the diagonal, one of them with -0.0 coordinates
+void addSquare(TriangleSink& sink) {
+    const glm::vec3 normal(0, 0, 1);
+    sink.addTriangle({glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(1, 1, 0)}, {normal, normal, normal});
+    sink.addTriangle({glm::vec3(-0.f, 0, 0), glm::vec3(1, 1, 0), glm::vec3(0, 1, -0.f)}, {normal, normal, normal});
+}
+
+TEST(MeshWriters, binaryStl) {
+    const std::string path = "meshWritersTest.stl";
+    StlWriter writer(path);
+    addSquare(writer);
+    // Facet normal is the normalized sum of the vertex normals
+    writer.addTriangle({glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)},
+                       {glm::vec3(1, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)});
+    writer.close();
+
+    const std::string data = readFile(path);
+    std::remove(path.c_str());
+
+    ASSERT_EQ(data.size(), 80 + 4 + 3 * 50);
+    EXPECT_EQ(readValue<uint32_t>(data, 80), 3);
+
+    const size_t secondFacet = 84 + 50;
+    EXPECT_EQ(readValue<float>(data, secondFacet + 8), 1.f);
+    const float minusZero = readValue<float>(data, secondFacet + 12);
+    EXPECT_EQ(minusZero, 0.f);
+    EXPECT_TRUE(std::signbit(minusZero));  // positions are written exactly as they are
+    EXPECT_EQ(readValue<float>(data, secondFacet + 40), 1.f);
+    EXPECT_EQ(readValue<uint16_t>(data, secondFacet + 48), 0);
+
+    const size_t thirdFacet = 84 + 100;
+    EXPECT_FLOAT_EQ(readValue<float>(data, thirdFacet), 2.f / std::sqrt(5.f));
+    EXPECT_FLOAT_EQ(readValue<float>(data, thirdFacet + 4), 1.f / std::sqrt(5.f));
+    EXPECT_EQ(readValue<float>(data, thirdFacet + 8), 0.f);
+}
+
+TEST(MeshWriters, obj) {
+    const std::string path = "meshWritersTest.obj";
+    const std::string materialPath = "meshWritersTest.mtl";
+    ObjWriter writer(path, "color_2", glm::vec4(1.f, 0.5f, 0.25f, 1.f));
+    addSquare(writer);
+    writer.close();
+
+    const std::string data = readFile(path);
+    const std::string material = readFile(materialPath);
+    std::remove(path.c_str());
+    std::remove(materialPath.c_str());
+
+    // Shared vertices and normals are written only once, -0.0 is joined with 0.0
+    EXPECT_EQ(data,
+              "# Exported by Pepr3D\n"
+              "mtllib meshWritersTest.mtl\n"
+              "o color_2\n"
+              "usemtl color_2\n"
+              "v 0 0 0\n"
+              "vn 0 0 1\n"
+              "v 1 0 0\n"
+              "v 1 1 0\n"
+              "f 1//1 2//1 3//1\n"
+              "v 0 1 -0\n"
+              "f 1//1 3//1 4//1\n");
+    EXPECT_EQ(material, "newmtl color_2\nKd 1 0.5 0.25\nd 1\n");
+}
+
+TEST(MeshWriters, crc32) {
+    const std::string data = "123456789";
+    EXPECT_EQ(ZipWriter::updateCrc32(0, data.data(), data.size()), 0xCBF43926);
+    // Computed in parts the same as at once
+    EXPECT_EQ(ZipWriter::updateCrc32(ZipWriter::updateCrc32(0, data.data(), 4), data.data() + 4, 5), 0xCBF43926);
+}
+
+TEST(MeshWriters, threeMf) {
+    const std::string path = "meshWritersTest.3mf";
+    ThreeMfWriter writer(path, {glm::vec4(1.f, 0.f, 0.f, 1.f), glm::vec4(0.f, 0.f, 1.f, 0.5f)});
+    writer.beginObject(1);
+    addSquare(writer);
+    writer.endObject();
+    // Objects without triangles are left out
+    writer.beginObject(1);
+    writer.endObject();
+    writer.beginObject(1);
+    writer.addTriangle({glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), glm::vec3(1, 0, 0)}, {});
+    writer.endObject();
+    writer.beginObject(0);
+    addSquare(writer);
+    // Degenerate triangles are left out
+    writer.addTriangle({glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), glm::vec3(1, 0, 0)}, {});
+    writer.endObject();
+    writer.close();
+
+    const std::string data = readFile(path);
+    std::remove(path.c_str());
+
+    // Read the stored entries one after another by their local headers
+    std::map<std::string, std::string> entries;
+    size_t offset = 0;
+    while(readValue<uint32_t>(data, offset) == 0x04034b50) {
+        EXPECT_EQ(readValue<uint16_t>(data, offset + 8), 0);  // stored
+        const uint32_t crc = readValue<uint32_t>(data, offset + 14);
+        const uint32_t size = readValue<uint32_t>(data, offset + 18);
+        EXPECT_EQ(readValue<uint32_t>(data, offset + 22), size);
+        const uint16_t nameLength = readValue<uint16_t>(data, offset + 26);
+        const std::string name = data.substr(offset + 30, nameLength);
+        const std::string content = data.substr(offset + 30 + nameLength, size);
+        EXPECT_EQ(ZipWriter::updateCrc32(0, content.data(), content.size()), crc);
+        entries[name] = content;
+        offset += 30 + nameLength + size;
+    }
+
+    ASSERT_EQ(entries.size(), 3);
+    EXPECT_EQ(entries.count("[Content_Types].xml"), 1);
+    EXPECT_EQ(entries.count("_rels/.rels"), 1);
+    ASSERT_EQ(entries.count("3D/3dmodel.model"), 1);
+
+    // Central directory follows the entries, the end record points to it
+    const size_t endRecord = data.size() - 22;
+    EXPECT_EQ(readValue<uint32_t>(data, offset), 0x02014b50);
+    EXPECT_EQ(readValue<uint32_t>(data, endRecord), 0x06054b50);
+    EXPECT_EQ(readValue<uint16_t>(data, endRecord + 10), 3);
+    EXPECT_EQ(readValue<uint32_t>(data, endRecord + 12), endRecord - offset);
+    EXPECT_EQ(readValue<uint32_t>(data, endRecord + 16), offset);
+
+    const std::string& model = entries["3D/3dmodel.model"];
+    EXPECT_NE(model.find("<base name=\"Color 1\" displaycolor=\"#FF0000FF\"/>\n"
+                         "<base name=\"Color 2\" displaycolor=\"#0000FF80\"/>\n"),
+              std::string::npos);
+    const std::string square =
+        "<mesh>\n<vertices>\n"
+        "<vertex x=\"0\" y=\"0\" z=\"0\"/>\n"
+        "<vertex x=\"1\" y=\"0\" z=\"0\"/>\n"
+        "<vertex x=\"1\" y=\"1\" z=\"0\"/>\n"
+        "<vertex x=\"0\" y=\"1\" z=\"-0\"/>\n"
+        "</vertices>\n<triangles>\n"
+        "<triangle v1=\"0\" v2=\"1\" v3=\"2\"/>\n"
+        "<triangle v1=\"0\" v2=\"2\" v3=\"3\"/>\n"
+        "</triangles>\n</mesh>\n</object>\n";
+    EXPECT_NE(model.find("<object id=\"2\" type=\"model\" pid=\"1\" pindex=\"1\">\n" + square + "<object id=\"3\""),
+              std::string::npos);
+    EXPECT_NE(model.find("<object id=\"3\" type=\"model\" pid=\"1\" pindex=\"0\">\n" + square + "</resources>\n"),
+              std::string::npos);
+    EXPECT_NE(model.find("<build>\n<item objectid=\"2\"/>\n<item objectid=\"3\"/>\n</build>\n</model>\n"),
+              std::string::npos);
+}
+
+TEST(MeshWriters, bufferedOverwrite) {
+    /**
+     * Test that bytes are replaced both while they are still buffered and after they were written to the file
+     */
+
+    const std::string path = "meshWritersTest.bin";
+    BufferedFileWriter writer(path);
+    writer.write(std::string("abcdef"));
+    writer.overwrite(1, "X", 1);
+    const std::vector<char> large(3 << 20, 'z');  // larger than the buffer
+    writer.write(large.data(), large.size());
+    writer.overwrite(4, "YY", 2);
+    writer.write(std::string("end"));
+    EXPECT_EQ(writer.getSize(), 6 + large.size() + 3);
+    writer.close();
+
+    const std::string data = readFile(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(data.size(), 6 + large.size() + 3);
+    EXPECT_EQ(data.substr(0, 7), "aXcdYYz");
+    EXPECT_EQ(data.substr(data.size() - 4), "zend");
+}
+
+}  // namespace pepr3d
+#endif
@@ -5,81 +5,123 @@
 
 #include <glm/gtc/epsilon.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <numeric>
 #include <sstream>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "ThreadPool.h"
+
 #include "geometry/AssimpProgress.h"
 #include "geometry/ExportType.h"
 #include "geometry/Geometry.h"
 #include "geometry/GeometryProgress.h"
+#include "geometry/MeshWriters.h"
 #include "geometry/PolyhedronData.h"
 #include "geometry/Triangle.h"
 #include "geometry/TrianglePrimitive.h"
+#include "geometry/VertexWelder.h"
 
 typedef size_t colorIndex;
 
 namespace pepr3d {
 
-/// Exports Geometry to separate files via Assimp, supports surface export and depth extrusions
+/// Exports Geometry to separate files, supports surface export and depth extrusions.
+/// STL, OBJ and 3MF files are streamed straight from the Geometry, other formats are written via Assimp scenes.
 class ModelExporter {
     const Geometry *mGeometry;
 
     GeometryProgress *mProgress;
     std::vector<float> mExtrusionCoef;
 
+    /// Scenes of different colors are created and exported concurrently on this pool
+    ::ThreadPool &mThreadPool;
+
    public:
-    ModelExporter(const Geometry *geometry, GeometryProgress *progress) : mGeometry(geometry), mProgress(progress) {}
+    ModelExporter(const Geometry *geometry, GeometryProgress *progress, ::ThreadPool &threadPool)
+        : mGeometry(geometry), mProgress(progress), mThreadPool(threadPool) {}
 
     /// Returns a map where each color index has a corresponding exported Assimp scene.
     std::map<colorIndex, std::unique_ptr<aiScene>> createScenes(ExportType exportType) {
-        switch(exportType) {
-        case ExportType::Surface: return createPolySurfaceScenes(); break;
-        case ExportType::NonPolySurface: return createNonPolySurfaceScenes(); break;
-        case ExportType::NonPolyExtrusion: return createNonPolyScenes(); break;
-        case ExportType::PolyExtrusion: return createPolyScenes(false); break;
-        case ExportType::PolyExtrusionWithSDF: return createPolyScenes(true); break;
-        default: P_ASSERT(false); return createNonPolySurfaceScenes();
+        std::map<colorIndex, std::unique_ptr<aiScene>> scenes;
+        prepareObjects(exportType, [&](const std::vector<colorIndex> &colors, const EmitObject &emitObject) {
+            scenes = createColorScenes(colors, emitObject);
+        });
+        return scenes;
+    }
+
+    /// Extruded object of a single color for the preview. Its vertices are kept together with the direction they move
+    /// in with the depth, so that a new depth does not need the object to be created again.
+    struct ExtrusionPreview {
+        /// Vertices before the extrusion, three for every triangle
+        std::vector<glm::vec3> vertices;
+
+        /// Vertex i is at vertices[i] - depth * offsets[i], vertices that stay on the surface have a zero offset
+        std::vector<glm::vec3> offsets;
+
+        std::vector<glm::vec3> normals;
+
+        /// Three indices into the vertices for every triangle, in counter-clockwise order
+        std::vector<uint32_t> indices;
+
+        /// Writes the vertices extruded to the depth to out, which has room for all of them
+        void extrude(float depth, glm::vec3 *out) const {
+            for(size_t i = 0; i < vertices.size(); i++) {
+                out[i] = vertices[i] - depth * offsets[i];
+            }
         }
+    };
+
+    /// Returns a map where each color index has a corresponding extruded object for the preview.
+    /// Extrusion coefficients are not needed, the previews are extruded later with getExtrusionDepth().
+    std::map<colorIndex, ExtrusionPreview> createExtrusionPreviews(ExportType exportType) {
+        // Normals of the sides are the same for every depth above zero, take them at the full depth
+        const std::vector<float> fullExtrusionCoef(mGeometry->getColorManager().size(), 1.0f);
+
+        std::map<colorIndex, ExtrusionPreview> previews;
+        const auto createPreviews = [&](const std::vector<colorIndex> &colors, const EmitObject &emitObject) {
+            previews = buildColorObjects<ExtrusionPreview>(colors, [&](colorIndex color) {
+                PreviewBuilder builder;
+                emitObject(color, builder);
+                return builder.takePreview();
+            });
+        };
+        prepareObjects(exportType, fullExtrusionCoef, createPreviews);
+        return previews;
+    }
+
+    /// Returns the depth of the extrusion with the coefficient between 0 and 1, relative to the size of the Geometry
+    float getExtrusionDepth(float extrusionCoef) const {
+        return glm::length(mGeometry->getBoundingBoxMax() - mGeometry->getBoundingBoxMin()) * extrusionCoef;
     }
 
     /// Saves the exported Geometry to files, may throw an exception on error.
     void saveModel(const std::string filePath, const std::string fileName, const std::string fileType,
                    ExportType exportType) {
-        Assimp::Exporter exporter;
-
         if(mProgress != nullptr) {
             mProgress->resetSave();
             mProgress->createScenePercentage = 0.0f;
         }
 
-        std::map<colorIndex, std::unique_ptr<aiScene>> scenes = createScenes(exportType);
-
-        if(mProgress != nullptr) {
-            mProgress->createScenePercentage = 1.0f;
-            mProgress->exportFilePercentage = 0.0f;
-        }
-
-        std::string assimpFileType = fileType;
-        if(fileType == "stl" || fileType == "ply") {
-            assimpFileType += "b";  // binary
-        }
-
-        int sceneCounter = 0;
-        for(auto &scene : scenes) {
-            std::stringstream ss;
-            ss << filePath << "/" << fileName << "_" << sceneCounter << "." << fileType;
-            auto exportResult = exporter.Export(scene.second.get(), assimpFileType, ss.str());
-            if(exportResult != AI_SUCCESS) {
-                throw std::runtime_error(
-                    "Could not export the scenes to the specified files. Make sure the model is valid and you have "
-                    "write permissions to the directory or files you are exporting to.");
-            }
-            sceneCounter++;
+        if(fileType == "stl" || fileType == "obj") {
+            saveStreamedFiles(filePath, fileName, fileType, exportType);
+        } else if(fileType == "3mf") {
+            saveThreeMf(filePath + "/" + fileName + ".3mf", exportType);
+        } else {
+            saveAssimpFiles(filePath, fileName, fileType, exportType);
         }
 
         if(mProgress != nullptr) {
+            mProgress->createScenePercentage = 1.0f;
             mProgress->exportFilePercentage = 1.0f;
         }
     }
@@ -99,620 +141,726 @@ class ModelExporter {
         bool isBoundary = false;
     };
 
-    /// Creates surface only exported scenes without the need for a CGAL Polyhedron.
-    /// Returns a map where each color index has a corresponding exported Assimp scene.
-    std::map<colorIndex, std::unique_ptr<aiScene>> createNonPolySurfaceScenes() {
-        std::map<colorIndex, std::unique_ptr<aiScene>> scenes;
+    /// Edge between two joined vertices, the lower vertex index first
+    using EdgeKey = std::pair<size_t, size_t>;
 
-        std::map<colorIndex, std::vector<unsigned int>> colorsWithIndices;
-
-        for(unsigned int i = 0; i < mGeometry->getTriangleCount(); i++) {
-            colorIndex color = mGeometry->getTriangle(i).getColor();
-            colorsWithIndices[color].emplace_back(static_cast<unsigned int>(i));
+    struct EdgeKeyHash {
+        size_t operator()(const EdgeKey &edge) const {
+            return static_cast<size_t>(PositionHash::mix(PositionHash::mix(edge.first) ^ edge.second));
         }
+    };
 
-        for(auto &indexOfColor : colorsWithIndices) {
-            scenes[indexOfColor.first] = std::move(createNewNonPolySurfaceScene(indexOfColor.second));
-        }
+    /// Both directions of an edge, as they appear in the triangles.
+    /// The first one goes from the lower vertex index to the higher one.
+    struct EdgeSides {
+        std::array<IndexedEdge, 2> sides;
+        std::array<bool, 2> isPresent = {false, false};
+    };
 
-        return scenes;
-    }
+    using EdgeLookup = std::unordered_map<EdgeKey, EdgeSides, EdgeKeyHash>;
 
-    /// Creates surface only exported scenes with the need for a CGAL Polyhedron.
-    /// Returns a map where each color index has a corresponding exported Assimp scene.
-    std::map<colorIndex, std::unique_ptr<aiScene>> createPolySurfaceScenes() {
-        std::map<colorIndex, std::unique_ptr<aiScene>> scenes;
+    /// Marks halfedges that are not on the border of any color
+    static constexpr colorIndex sNoBorderColor = std::numeric_limits<colorIndex>::max();
 
-        std::map<colorIndex, std::vector<DetailedTriangleId>> colorsWithIndices;
+    /// Emits all triangles of the exported object of a color into the sink.
+    /// Called from several threads at once for different colors, it must only read shared data.
+    using EmitObject = std::function<void(colorIndex color, TriangleSink &sink)>;
 
-        for(PolyhedronData::face_descriptor fd : mGeometry->getMeshDetailed()->faces()) {
-            colorIndex color = mGeometry->getTriangle(mGeometry->getMeshDetailedIdMap()[fd]).getColor();
-            colorsWithIndices[color].emplace_back(mGeometry->getMeshDetailedIdMap()[fd]);
-        }
+    /// Receives the exported colors in ascending order and the function emitting their objects.
+    /// The data shared by the objects live only until it returns.
+    using ProcessObjects = std::function<void(const std::vector<colorIndex> &colors, const EmitObject &emitObject)>;
 
-        for(auto &indexOfColor : colorsWithIndices) {
-            scenes[indexOfColor.first] = std::move(createNewPolySurfaceScene(indexOfColor.second));
+    /// Collects the emitted triangles into an Assimp scene with a single mesh, every triangle has its own vertices
+    class SceneBuilder : public TriangleSink {
+       public:
+        void addTriangle(const std::array<glm::vec3, 3> &vertices, const std::array<glm::vec3, 3> &normals) override {
+            addVertices(vertices, normals);
+            mIsReversed.push_back(false);
         }
 
-        return scenes;
-    }
-
-    /// Creates extruded scenes without the need for a CGAL Polyhedron.
-    /// Returns a map where each color index has a corresponding exported Assimp scene.
-    std::map<colorIndex, std::unique_ptr<aiScene>> createNonPolyScenes() {
-        std::map<colorIndex, std::unique_ptr<aiScene>> scenes;
-
-        std::map<colorIndex, std::vector<unsigned int>> colorsWithIndices;
+        /// Keeps the vertices in the given order and reverses the indices of the face
+        void addReversedExtrudedTriangle(const std::array<glm::vec3, 3> &vertices,
+                                         const std::array<glm::vec3, 3> &offsets, float depth,
+                                         const std::array<glm::vec3, 3> &normals) override {
+            addVertices({vertices[0] - depth * offsets[0], vertices[1] - depth * offsets[1],
+                         vertices[2] - depth * offsets[2]},
+                        normals);
+            mIsReversed.push_back(true);
+        }
 
-        std::map<std::array<float, 3>, glm::vec3> summedVertexNormals;
+        std::unique_ptr<aiScene> createScene() const {
+            std::unique_ptr<aiScene> scene = std::make_unique<aiScene>();
 
-        // key=edge, value=(tri_idx, vert_idx, vert_idx)
-        std::map<std::array<std::array<float, 3>, 2>, IndexedEdge> edgeLookup;
+            scene->mRootNode = new aiNode();
 
-        for(unsigned int i = 0; i < mGeometry->getTriangleCount(); i++) {
-            colorIndex color = mGeometry->getTriangle(i).getColor();
-            colorsWithIndices[color].emplace_back(static_cast<unsigned int>(i));
+            scene->mMaterials = new aiMaterial *[1];
+            scene->mMaterials[0] = nullptr;
+            scene->mNumMaterials = 1;
 
-            for(unsigned int j = 0; j < 3; j++) {
-                std::array<float, 3> vertex = {mGeometry->getTriangle(i).getVertex(j).x,
-                                               mGeometry->getTriangle(i).getVertex(j).y,
-                                               mGeometry->getTriangle(i).getVertex(j).z};
+            scene->mMaterials[0] = new aiMaterial();
 
-                summedVertexNormals[vertex] += mGeometry->getTriangle(i).getNormal();
+            scene->mMeshes = new aiMesh *[1];
+            scene->mMeshes[0] = nullptr;
+            scene->mNumMeshes = 1;
 
-                std::array<float, 3> nextVertex = {mGeometry->getTriangle(i).getVertex((j + 1) % 3).x,
-                                                   mGeometry->getTriangle(i).getVertex((j + 1) % 3).y,
-                                                   mGeometry->getTriangle(i).getVertex((j + 1) % 3).z};
+            scene->mMeshes[0] = new aiMesh();
+            scene->mMeshes[0]->mMaterialIndex = 0;
 
-                IndexedEdge &edge = edgeLookup[{vertex, nextVertex}];
-                edge.color = mGeometry->getTriangle(i).getColor();
-                edge.tri = i;
-                edge.id1 = j;
-                edge.id2 = (j + 1) % 3;
-            }
-        }
+            scene->mRootNode->mMeshes = new unsigned int[1];
+            scene->mRootNode->mMeshes[0] = 0;
+            scene->mRootNode->mNumMeshes = 1;
 
-        normalizeSummedNormals(summedVertexNormals);
+            auto pMesh = scene->mMeshes[0];
 
-        computeBoundaryEdges(edgeLookup);
+            const size_t trianglesCount = mVertices.size() / 3;
 
-        for(auto &indexOfColor : colorsWithIndices) {
-            auto soloBoundary = selectBoundaryEdgesByColor(edgeLookup, indexOfColor.first);
+            pMesh->mVertices = new aiVector3D[3 * trianglesCount];
+            pMesh->mNormals = new aiVector3D[3 * trianglesCount];
+            std::copy(mVertices.begin(), mVertices.end(), pMesh->mVertices);
+            std::copy(mNormals.begin(), mNormals.end(), pMesh->mNormals);
 
-            scenes[indexOfColor.first] = std::move(createNewNonPolyScene(
-                indexOfColor.second, summedVertexNormals, soloBoundary, mExtrusionCoef[indexOfColor.first]));
-        }
+            pMesh->mNumVertices = (unsigned int)(3 * trianglesCount);
 
-        return scenes;
-    }
+            pMesh->mFaces = new aiFace[trianglesCount];
+            pMesh->mNumFaces = (unsigned int)(trianglesCount);
 
-    /// Normalize summed vertex normals
-    void normalizeSummedNormals(std::map<std::array<float, 3>, glm::vec3> &summedVertexNormals) {
-        for(auto &vertexNormal : summedVertexNormals) {
-            vertexNormal.second = glm::normalize(vertexNormal.second);
-        }
-    }
+            for(unsigned int i = 0; i < trianglesCount; i++) {
+                aiFace &face = pMesh->mFaces[i];
+                face.mIndices = new unsigned int[3];
+                face.mNumIndices = 3;
 
-    /// Decide if the edge is between two colors
-    void computeBoundaryEdges(std::map<std::array<std::array<float, 3>, 2>, IndexedEdge> &edgeLookup) {
-        for(auto &edge : edgeLookup) {
-            if(edgeLookup.count({edge.first[1], edge.first[0]})) {
-                if(!edge.second.isBoundary && edgeLookup[{edge.first[1], edge.first[0]}].color != edge.second.color) {
-                    edgeLookup[{edge.first[1], edge.first[0]}].isBoundary = true;
-                    edge.second.isBoundary = true;
+                for(unsigned int j = 0; j < face.mNumIndices; j++) {
+                    const unsigned int faceJ = mIsReversed[i] ? 2 - j : j;
+                    face.mIndices[faceJ] = 3 * i + j;
                 }
             }
+            return scene;
         }
-    }
 
-    /// Returns a vector of IndexedEdge that were boundary and with the specified color.
-    std::vector<IndexedEdge> selectBoundaryEdgesByColor(
-        std::map<std::array<std::array<float, 3>, 2>, IndexedEdge> &edgeLookup, colorIndex color) {
-        std::vector<IndexedEdge> soloBoundary;
-        for(auto &edge : edgeLookup) {
-            if(edge.second.color == color && edge.second.isBoundary) {
-                soloBoundary.emplace_back(edge.second);
+       private:
+        void addVertices(const std::array<glm::vec3, 3> &vertices, const std::array<glm::vec3, 3> &normals) {
+            for(unsigned int j = 0; j < 3; j++) {
+                mVertices.emplace_back(vertices[j].x, vertices[j].y, vertices[j].z);
+                mNormals.emplace_back(normals[j].x, normals[j].y, normals[j].z);
             }
         }
-        return soloBoundary;
-    }
-
-    /// Creates extruded scenes with the need for a CGAL Polyhedron.
-    /// Optionally extrudes relative to SDF values.
-    /// Returns a map where each color index has a corresponding exported Assimp scene.
-    std::map<colorIndex, std::unique_ptr<aiScene>> createPolyScenes(bool withSDF) {
-        std::map<colorIndex, std::unique_ptr<aiScene>> scenes;
-
-        std::map<colorIndex, std::vector<DetailedTriangleId>> colorsWithIndices;
 
-        std::unordered_map<PolyhedronData::vertex_descriptor, glm::vec3> summedVertexNormals;
-        std::map<PolyhedronData::vertex_descriptor, float> vertexSDF;
+        std::vector<aiVector3D> mVertices;
+        std::vector<aiVector3D> mNormals;
 
-        std::map<colorIndex, std::set<PolyhedronData::halfedge_descriptor>> borderEdges;
+        /// Whether the face of each triangle lists its vertices in the reversed order
+        std::vector<bool> mIsReversed;
+    };
 
-        for(PolyhedronData::face_descriptor fd : mGeometry->getMeshDetailed()->faces()) {
-            colorIndex color = mGeometry->getTriangle(mGeometry->getMeshDetailedIdMap()[fd]).getColor();
-            colorsWithIndices[color].emplace_back(mGeometry->getMeshDetailedIdMap()[fd]);
+    /// Collects the emitted triangles into an ExtrusionPreview
+    class PreviewBuilder : public TriangleSink {
+       public:
+        void addTriangle(const std::array<glm::vec3, 3> &vertices, const std::array<glm::vec3, 3> &normals) override {
+            addExtrudedTriangle(vertices, {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)}, 0.0f, normals);
         }
 
-        for(PolyhedronData::vertex_descriptor vd : mGeometry->getMeshDetailed()->vertices()) {
-            int degree = mGeometry->getMeshDetailed()->degree(vd);
-            std::vector<glm::vec3> vertexNormals;
+        void addExtrudedTriangle(const std::array<glm::vec3, 3> &vertices, const std::array<glm::vec3, 3> &offsets,
+                                 float, const std::array<glm::vec3, 3> &normals) override {
+            const uint32_t first = addVertices(vertices, offsets, normals);
+            mPreview.indices.insert(mPreview.indices.end(), {first, first + 1, first + 2});
+        }
 
-            auto halfedge = mGeometry->getMeshDetailed()->halfedge(vd);
+        /// Keeps the vertices in the same order as the scenes do, only the indices are reversed
+        void addReversedExtrudedTriangle(const std::array<glm::vec3, 3> &vertices,
+                                         const std::array<glm::vec3, 3> &offsets, float,
+                                         const std::array<glm::vec3, 3> &normals) override {
+            const uint32_t first = addVertices(vertices, offsets, normals);
+            mPreview.indices.insert(mPreview.indices.end(), {first + 2, first + 1, first});
+        }
 
-            for(size_t i = 0; i < degree; i++) {
-                auto face = mGeometry->getMeshDetailed()->face(halfedge);
+        ExtrusionPreview takePreview() {
+            return std::move(mPreview);
+        }
 
-                if(face.is_valid()) {
-                    DetailedTriangleId triIndex = mGeometry->getMeshDetailedIdMap()[face];
+       private:
+        /// Returns the index of the first added vertex
+        uint32_t addVertices(const std::array<glm::vec3, 3> &vertices, const std::array<glm::vec3, 3> &offsets,
+                             const std::array<glm::vec3, 3> &normals) {
+            const uint32_t first = static_cast<uint32_t>(mPreview.vertices.size());
+            mPreview.vertices.insert(mPreview.vertices.end(), vertices.begin(), vertices.end());
+            mPreview.offsets.insert(mPreview.offsets.end(), offsets.begin(), offsets.end());
+            mPreview.normals.insert(mPreview.normals.end(), normals.begin(), normals.end());
+            return first;
+        }
 
-                    if(withSDF) {
-                        vertexSDF[vd] += (float)mGeometry->getSdfValue(triIndex.getBaseId());
-                    }
+        ExtrusionPreview mPreview;
+    };
 
-                    vertexNormals.push_back(mGeometry->getTriangle(triIndex).getNormal());
+    /// Prepares the data shared by the objects of all colors and passes them to processObjects
+    void prepareObjects(ExportType exportType, const ProcessObjects &processObjects) {
+        prepareObjects(exportType, mExtrusionCoef, processObjects);
+    }
 
-                    colorIndex faceColor = mGeometry->getTriangle(triIndex).getColor();
+    /// Extrusions use the given coefficients indexed by the color index instead of the ones set for the export
+    void prepareObjects(ExportType exportType, const std::vector<float> &extrusionCoef,
+                        const ProcessObjects &processObjects) {
+        switch(exportType) {
+        case ExportType::Surface: preparePolySurfaceObjects(processObjects); break;
+        case ExportType::NonPolySurface: prepareNonPolySurfaceObjects(processObjects); break;
+        case ExportType::NonPolyExtrusion: prepareNonPolyObjects(extrusionCoef, processObjects); break;
+        case ExportType::PolyExtrusion: preparePolyObjects(false, extrusionCoef, processObjects); break;
+        case ExportType::PolyExtrusionWithSDF: preparePolyObjects(true, extrusionCoef, processObjects); break;
+        default: P_ASSERT(false); prepareNonPolySurfaceObjects(processObjects);
+        }
+    }
 
-                    auto oppositeHalfedge = mGeometry->getMeshDetailed()->opposite(halfedge);
-                    auto oppositeFace = mGeometry->getMeshDetailed()->face(oppositeHalfedge);
+    /// Writes a binary STL or an ASCII OBJ file for every color, the files are written concurrently
+    void saveStreamedFiles(const std::string &filePath, const std::string &fileName, const std::string &fileType,
+                           ExportType exportType) {
+        prepareObjects(exportType, [&](const std::vector<colorIndex> &colors, const EmitObject &emitObject) {
+            if(mProgress != nullptr) {
+                mProgress->createScenePercentage = 1.0f;
+                mProgress->exportFilePercentage = 0.0f;
+            }
 
-                    if(oppositeFace.is_valid()) {
-                        DetailedTriangleId oppositeFaceIdx = mGeometry->getMeshDetailedIdMap()[oppositeFace];
-                        colorIndex oppositeFaceColor = mGeometry->getTriangle(oppositeFaceIdx).getColor();
-                        if(faceColor != oppositeFaceColor) {
-                            borderEdges[faceColor].insert(halfedge);
-                        }
-                    } else {
-                        // halfedge is border edge (hole in the model), so it is alsou boundary edge
-                        borderEdges[faceColor].insert(halfedge);
-                    }
+            std::atomic<float> *percentage = mProgress != nullptr ? &mProgress->exportFilePercentage : nullptr;
+            forEachOnThreadPool(colors.size(), percentage, [&](const size_t fileIdx) {
+                std::stringstream ss;
+                ss << filePath << "/" << fileName << "_" << fileIdx << "." << fileType;
+
+                if(fileType == "stl") {
+                    StlWriter writer(ss.str());
+                    emitObject(colors[fileIdx], writer);
+                    writer.close();
+                } else {
+                    ObjWriter writer(ss.str(), "color_" + std::to_string(colors[fileIdx] + 1),
+                                     mGeometry->getColorManager().getColor(colors[fileIdx]));
+                    emitObject(colors[fileIdx], writer);
+                    writer.close();
                 }
+            });
+        });
+    }
+
+    /// Writes a single 3MF file with an object for every color. The objects go into one file one after another.
+    void saveThreeMf(const std::string &path, ExportType exportType) {
+        std::vector<glm::vec4> colorMap;
+        for(size_t i = 0; i < mGeometry->getColorManager().size(); i++) {
+            colorMap.push_back(mGeometry->getColorManager().getColor(i));
+        }
 
-                halfedge = mGeometry->getMeshDetailed()->next_around_target(halfedge);
+        prepareObjects(exportType, [&](const std::vector<colorIndex> &colors, const EmitObject &emitObject) {
+            if(mProgress != nullptr) {
+                mProgress->createScenePercentage = 1.0f;
+                mProgress->exportFilePercentage = 0.0f;
             }
 
-            float ep = glm::epsilon<float>();
+            ThreeMfWriter writer(path, colorMap);
+            for(size_t i = 0; i < colors.size(); i++) {
+                writer.beginObject(colors[i]);
+                emitObject(colors[i], writer);
+                writer.endObject();
 
-            bool isEpsSameNormal = false;
-            for(size_t i = 0; i < vertexNormals.size(); i++) {
-                for(size_t j = 0; j < i; j++) {
-                    isEpsSameNormal |= glm::all(glm::epsilonEqual(vertexNormals[i], vertexNormals[j], ep));
-                }
-                if(!isEpsSameNormal) {
-                    summedVertexNormals[vd] += vertexNormals[i];
+                if(mProgress != nullptr) {
+                    mProgress->exportFilePercentage = static_cast<float>(i + 1) / colors.size();
                 }
-                isEpsSameNormal = false;
             }
+            writer.close();
+        });
+    }
 
-            summedVertexNormals[vd] = glm::normalize(summedVertexNormals[vd]);
+    /// Creates the Assimp scenes of all colors and exports each of them to a separate file, concurrently
+    void saveAssimpFiles(const std::string &filePath, const std::string &fileName, const std::string &fileType,
+                         ExportType exportType) {
+        std::map<colorIndex, std::unique_ptr<aiScene>> scenes = createScenes(exportType);
 
-            if(withSDF) {
-                vertexSDF[vd] = vertexSDF[vd] / degree;  // average
-            }
+        if(mProgress != nullptr) {
+            mProgress->createScenePercentage = 1.0f;
+            mProgress->exportFilePercentage = 0.0f;
         }
 
-        for(auto &indexOfColor : colorsWithIndices) {
-            scenes[indexOfColor.first] =
-                std::move(createNewPolyScene(indexOfColor.second, summedVertexNormals, borderEdges[indexOfColor.first],
-                                             vertexSDF, mExtrusionCoef[indexOfColor.first]));
+        std::string assimpFileType = fileType;
+        if(fileType == "ply") {
+            assimpFileType += "b";  // binary
         }
 
-        return scenes;
-    }
+        std::vector<std::pair<std::string, const aiScene *>> files;
+        for(auto &scene : scenes) {
+            std::stringstream ss;
+            ss << filePath << "/" << fileName << "_" << files.size() << "." << fileType;
+            files.emplace_back(ss.str(), scene.second.get());
+        }
 
-    std::unique_ptr<aiScene> createNewNonPolySurfaceScene(std::vector<unsigned int> &triangleIndices) {
-        std::unique_ptr<aiScene> scene = std::make_unique<aiScene>();
+        std::atomic<float> *percentage = mProgress != nullptr ? &mProgress->exportFilePercentage : nullptr;
+        forEachOnThreadPool(files.size(), percentage, [&](const size_t fileIdx) {
+            // Assimp::Exporter keeps the state of the running export, so every file needs its own
+            Assimp::Exporter exporter;
+            auto exportResult = exporter.Export(files[fileIdx].second, assimpFileType, files[fileIdx].first);
+            if(exportResult != AI_SUCCESS) {
+                throw std::runtime_error(
+                    "Could not export the scenes to the specified files. Make sure the model is valid and you have "
+                    "write permissions to the directory or files you are exporting to.");
+            }
+        });
+    }
 
-        scene->mRootNode = new aiNode();
+    /// Creates the scene of every color on the thread pool, the colors do not depend on each other.
+    std::map<colorIndex, std::unique_ptr<aiScene>> createColorScenes(const std::vector<colorIndex> &colors,
+                                                                     const EmitObject &emitObject) {
+        return buildColorObjects<std::unique_ptr<aiScene>>(colors, [&](colorIndex color) {
+            SceneBuilder builder;
+            emitObject(color, builder);
+            return builder.createScene();
+        });
+    }
 
-        scene->mMaterials = new aiMaterial *[1];
-        scene->mMaterials[0] = nullptr;
-        scene->mNumMaterials = 1;
+    /// Calls processItem(i) for every i < count on the thread pool and reports the finished share to the percentage.
+    /// Every item is processed even if some of them throw, the exception of the first failed item is rethrown after.
+    template <typename ProcessItem>
+    void forEachOnThreadPool(size_t count, std::atomic<float> *percentage, ProcessItem processItem) {
+        std::vector<size_t> indices(count);
+        std::iota(indices.begin(), indices.end(), 0);
+
+        std::vector<std::exception_ptr> errors(count);
+        std::atomic<size_t> itemsDone{0};
+        mThreadPool.parallel_for(indices.begin(), indices.end(), [&](const size_t idx) {
+            try {
+                processItem(idx);
+            } catch(...) {
+                errors[idx] = std::current_exception();
+            }
 
-        scene->mMaterials[0] = new aiMaterial();
+            if(percentage != nullptr) {
+                // Items finish in any order, only ever move the progress forward
+                const float done = static_cast<float>(++itemsDone) / count;
+                float current = percentage->load();
+                while(current < done && !percentage->compare_exchange_weak(current, done)) {
+                }
+            }
+        });
 
-        scene->mMeshes = new aiMesh *[1];
-        scene->mMeshes[0] = nullptr;
-        scene->mNumMeshes = 1;
+        for(const std::exception_ptr &error : errors) {
+            if(error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
 
-        scene->mMeshes[0] = new aiMesh();
-        scene->mMeshes[0]->mMaterialIndex = 0;
+    /// Calls buildObject(color) for every color on the thread pool and returns the results by color
+    template <typename Object, typename BuildObject>
+    std::map<colorIndex, Object> buildColorObjects(const std::vector<colorIndex> &colors, BuildObject buildObject) {
+        std::vector<Object> colorObjects(colors.size());
+        std::atomic<float> *percentage = mProgress != nullptr ? &mProgress->createScenePercentage : nullptr;
+        forEachOnThreadPool(colors.size(), percentage,
+                            [&](const size_t objectIdx) { colorObjects[objectIdx] = buildObject(colors[objectIdx]); });
+
+        std::map<colorIndex, Object> objects;
+        for(size_t i = 0; i < colors.size(); i++) {
+            objects[colors[i]] = std::move(colorObjects[i]);
+        }
+        return objects;
+    }
 
-        scene->mRootNode->mMeshes = new unsigned int[1];
-        scene->mRootNode->mMeshes[0] = 0;
-        scene->mRootNode->mNumMeshes = 1;
+    /// Returns the keys of the map in ascending order
+    template <typename TriangleIndices>
+    static std::vector<colorIndex> getColors(const std::map<colorIndex, TriangleIndices> &colorsWithIndices) {
+        std::vector<colorIndex> colors;
+        for(const auto &indexOfColor : colorsWithIndices) {
+            colors.push_back(indexOfColor.first);
+        }
+        return colors;
+    }
 
-        auto pMesh = scene->mMeshes[0];
+    /// Prepares surface only objects without the need for a CGAL Polyhedron.
+    void prepareNonPolySurfaceObjects(const ProcessObjects &processObjects) {
+        std::map<colorIndex, std::vector<unsigned int>> colorsWithIndices;
 
-        size_t trianglesCount = triangleIndices.size();
+        for(unsigned int i = 0; i < mGeometry->getTriangleCount(); i++) {
+            colorIndex color = mGeometry->getTriangleColor(i);
+            colorsWithIndices[color].emplace_back(static_cast<unsigned int>(i));
+        }
 
-        pMesh->mVertices = new aiVector3D[3 * trianglesCount];
-        pMesh->mNormals = new aiVector3D[3 * trianglesCount];
+        processObjects(getColors(colorsWithIndices), [&](colorIndex color, TriangleSink &sink) {
+            emitSurfaceObject(colorsWithIndices.at(color), sink);
+        });
+    }
 
-        pMesh->mNumVertices = (unsigned int)(3 * trianglesCount);
+    /// Prepares surface only objects with the need for a CGAL Polyhedron.
+    void preparePolySurfaceObjects(const ProcessObjects &processObjects) {
+        std::map<colorIndex, std::vector<DetailedTriangleId>> colorsWithIndices;
 
-        pMesh->mFaces = new aiFace[trianglesCount];
-        pMesh->mNumFaces = (unsigned int)(trianglesCount);
+        for(PolyhedronData::face_descriptor fd : mGeometry->getMeshDetailed()->faces()) {
+            colorIndex color = mGeometry->getTriangleColor(mGeometry->getMeshDetailedIdMap()[fd]);
+            colorsWithIndices[color].emplace_back(mGeometry->getMeshDetailedIdMap()[fd]);
+        }
 
-        for(unsigned int i = 0; i < trianglesCount; i++) {
-            aiFace &face = pMesh->mFaces[i];
-            face.mIndices = new unsigned int[3];
-            face.mNumIndices = 3;
+        processObjects(getColors(colorsWithIndices), [&](colorIndex color, TriangleSink &sink) {
+            emitSurfaceObject(colorsWithIndices.at(color), sink);
+        });
+    }
 
-            for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                pMesh->mVertices[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getVertex(j).x,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).y,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).z);
+    /// Prepares extruded objects without the need for a CGAL Polyhedron.
+    void prepareNonPolyObjects(const std::vector<float> &extrusionCoef, const ProcessObjects &processObjects) {
+        std::map<colorIndex, std::vector<unsigned int>> colorsWithIndices;
 
-                pMesh->mNormals[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getNormal().x,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().y,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().z);
+        const size_t triangleCount = mGeometry->getTriangleCount();
 
-                face.mIndices[j] = 3 * i + j;
-            }
+        // Geometry built without its joined vertices gets them welded here
+        std::vector<glm::vec3> weldedVertices;
+        std::vector<std::array<size_t, 3>> weldedIndices;
+        const bool hasJoinedVertices = mGeometry->getPolyhedronIndices().size() == triangleCount;
+        if(!hasJoinedVertices) {
+            weldVertices(weldedVertices, weldedIndices);
         }
-        return scene;
-    }
-
-    std::unique_ptr<aiScene> createNewPolySurfaceScene(std::vector<DetailedTriangleId> &triangleIndices) {
-        std::unique_ptr<aiScene> scene = std::make_unique<aiScene>();
+        const std::vector<glm::vec3> &vertices =
+            hasJoinedVertices ? mGeometry->getPolyhedronVertices() : weldedVertices;
+        const std::vector<std::array<size_t, 3>> &indices =
+            hasJoinedVertices ? mGeometry->getPolyhedronIndices() : weldedIndices;
 
-        scene->mRootNode = new aiNode();
+        std::vector<glm::vec3> summedVertexNormals(vertices.size(), glm::vec3(0.f));
 
-        scene->mMaterials = new aiMaterial *[1];
-        scene->mMaterials[0] = nullptr;
-        scene->mNumMaterials = 1;
+        EdgeLookup edgeLookup;
+        edgeLookup.reserve(3 * triangleCount / 2 + 1);  // every edge of a closed mesh is shared by two triangles
 
-        scene->mMaterials[0] = new aiMaterial();
+        for(unsigned int i = 0; i < triangleCount; i++) {
+            const colorIndex color = mGeometry->getTriangleColor(i);
+            const glm::vec3 normal = mGeometry->getTriangleNormal(i);
+            colorsWithIndices[color].emplace_back(i);
 
-        scene->mMeshes = new aiMesh *[1];
-        scene->mMeshes[0] = nullptr;
-        scene->mNumMeshes = 1;
-
-        scene->mMeshes[0] = new aiMesh();
-        scene->mMeshes[0]->mMaterialIndex = 0;
+            for(unsigned int j = 0; j < 3; j++) {
+                const size_t vertex = indices[i][j];
+                const size_t nextVertex = indices[i][(j + 1) % 3];
 
-        scene->mRootNode->mMeshes = new unsigned int[1];
-        scene->mRootNode->mMeshes[0] = 0;
-        scene->mRootNode->mNumMeshes = 1;
+                summedVertexNormals[vertex] += normal;
 
-        auto pMesh = scene->mMeshes[0];
+                const bool isReversed = nextVertex < vertex;
+                EdgeSides &edgeSides =
+                    edgeLookup[isReversed ? EdgeKey(nextVertex, vertex) : EdgeKey(vertex, nextVertex)];
+                IndexedEdge &edge = edgeSides.sides[isReversed];
+                edge.color = color;
+                edge.tri = i;
+                edge.id1 = j;
+                edge.id2 = (j + 1) % 3;
+                edgeSides.isPresent[isReversed] = true;
+            }
+        }
 
-        size_t trianglesCount = triangleIndices.size();
+        normalizeSummedNormals(summedVertexNormals);
 
-        pMesh->mVertices = new aiVector3D[3 * trianglesCount];
-        pMesh->mNormals = new aiVector3D[3 * trianglesCount];
+        const std::vector<IndexedEdge> boundaryEdges = computeBoundaryEdges(edgeLookup, vertices, indices);
 
-        pMesh->mNumVertices = (unsigned int)(3 * trianglesCount);
+        processObjects(getColors(colorsWithIndices), [&](colorIndex color, TriangleSink &sink) {
+            const std::vector<IndexedEdge> soloBoundary = selectBoundaryEdgesByColor(boundaryEdges, color);
+            emitNonPolyObject(colorsWithIndices.at(color), summedVertexNormals, indices, soloBoundary,
+                              extrusionCoef[color], sink);
+        });
+    }
 
-        pMesh->mFaces = new aiFace[trianglesCount];
-        pMesh->mNumFaces = (unsigned int)(trianglesCount);
+    /// Join the vertices of all triangles by their position, the same way the importer does.
+    void weldVertices(std::vector<glm::vec3> &vertices, std::vector<std::array<size_t, 3>> &indices) const {
+        VertexWelder welder(mGeometry->getTriangleCount() / 2 + 3);
+        indices.resize(mGeometry->getTriangleCount());
+        for(size_t i = 0; i < indices.size(); i++) {
+            for(unsigned int j = 0; j < 3; j++) {
+                indices[i][j] = welder.addVertex(mGeometry->getTriangleVertex(i, j));
+            }
+        }
+        vertices = welder.takeVertices();
+    }
 
-        for(unsigned int i = 0; i < trianglesCount; i++) {
-            aiFace &face = pMesh->mFaces[i];
-            face.mIndices = new unsigned int[3];
-            face.mNumIndices = 3;
+    /// Normalize summed vertex normals
+    void normalizeSummedNormals(std::vector<glm::vec3> &summedVertexNormals) {
+        for(glm::vec3 &vertexNormal : summedVertexNormals) {
+            vertexNormal = glm::normalize(vertexNormal);
+        }
+    }
 
-            for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                pMesh->mVertices[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getVertex(j).x,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).y,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).z);
+    /// Decide if the edge is between two colors.
+    /// Returns the boundary edges ordered by the positions of their vertices, which keeps the exported files the same
+    /// as when the edges were looked up by their positions.
+    std::vector<IndexedEdge> computeBoundaryEdges(EdgeLookup &edgeLookup, const std::vector<glm::vec3> &vertices,
+                                                  const std::vector<std::array<size_t, 3>> &indices) {
+        std::vector<IndexedEdge> boundaryEdges;
+        for(auto &edge : edgeLookup) {
+            EdgeSides &edgeSides = edge.second;
+            if(edgeSides.isPresent[0] && edgeSides.isPresent[1] &&
+               edgeSides.sides[0].color != edgeSides.sides[1].color) {
+                for(IndexedEdge &side : edgeSides.sides) {
+                    side.isBoundary = true;
+                    boundaryEdges.emplace_back(side);
+                }
+            }
+        }
 
-                pMesh->mNormals[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getNormal().x,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().y,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().z);
+        const auto getPositions = [&vertices, &indices](const IndexedEdge &edge) {
+            const glm::vec3 &vertex1 = vertices[indices[edge.tri][edge.id1]];
+            const glm::vec3 &vertex2 = vertices[indices[edge.tri][edge.id2]];
+            return std::array<float, 6>{vertex1.x, vertex1.y, vertex1.z, vertex2.x, vertex2.y, vertex2.z};
+        };
+        std::sort(boundaryEdges.begin(), boundaryEdges.end(),
+                  [&getPositions](const IndexedEdge &a, const IndexedEdge &b) {
+                      return getPositions(a) < getPositions(b);
+                  });
+
+        return boundaryEdges;
+    }
 
-                face.mIndices[j] = 3 * i + j;
+    /// Returns a vector of IndexedEdge that were boundary and with the specified color.
+    std::vector<IndexedEdge> selectBoundaryEdgesByColor(const std::vector<IndexedEdge> &boundaryEdges,
+                                                        colorIndex color) {
+        std::vector<IndexedEdge> soloBoundary;
+        for(const IndexedEdge &edge : boundaryEdges) {
+            if(edge.color == color) {
+                soloBoundary.emplace_back(edge);
             }
         }
-        return scene;
+        return soloBoundary;
     }
 
-    std::unique_ptr<aiScene> createNewNonPolyScene(std::vector<unsigned int> &triangleIndices,
-                                                   std::map<std::array<float, 3>, glm::vec3> &vertexNormalLookup,
-                                                   std::vector<IndexedEdge> &borderEdges, float userCoef) {
-        size_t borderTriangleCount = 2 * borderEdges.size();
-
-        float extrusionCoef = glm::length(mGeometry->getBoundingBoxMax() - mGeometry->getBoundingBoxMin()) * userCoef;
-
-        std::unique_ptr<aiScene> scene = std::make_unique<aiScene>();
-        scene->mRootNode = new aiNode();
-
-        scene->mMaterials = new aiMaterial *[1];
-        scene->mMaterials[0] = nullptr;
-        scene->mNumMaterials = 1;
+    /// Prepares extruded objects with the need for a CGAL Polyhedron.
+    /// Optionally extrudes relative to SDF values.
+    void preparePolyObjects(bool withSDF, const std::vector<float> &extrusionCoef,
+                            const ProcessObjects &processObjects) {
+        const PolyhedronData::Mesh &mesh = *mGeometry->getMeshDetailed();
 
-        scene->mMaterials[0] = new aiMaterial();
+        std::map<colorIndex, std::vector<DetailedTriangleId>> colorsWithIndices;
 
-        scene->mMeshes = new aiMesh *[1];
-        scene->mMeshes[0] = nullptr;
-        scene->mNumMeshes = 1;
+        for(PolyhedronData::face_descriptor fd : mesh.faces()) {
+            colorIndex color = mGeometry->getTriangleColor(mGeometry->getMeshDetailedIdMap()[fd]);
+            colorsWithIndices[color].emplace_back(mGeometry->getMeshDetailedIdMap()[fd]);
+        }
 
-        scene->mMeshes[0] = new aiMesh();
-        scene->mMeshes[0]->mMaterialIndex = 0;
+        // Surface_mesh indices are dense, vertex and halfedge data are stored in plain arrays indexed by them
+        std::vector<glm::vec3> summedVertexNormals(mesh.num_vertices(), glm::vec3(0.f));
+        std::vector<float> vertexSDF(withSDF ? mesh.num_vertices() : 0, 0.0f);
 
-        scene->mRootNode->mMeshes = new unsigned int[1];
-        scene->mRootNode->mMeshes[0] = 0;
-        scene->mRootNode->mNumMeshes = 1;
+        // Color of the face of each halfedge between two colors or on a hole, sNoBorderColor for all other halfedges
+        std::vector<colorIndex> borderColors(mesh.num_halfedges(), sNoBorderColor);
 
-        auto pMesh = scene->mMeshes[0];
+        // Every range of vertices writes only the data of its vertices and of the halfedges pointing to them
+        const size_t rangeCount = std::max<size_t>(std::min(4 * mThreadPool.size(), mesh.num_vertices() / 1024), 1);
+        std::vector<size_t> rangeIndices(rangeCount);
+        std::iota(rangeIndices.begin(), rangeIndices.end(), 0);
 
-        size_t trianglesCount = triangleIndices.size();
+        mThreadPool.parallel_for(rangeIndices.begin(), rangeIndices.end(), [&](const size_t rangeIdx) {
+            std::vector<glm::vec3> vertexNormals;
+            std::vector<glm::vec3> distinctNormals;
 
-        pMesh->mVertices = new aiVector3D[3 * (trianglesCount * 2 + borderTriangleCount)];
-        pMesh->mNormals = new aiVector3D[3 * (trianglesCount * 2 + borderTriangleCount)];
+            const size_t endVertex = mesh.num_vertices() * (rangeIdx + 1) / rangeCount;
+            for(size_t vertexIdx = mesh.num_vertices() * rangeIdx / rangeCount; vertexIdx < endVertex; vertexIdx++) {
+                const PolyhedronData::vertex_descriptor vd(static_cast<PolyhedronData::Mesh::size_type>(vertexIdx));
+                if(mesh.is_removed(vd)) {
+                    continue;
+                }
 
-        pMesh->mNumVertices = (unsigned int)(3 * (trianglesCount * 2 + borderTriangleCount));
+                const size_t degree = mesh.degree(vd);
+                vertexNormals.clear();
 
-        pMesh->mFaces = new aiFace[trianglesCount * 2 + borderTriangleCount];
-        pMesh->mNumFaces = (unsigned int)(trianglesCount * 2 + borderTriangleCount);
+                auto halfedge = mesh.halfedge(vd);
 
-        for(unsigned int i = 0; i < trianglesCount; i++) {
-            aiFace &face = pMesh->mFaces[i];
-            face.mIndices = new unsigned int[3];
-            face.mNumIndices = 3;
+                for(size_t i = 0; i < degree; i++) {
+                    auto face = mesh.face(halfedge);
 
-            for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                pMesh->mVertices[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getVertex(j).x,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).y,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).z);
+                    if(face.is_valid()) {
+                        DetailedTriangleId triIndex = mGeometry->getMeshDetailedIdMap()[face];
 
-                pMesh->mNormals[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getNormal().x,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().y,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().z);
+                        if(withSDF) {
+                            vertexSDF[vertexIdx] += (float)mGeometry->getSdfValue(triIndex.getBaseId());
+                        }
 
-                face.mIndices[j] = 3 * i + j;
-            }
-        }
+                        vertexNormals.push_back(mGeometry->getTriangleNormal(triIndex));
 
-        for(unsigned int i = 0; i < trianglesCount; i++) {
-            aiFace &face = pMesh->mFaces[i + trianglesCount];
-            face.mIndices = new unsigned int[3];
-            face.mNumIndices = 3;
+                        colorIndex faceColor = mGeometry->getTriangleColor(triIndex);
 
-            for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                unsigned int jRevert = 2 - j;
+                        auto oppositeFace = mesh.face(mesh.opposite(halfedge));
 
-                glm::vec3 vertex = mGeometry->getTriangle(triangleIndices[i]).getVertex(j);
+                        if(oppositeFace.is_valid()) {
+                            DetailedTriangleId oppositeFaceIdx = mGeometry->getMeshDetailedIdMap()[oppositeFace];
+                            if(faceColor != mGeometry->getTriangleColor(oppositeFaceIdx)) {
+                                borderColors[halfedge.idx()] = faceColor;
+                            }
+                        } else {
+                            // halfedge is border edge (hole in the model), so it is also boundary edge
+                            borderColors[halfedge.idx()] = faceColor;
+                        }
+                    }
 
-                glm::vec3 vertexNormal = extrusionCoef * vertexNormalLookup[{vertex.x, vertex.y, vertex.z}];
+                    halfedge = mesh.next_around_target(halfedge);
+                }
 
-                pMesh->mVertices[3 * (i + trianglesCount) + j] =
-                    aiVector3D(vertex.x - vertexNormal.x, vertex.y - vertexNormal.y, vertex.z - vertexNormal.z);
+                // Normals epsilon-equal to an earlier normal of the vertex are summed only once. An exact copy of an
+                // earlier normal compares the same as that normal, so it is enough to compare the distinct ones.
+                float ep = glm::epsilon<float>();
+
+                distinctNormals.clear();
+                for(const glm::vec3 &normal : vertexNormals) {
+                    bool isEpsSameNormal = false;
+                    bool isSameNormal = false;
+                    for(const glm::vec3 &distinctNormal : distinctNormals) {
+                        if(distinctNormal == normal) {
+                            isSameNormal = true;
+                            break;
+                        }
+                        isEpsSameNormal |= glm::all(glm::epsilonEqual(normal, distinctNormal, ep));
+                    }
+                    if(isSameNormal) {
+                        continue;
+                    }
+                    distinctNormals.push_back(normal);
+                    if(!isEpsSameNormal) {
+                        summedVertexNormals[vertexIdx] += normal;
+                    }
+                }
 
-                pMesh->mNormals[3 * (i + trianglesCount) + j] =
-                    aiVector3D(-mGeometry->getTriangle(triangleIndices[i]).getNormal().x,
-                               -mGeometry->getTriangle(triangleIndices[i]).getNormal().y,
-                               -mGeometry->getTriangle(triangleIndices[i]).getNormal().z);
+                summedVertexNormals[vertexIdx] = glm::normalize(summedVertexNormals[vertexIdx]);
 
-                face.mIndices[jRevert] = (unsigned int)(3 * (i + trianglesCount) + j);
+                if(withSDF) {
+                    vertexSDF[vertexIdx] = vertexSDF[vertexIdx] / degree;  // average
+                }
             }
-        }
-
-        for(size_t i = 0; i < borderEdges.size(); i++) {
-            aiFace &face1 = pMesh->mFaces[(2 * trianglesCount) + (2 * i)];
-            face1.mIndices = new unsigned int[3];
-            face1.mNumIndices = 3;
-
-            aiFace &face2 = pMesh->mFaces[(2 * trianglesCount) + (2 * i + 1)];
-            face2.mIndices = new unsigned int[3];
-            face2.mNumIndices = 3;
-
-            glm::vec3 vertex1 = mGeometry->getTriangle(borderEdges[i].tri).getVertex(borderEdges[i].id1);
-            glm::vec3 vertex2 = mGeometry->getTriangle(borderEdges[i].tri).getVertex(borderEdges[i].id2);
+        });
 
-            glm::vec3 vertexNormal1 = extrusionCoef * vertexNormalLookup[{vertex1.x, vertex1.y, vertex1.z}];
-            glm::vec3 vertexNormal2 = extrusionCoef * vertexNormalLookup[{vertex2.x, vertex2.y, vertex2.z}];
-
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 0] = aiVector3D(vertex1.x, vertex1.y, vertex1.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 1] =
-                aiVector3D(vertex1.x - vertexNormal1.x, vertex1.y - vertexNormal1.y, vertex1.z - vertexNormal1.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 2] = aiVector3D(vertex2.x, vertex2.y, vertex2.z);
-
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 3] = aiVector3D(vertex2.x, vertex2.y, vertex2.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 4] =
-                aiVector3D(vertex1.x - vertexNormal1.x, vertex1.y - vertexNormal1.y, vertex1.z - vertexNormal1.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 5] =
-                aiVector3D(vertex2.x - vertexNormal2.x, vertex2.y - vertexNormal2.y, vertex2.z - vertexNormal2.z);
-
-            aiVector3D normal = calculateNormal({vertex2, vertex1, vertex1 - vertexNormal1});
+        float maxSdfValue = 0.0f;
+        for(const float sdf : vertexSDF) {
+            maxSdfValue = std::max(maxSdfValue, sdf);
+        }
 
-            for(size_t j = 0; j < 6; j++) {
-                pMesh->mNormals[3 * 2 * (trianglesCount + i) + j] = normal;
+        // Border edges of every color in the order of their halfedges. Colors without any border edges get an empty
+        // vector, the map must not change while the objects are emitted.
+        std::map<colorIndex, std::vector<PolyhedronData::halfedge_descriptor>> borderEdges;
+        for(auto &indexOfColor : colorsWithIndices) {
+            borderEdges[indexOfColor.first];
+        }
+        for(size_t halfedgeIdx = 0; halfedgeIdx < borderColors.size(); halfedgeIdx++) {
+            if(borderColors[halfedgeIdx] != sNoBorderColor) {
+                borderEdges.at(borderColors[halfedgeIdx])
+                    .emplace_back(static_cast<PolyhedronData::Mesh::size_type>(halfedgeIdx));
             }
-
-            face1.mIndices[0] = (unsigned int)(3 * 2 * (trianglesCount + i) + 0);
-            face1.mIndices[1] = (unsigned int)(3 * 2 * (trianglesCount + i) + 1);
-            face1.mIndices[2] = (unsigned int)(3 * 2 * (trianglesCount + i) + 2);
-
-            face2.mIndices[0] = (unsigned int)(3 * 2 * (trianglesCount + i) + 3);
-            face2.mIndices[1] = (unsigned int)(3 * 2 * (trianglesCount + i) + 4);
-            face2.mIndices[2] = (unsigned int)(3 * 2 * (trianglesCount + i) + 5);
         }
 
-        return scene;
+        processObjects(getColors(colorsWithIndices), [&](colorIndex color, TriangleSink &sink) {
+            emitPolyObject(colorsWithIndices.at(color), summedVertexNormals, borderEdges.at(color), vertexSDF,
+                           maxSdfValue, extrusionCoef[color], sink);
+        });
     }
 
-    std::unique_ptr<aiScene> createNewPolyScene(
-        std::vector<DetailedTriangleId> &triangleIndices,
-        std::unordered_map<PolyhedronData::vertex_descriptor, glm::vec3> &vertexNormals,
-        std::set<PolyhedronData::halfedge_descriptor> &borderEdges,
-        std::map<PolyhedronData::vertex_descriptor, float> &vertexSDF, float userCoef) {
-        size_t borderTriangleCount = 2 * borderEdges.size();
-
-        float extrusionCoef = glm::length(mGeometry->getBoundingBoxMax() - mGeometry->getBoundingBoxMin()) * userCoef;
-
-        bool withSDF = !vertexSDF.empty();
-
-        float maxSdfValue = 0.0f;
-        if(withSDF) {
-            for(auto &v : vertexSDF) {
-                if(v.second > maxSdfValue) {
-                    maxSdfValue = v.second;
-                }
-            }
+    /// Emits the triangles as they are, for the surface export and the top of the extrusions
+    template <typename TriangleId>
+    void emitSurfaceObject(const std::vector<TriangleId> &triangleIndices, TriangleSink &sink) {
+        for(const TriangleId triangleIdx : triangleIndices) {
+            const glm::vec3 normal = mGeometry->getTriangleNormal(triangleIdx);
+            sink.addTriangle({mGeometry->getTriangleVertex(triangleIdx, 0),
+                              mGeometry->getTriangleVertex(triangleIdx, 1),
+                              mGeometry->getTriangleVertex(triangleIdx, 2)},
+                             {normal, normal, normal});
         }
+    }
 
-        std::unique_ptr<aiScene> scene = std::make_unique<aiScene>();
-        scene->mRootNode = new aiNode();
-
-        scene->mMaterials = new aiMaterial *[1];
-        scene->mMaterials[0] = nullptr;
-        scene->mNumMaterials = 1;
-
-        scene->mMaterials[0] = new aiMaterial();
-
-        scene->mMeshes = new aiMesh *[1];
-        scene->mMeshes[0] = nullptr;
-        scene->mNumMeshes = 1;
-
-        scene->mMeshes[0] = new aiMesh();
-        scene->mMeshes[0]->mMaterialIndex = 0;
-
-        scene->mRootNode->mMeshes = new unsigned int[1];
-        scene->mRootNode->mMeshes[0] = 0;
-        scene->mRootNode->mNumMeshes = 1;
+    /// Emits the sides of the extrusion, two triangles joining every border edge with its extruded copy
+    void emitBorderEdge(const glm::vec3 &vertex1, const glm::vec3 &vertex2, const glm::vec3 &offset1,
+                        const glm::vec3 &offset2, float extrusionDepth, TriangleSink &sink) {
+        const glm::vec3 extrudedVertex1 = vertex1 - extrusionDepth * offset1;
 
-        auto pMesh = scene->mMeshes[0];
+        const glm::vec3 normal = calculateNormal({vertex2, vertex1, extrudedVertex1});
+        const glm::vec3 noOffset(0.0f);
 
-        size_t trianglesCount = triangleIndices.size();
+        sink.addExtrudedTriangle({vertex1, vertex1, vertex2}, {noOffset, offset1, noOffset}, extrusionDepth,
+                                 {normal, normal, normal});
+        sink.addExtrudedTriangle({vertex2, vertex1, vertex2}, {noOffset, offset1, offset2}, extrusionDepth,
+                                 {normal, normal, normal});
+    }
 
-        pMesh->mVertices = new aiVector3D[3 * (trianglesCount * 2 + borderTriangleCount)];
-        pMesh->mNormals = new aiVector3D[3 * (trianglesCount * 2 + borderTriangleCount)];
+    void emitNonPolyObject(const std::vector<unsigned int> &triangleIndices,
+                           const std::vector<glm::vec3> &vertexNormals,
+                           const std::vector<std::array<size_t, 3>> &vertexIndices,
+                           const std::vector<IndexedEdge> &borderEdges, float userCoef, TriangleSink &sink) {
+        const float extrusionDepth = getExtrusionDepth(userCoef);
+
+        emitSurfaceObject(triangleIndices, sink);
+
+        // Extruded copy of the surface, facing the other way
+        for(const unsigned int triangleIdx : triangleIndices) {
+            const std::array<size_t, 3> &indices = vertexIndices[triangleIdx];
+
+            const glm::vec3 normal = -mGeometry->getTriangleNormal(triangleIdx);
+            sink.addReversedExtrudedTriangle({mGeometry->getTriangleVertex(triangleIdx, 0),
+                                              mGeometry->getTriangleVertex(triangleIdx, 1),
+                                              mGeometry->getTriangleVertex(triangleIdx, 2)},
+                                             {vertexNormals[indices[0]], vertexNormals[indices[1]],
+                                              vertexNormals[indices[2]]},
+                                             extrusionDepth, {normal, normal, normal});
+        }
 
-        pMesh->mNumVertices = (unsigned int)(3 * (trianglesCount * 2 + borderTriangleCount));
+        for(const IndexedEdge &edge : borderEdges) {
+            const std::array<size_t, 3> &edgeTriangle = vertexIndices[edge.tri];
 
-        pMesh->mFaces = new aiFace[trianglesCount * 2 + borderTriangleCount];
-        pMesh->mNumFaces = (unsigned int)(trianglesCount * 2 + borderTriangleCount);
+            emitBorderEdge(mGeometry->getTriangleVertex(edge.tri, edge.id1),
+                           mGeometry->getTriangleVertex(edge.tri, edge.id2),
+                           vertexNormals[edgeTriangle[edge.id1]], vertexNormals[edgeTriangle[edge.id2]],
+                           extrusionDepth, sink);
+        }
+    }
 
-        for(unsigned int i = 0; i < trianglesCount; i++) {
-            aiFace &face = pMesh->mFaces[i];
-            face.mIndices = new unsigned int[3];
-            face.mNumIndices = 3;
+    void emitPolyObject(const std::vector<DetailedTriangleId> &triangleIndices,
+                        const std::vector<glm::vec3> &vertexNormals,
+                        const std::vector<PolyhedronData::halfedge_descriptor> &borderEdges,
+                        const std::vector<float> &vertexSDF, float maxSdfValue, float userCoef, TriangleSink &sink) {
+        const float extrusionDepth = getExtrusionDepth(userCoef);
 
-            for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                pMesh->mVertices[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getVertex(j).x,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).y,
-                                                         mGeometry->getTriangle(triangleIndices[i]).getVertex(j).z);
+        bool withSDF = !vertexSDF.empty();
 
-                pMesh->mNormals[3 * i + j] = aiVector3D(mGeometry->getTriangle(triangleIndices[i]).getNormal().x,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().y,
-                                                        mGeometry->getTriangle(triangleIndices[i]).getNormal().z);
+        const PolyhedronData::Mesh &mesh = *mGeometry->getMeshDetailed();
 
-                face.mIndices[j] = 3 * i + j;
+        // Direction of the extrusion of the vertex, shared by all triangles around it
+        const auto getOffset = [&](PolyhedronData::vertex_descriptor polyVertex) {
+            glm::vec3 offset = vertexNormals[polyVertex.idx()];
+            if(withSDF) {
+                offset *= vertexSDF[polyVertex.idx()] / maxSdfValue;
             }
-        }
+            return offset;
+        };
 
-        auto &detailedFaceDescs = mGeometry->getMeshDetailedFaceDescs();
+        const auto getPosition = [&mesh](PolyhedronData::vertex_descriptor polyVertex) {
+            auto &p = mesh.point(polyVertex);
+            return glm::vec3(p.x(), p.y(), p.z());
+        };
 
-        for(unsigned int i = 0; i < trianglesCount; i++) {
-            aiFace &face = pMesh->mFaces[i + trianglesCount];
-            face.mIndices = new unsigned int[3];
-            face.mNumIndices = 3;
+        emitSurfaceObject(triangleIndices, sink);
 
-            const auto polyFaceIterator = detailedFaceDescs.find(triangleIndices[i]);
+        // Extruded copy of the surface, facing the other way
+        auto &detailedFaceDescs = mGeometry->getMeshDetailedFaceDescs();
+        for(const DetailedTriangleId triangleIdx : triangleIndices) {
+            const auto polyFaceIterator = detailedFaceDescs.find(triangleIdx);
             P_ASSERT(polyFaceIterator != detailedFaceDescs.cend());
             const PolyhedronData::face_descriptor polyFace = polyFaceIterator->second;
 
-            const auto halfedge = mGeometry->getMeshDetailed()->halfedge(polyFace);
+            const auto halfedge = mesh.halfedge(polyFace);
             auto itHalfedge = halfedge;
 
-            for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                unsigned int jRevert = 2 - j;
-
-                auto polyVertex = mGeometry->getMeshDetailed()->target(itHalfedge);
-
-                auto &p = mGeometry->getMeshDetailed()->point(polyVertex);
-                glm::vec3 vertex(p.x(), p.y(), p.z());
-                glm::vec3 vertexNormal = extrusionCoef * vertexNormals[polyVertex];
-
-                if(withSDF) {
-                    vertexNormal *= vertexSDF[polyVertex] / maxSdfValue;
-                }
-
-                pMesh->mVertices[3 * (i + trianglesCount) + j] =
-                    aiVector3D(vertex.x - vertexNormal.x, vertex.y - vertexNormal.y, vertex.z - vertexNormal.z);
-
-                pMesh->mNormals[3 * (i + trianglesCount) + j] =
-                    aiVector3D(-mGeometry->getTriangle(triangleIndices[i]).getNormal().x,
-                               -mGeometry->getTriangle(triangleIndices[i]).getNormal().y,
-                               -mGeometry->getTriangle(triangleIndices[i]).getNormal().z);
-
-                face.mIndices[jRevert] = (unsigned int)(3 * (i + trianglesCount) + j);
-
-                itHalfedge = mGeometry->getMeshDetailed()->next(itHalfedge);
+            std::array<glm::vec3, 3> vertices;
+            std::array<glm::vec3, 3> offsets;
+            for(unsigned int j = 0; j < 3; j++) {
+                auto polyVertex = mesh.target(itHalfedge);
+                vertices[j] = getPosition(polyVertex);
+                offsets[j] = getOffset(polyVertex);
+                itHalfedge = mesh.next(itHalfedge);
             }
             P_ASSERT(halfedge == itHalfedge);
+
+            const glm::vec3 normal = -mGeometry->getTriangleNormal(triangleIdx);
+            sink.addReversedExtrudedTriangle(vertices, offsets, extrusionDepth, {normal, normal, normal});
         }
 
-        size_t i = 0;
         for(auto &edge : borderEdges) {
-            aiFace &face1 = pMesh->mFaces[(2 * trianglesCount) + (2 * i)];
-            face1.mIndices = new unsigned int[3];
-            face1.mNumIndices = 3;
+            auto polyVertex1 = mesh.source(edge);
+            auto polyVertex2 = mesh.target(edge);
 
-            aiFace &face2 = pMesh->mFaces[(2 * trianglesCount) + (2 * i + 1)];
-            face2.mIndices = new unsigned int[3];
-            face2.mNumIndices = 3;
-
-            auto polyVertex1 = mGeometry->getMeshDetailed()->source(edge);
-            auto polyVertex2 = mGeometry->getMeshDetailed()->target(edge);
-
-            auto &p1 = mGeometry->getMeshDetailed()->point(polyVertex1);
-            auto &p2 = mGeometry->getMeshDetailed()->point(polyVertex2);
-
-            glm::vec3 vertex1(p1.x(), p1.y(), p1.z());
-            glm::vec3 vertex2(p2.x(), p2.y(), p2.z());
-
-            glm::vec3 vertexNormal1 = extrusionCoef * vertexNormals[polyVertex1];
-            glm::vec3 vertexNormal2 = extrusionCoef * vertexNormals[polyVertex2];
-
-            if(!vertexSDF.empty()) {
-                vertexNormal1 *= vertexSDF[polyVertex1] / maxSdfValue;
-                vertexNormal2 *= vertexSDF[polyVertex2] / maxSdfValue;
-            }
-
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 0] = aiVector3D(vertex1.x, vertex1.y, vertex1.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 1] =
-                aiVector3D(vertex1.x - vertexNormal1.x, vertex1.y - vertexNormal1.y, vertex1.z - vertexNormal1.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 2] = aiVector3D(vertex2.x, vertex2.y, vertex2.z);
-
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 3] = aiVector3D(vertex2.x, vertex2.y, vertex2.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 4] =
-                aiVector3D(vertex1.x - vertexNormal1.x, vertex1.y - vertexNormal1.y, vertex1.z - vertexNormal1.z);
-            pMesh->mVertices[3 * 2 * (trianglesCount + i) + 5] =
-                aiVector3D(vertex2.x - vertexNormal2.x, vertex2.y - vertexNormal2.y, vertex2.z - vertexNormal2.z);
-
-            aiVector3D normal = calculateNormal({vertex2, vertex1, vertex1 - vertexNormal1});
-
-            for(size_t j = 0; j < 6; j++) {
-                pMesh->mNormals[3 * 2 * (trianglesCount + i) + j] = normal;
-            }
-
-            face1.mIndices[0] = (unsigned int)(3 * 2 * (trianglesCount + i) + 0);
-            face1.mIndices[1] = (unsigned int)(3 * 2 * (trianglesCount + i) + 1);
-            face1.mIndices[2] = (unsigned int)(3 * 2 * (trianglesCount + i) + 2);
-
-            face2.mIndices[0] = (unsigned int)(3 * 2 * (trianglesCount + i) + 3);
-            face2.mIndices[1] = (unsigned int)(3 * 2 * (trianglesCount + i) + 4);
-            face2.mIndices[2] = (unsigned int)(3 * 2 * (trianglesCount + i) + 5);
-
-            i++;
+            emitBorderEdge(getPosition(polyVertex1), getPosition(polyVertex2), getOffset(polyVertex1),
+                           getOffset(polyVertex2), extrusionDepth, sink);
         }
-
-        return scene;
     }
 
     /// Returns a normal vector of a triangle.
-    static aiVector3D calculateNormal(const std::array<glm::vec3, 3> vertices) {
+    static glm::vec3 calculateNormal(const std::array<glm::vec3, 3> vertices) {
         const glm::vec3 p0 = vertices[1] - vertices[0];
         const glm::vec3 p1 = vertices[2] - vertices[0];
-        const glm::vec3 faceNormal = glm::normalize(glm::cross(p0, p1));
-
-        return aiVector3D(faceNormal.x, faceNormal.y, faceNormal.z);
+        return glm::normalize(glm::cross(p0, p1));
     }
 };
 
-}  // namespace pepr3d
\ No newline at end of file
+}  // namespace pepr3d
@@ -0,0 +1,331 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/Geometry.h"
+#include "geometry/ModelExporter.h"
+#include "ui/MainApplication.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace pepr3d {
+
+/// Surface of a cube centered at the origin, every side split into n x n quads, with randomly colored triangles.
+/// @param withJoinedVertices whether the geometry gets the joined vertices and indices, otherwise the exporter has to
+/// join them itself. Without them, zero coordinates of every other triangle are stored as -0.0.
+Geometry getColoredCube(const size_t n, const size_t colorCount, const bool withJoinedVertices) {
+    std::vector<DataTriangle> triangles;
+    std::vector<glm::vec3> vertices;
+    std::vector<std::array<size_t, 3>> indices;
+    std::map<std::array<float, 3>, size_t> vertexLookup;
+
+    std::mt19937 generator(5);
+    std::uniform_int_distribution<size_t> colorDistribution(0, colorCount - 1);
+
+    const auto addVertex = [&](const glm::vec3& position) {
+        const auto inserted = vertexLookup.emplace(std::array<float, 3>{position.x, position.y, position.z},
+                                                   vertices.size());
+        if(inserted.second) {
+            vertices.push_back(position);
+        }
+        return inserted.first->second;
+    };
+
+    const float step = 2.f / static_cast<float>(n);
+    for(int axis = 0; axis < 3; ++axis) {
+        for(const float side : {-1.f, 1.f}) {
+            const auto getPosition = [&](size_t i, size_t j) {
+                glm::vec3 position;
+                position[axis] = side;
+                position[(axis + 1) % 3] = -1.f + i * step;
+                position[(axis + 2) % 3] = -1.f + j * step;
+                return position;
+            };
+            glm::vec3 normal(0.f);
+            normal[axis] = side;
+
+            for(size_t i = 0; i < n; ++i) {
+                for(size_t j = 0; j < n; ++j) {
+                    std::array<std::array<glm::vec3, 3>, 2> quad = {
+                        {{getPosition(i, j), getPosition(i + 1, j), getPosition(i + 1, j + 1)},
+                         {getPosition(i, j), getPosition(i + 1, j + 1), getPosition(i, j + 1)}}};
+                    for(auto& triangle : quad) {
+                        if(side < 0) {
+                            std::swap(triangle[1], triangle[2]);
+                        }
+                        std::array<size_t, 3> triangleIndices;
+                        for(size_t k = 0; k < 3; ++k) {
+                            triangleIndices[k] = addVertex(triangle[k]);
+                            if(!withJoinedVertices && triangles.size() % 2 == 1) {
+                                for(int c = 0; c < 3; ++c) {
+                                    if(triangle[k][c] == 0.f) {
+                                        triangle[k][c] = -0.f;
+                                    }
+                                }
+                            }
+                        }
+                        triangles.emplace_back(triangle[0], triangle[1], triangle[2], normal,
+                                               colorDistribution(generator));
+                        indices.push_back(triangleIndices);
+                    }
+                }
+            }
+        }
+    }
+
+    if(withJoinedVertices) {
+        return Geometry(std::move(triangles), std::move(vertices), std::move(indices));
+    }
+    return Geometry(std::move(triangles));
+}
+
+/// Data of the extruded scene of a single color
+struct ExtrudedScene {
+    std::vector<aiVector3D> vertices;
+    std::vector<aiVector3D> normals;
+    std::vector<std::array<unsigned int, 3>> faces;
+};
+
+/// Extruded scenes computed the way ModelExporter did before it used the joined vertices, looking up the vertex normals
+/// and edges by the positions of the vertices
+std::map<size_t, ExtrudedScene> getReferenceNonPolyScenes(const Geometry& geometry,
+                                                          const std::vector<float>& extrusionCoef) {
+    struct PositionEdge {
+        unsigned int tri;
+        unsigned int id1;
+        unsigned int id2;
+        size_t color;
+        bool isBoundary = false;
+    };
+
+    using Position = std::array<float, 3>;
+    const auto toPosition = [](const glm::vec3& v) { return Position{v.x, v.y, v.z}; };
+
+    std::map<size_t, std::vector<unsigned int>> colorsWithIndices;
+    std::map<Position, glm::vec3> summedVertexNormals;
+    std::map<std::array<Position, 2>, PositionEdge> edgeLookup;
+
+    for(unsigned int i = 0; i < geometry.getTriangleCount(); i++) {
+        const DataTriangle triangle = geometry.getTriangle(i);
+        colorsWithIndices[triangle.getColor()].emplace_back(i);
+        for(unsigned int j = 0; j < 3; j++) {
+            const Position vertex = toPosition(triangle.getVertex(j));
+            summedVertexNormals[vertex] += triangle.getNormal();
+
+            PositionEdge& edge = edgeLookup[{vertex, toPosition(triangle.getVertex((j + 1) % 3))}];
+            edge.color = triangle.getColor();
+            edge.tri = i;
+            edge.id1 = j;
+            edge.id2 = (j + 1) % 3;
+        }
+    }
+
+    for(auto& vertexNormal : summedVertexNormals) {
+        vertexNormal.second = glm::normalize(vertexNormal.second);
+    }
+
+    for(auto& edge : edgeLookup) {
+        const auto opposite = edgeLookup.find({edge.first[1], edge.first[0]});
+        if(opposite != edgeLookup.end() && !edge.second.isBoundary && opposite->second.color != edge.second.color) {
+            opposite->second.isBoundary = true;
+            edge.second.isBoundary = true;
+        }
+    }
+
+    const float boxSize = glm::length(geometry.getBoundingBoxMax() - geometry.getBoundingBoxMin());
+    const auto toAi = [](const glm::vec3& v) { return aiVector3D(v.x, v.y, v.z); };
+
+    std::map<size_t, ExtrudedScene> scenes;
+    for(const auto& indexOfColor : colorsWithIndices) {
+        const float coef = boxSize * extrusionCoef[indexOfColor.first];
+        const std::vector<unsigned int>& triangleIndices = indexOfColor.second;
+        const unsigned int trianglesCount = static_cast<unsigned int>(triangleIndices.size());
+        ExtrudedScene& scene = scenes[indexOfColor.first];
+
+        for(unsigned int i = 0; i < trianglesCount; i++) {
+            const DataTriangle triangle = geometry.getTriangle(triangleIndices[i]);
+            for(unsigned int j = 0; j < 3; j++) {
+                scene.vertices.push_back(toAi(triangle.getVertex(j)));
+                scene.normals.push_back(toAi(triangle.getNormal()));
+            }
+            scene.faces.push_back({3 * i, 3 * i + 1, 3 * i + 2});
+        }
+
+        for(unsigned int i = 0; i < trianglesCount; i++) {
+            const DataTriangle triangle = geometry.getTriangle(triangleIndices[i]);
+            for(unsigned int j = 0; j < 3; j++) {
+                const glm::vec3 vertex = triangle.getVertex(j);
+                const glm::vec3 vertexNormal = coef * summedVertexNormals[toPosition(vertex)];
+                scene.vertices.push_back(
+                    aiVector3D(vertex.x - vertexNormal.x, vertex.y - vertexNormal.y, vertex.z - vertexNormal.z));
+                scene.normals.push_back(
+                    aiVector3D(-triangle.getNormal().x, -triangle.getNormal().y, -triangle.getNormal().z));
+            }
+            const unsigned int first = 3 * (i + trianglesCount);
+            scene.faces.push_back({first + 2, first + 1, first});
+        }
+
+        for(const auto& edge : edgeLookup) {
+            if(edge.second.color != indexOfColor.first || !edge.second.isBoundary) {
+                continue;
+            }
+            const DataTriangle triangle = geometry.getTriangle(edge.second.tri);
+            const glm::vec3 vertex1 = triangle.getVertex(edge.second.id1);
+            const glm::vec3 vertex2 = triangle.getVertex(edge.second.id2);
+            const glm::vec3 extruded1 = vertex1 - coef * summedVertexNormals[toPosition(vertex1)];
+            const glm::vec3 extruded2 = vertex2 - coef * summedVertexNormals[toPosition(vertex2)];
+
+            const unsigned int first = static_cast<unsigned int>(scene.vertices.size());
+            for(const glm::vec3& vertex : {vertex1, extruded1, vertex2, vertex2, extruded1, extruded2}) {
+                scene.vertices.push_back(toAi(vertex));
+            }
+            const glm::vec3 normal = glm::normalize(glm::cross(vertex1 - vertex2, extruded1 - vertex2));
+            scene.normals.insert(scene.normals.end(), 6, toAi(normal));
+            scene.faces.push_back({first, first + 1, first + 2});
+            scene.faces.push_back({first + 3, first + 4, first + 5});
+        }
+    }
+    return scenes;
+}
+
+void expectSameNonPolyScenes(const Geometry& geometry) {
+    const std::vector<float> extrusionCoef = {0.1f, 0.25f, 0.05f};
+
+    ModelExporter exporter(&geometry, nullptr, MainApplication::getThreadPool());
+    exporter.setExtrusionCoef(extrusionCoef);
+    const auto scenes = exporter.createScenes(ExportType::NonPolyExtrusion);
+    const auto expectedScenes = getReferenceNonPolyScenes(geometry, extrusionCoef);
+
+    ASSERT_EQ(scenes.size(), expectedScenes.size());
+    for(const auto& expectedScene : expectedScenes) {
+        const auto sceneIt = scenes.find(expectedScene.first);
+        ASSERT_NE(sceneIt, scenes.end());
+        const aiMesh* mesh = sceneIt->second->mMeshes[0];
+        const ExtrudedScene& expected = expectedScene.second;
+
+        // The exported files have to stay the same, so the data are compared bit by bit
+        ASSERT_EQ(mesh->mNumVertices, expected.vertices.size());
+        EXPECT_EQ(std::memcmp(mesh->mVertices, expected.vertices.data(), sizeof(aiVector3D) * mesh->mNumVertices), 0);
+        EXPECT_EQ(std::memcmp(mesh->mNormals, expected.normals.data(), sizeof(aiVector3D) * mesh->mNumVertices), 0);
+
+        ASSERT_EQ(mesh->mNumFaces, expected.faces.size());
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++) {
+            ASSERT_EQ(mesh->mFaces[i].mNumIndices, 3);
+            for(unsigned int j = 0; j < 3; j++) {
+                EXPECT_EQ(mesh->mFaces[i].mIndices[j], expected.faces[i][j]);
+            }
+        }
+    }
+}
+
+TEST(ModelExporter, nonPolyExtrusionMatchesPositionLookup) {
+    /**
+     * Test that the extrusion exported with the joined vertices is the same as with vertices looked up by position
+     */
+
+    expectSameNonPolyScenes(getColoredCube(8, 3, true));
+}
+
+TEST(ModelExporter, nonPolyExtrusionWithoutJoinedVertices) {
+    /**
+     * Test that the exporter joins the vertices itself when the geometry has none, joining -0.0 and 0.0 as well
+     */
+
+    expectSameNonPolyScenes(getColoredCube(8, 3, false));
+}
+
+TEST(ModelExporter, extrusionPreviewMatchesScenes) {
+    /**
+     * Test that the previews extruded to the depths of the coefficients are the same as the exported scenes
+     */
+
+    const Geometry geometry = getColoredCube(4, 3, true);
+    const std::vector<float> extrusionCoef = {0.1f, 0.0f, 0.05f};
+
+    ModelExporter exporter(&geometry, nullptr, MainApplication::getThreadPool());
+    exporter.setExtrusionCoef(extrusionCoef);
+    const auto scenes = exporter.createScenes(ExportType::NonPolyExtrusion);
+    const auto previews = exporter.createExtrusionPreviews(ExportType::NonPolyExtrusion);
+
+    ASSERT_EQ(previews.size(), scenes.size());
+    for(const auto& scene : scenes) {
+        const auto previewIt = previews.find(scene.first);
+        ASSERT_NE(previewIt, previews.end());
+        const aiMesh* mesh = scene.second->mMeshes[0];
+        const ModelExporter::ExtrusionPreview& preview = previewIt->second;
+        ASSERT_EQ(preview.vertices.size(), mesh->mNumVertices);
+        ASSERT_EQ(preview.normals.size(), mesh->mNumVertices);
+
+        std::vector<glm::vec3> vertices(preview.vertices.size());
+        preview.extrude(exporter.getExtrusionDepth(extrusionCoef[scene.first]), vertices.data());
+        for(size_t i = 0; i < vertices.size(); i++) {
+            EXPECT_EQ(vertices[i].x, mesh->mVertices[i].x);
+            EXPECT_EQ(vertices[i].y, mesh->mVertices[i].y);
+            EXPECT_EQ(vertices[i].z, mesh->mVertices[i].z);
+
+            // The preview keeps the normals of the sides even where the color is not extruded at all
+            if(extrusionCoef[scene.first] > 0.0f) {
+                EXPECT_NEAR(preview.normals[i].x, mesh->mNormals[i].x, 1e-5f);
+                EXPECT_NEAR(preview.normals[i].y, mesh->mNormals[i].y, 1e-5f);
+                EXPECT_NEAR(preview.normals[i].z, mesh->mNormals[i].z, 1e-5f);
+            } else {
+                EXPECT_FALSE(std::isnan(preview.normals[i].x));
+            }
+        }
+
+        ASSERT_EQ(preview.indices.size(), 3 * mesh->mNumFaces);
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++) {
+            for(unsigned int j = 0; j < 3; j++) {
+                EXPECT_EQ(preview.indices[3 * i + j], mesh->mFaces[i].mIndices[j]);
+            }
+        }
+    }
+}
+
+TEST(ModelExporter, failedFilesDoNotStopTheOthers) {
+    /**
+     * Test that every file is attempted when some of them cannot be written, and the error is reported afterwards
+     */
+
+    const Geometry geometry = getColoredCube(4, 3, true);
+    GeometryProgress progress;
+    ModelExporter exporter(&geometry, &progress, MainApplication::getThreadPool());
+
+    EXPECT_THROW(exporter.saveModel("modelExporterMissingDirectory", "cube", "stl", ExportType::NonPolySurface),
+                 std::runtime_error);
+
+    // All files were processed before the first error was rethrown
+    EXPECT_EQ(progress.createScenePercentage, 1.0f);
+    EXPECT_EQ(progress.exportFilePercentage, 1.0f);
+}
+
+TEST(ModelExporter, DISABLED_benchmarkPolyExtrusion) {
+    /**
+     * Create the extruded scenes of a randomly colored cube of 120k triangles from its detailed mesh
+     */
+
+    Geometry geometry = getColoredCube(100, 3, true);
+    geometry.updateTemporaryDetailedData();
+    ASSERT_TRUE(geometry.isTemporaryDetailedDataValid());
+
+    ModelExporter exporter(&geometry, nullptr, MainApplication::getThreadPool());
+    exporter.setExtrusionCoef({0.1f, 0.25f, 0.05f});
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    const auto scenes = exporter.createScenes(ExportType::PolyExtrusion);
+    const auto end = std::chrono::high_resolution_clock::now();
+    ASSERT_EQ(scenes.size(), 3);
+
+    std::cout << "Extruding " << geometry.getMeshDetailed()->number_of_faces() << " faces took: "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+}
+
+}  // namespace pepr3d
+#endif
@@ -16,17 +16,20 @@
 #include "ThreadPool.h"
 
 #include "geometry/AssimpProgress.h"
+#include "geometry/BinaryStlReader.h"
 #include "geometry/ColorManager.h"
 #include "geometry/GeometryProgress.h"
 #include "geometry/Triangle.h"
+#include "geometry/TriangleStore.h"
+#include "geometry/VertexWelder.h"
 #include "peprassert.h"
 
 namespace pepr3d {
 
-/// Imports triangles and color palette from a model via Assimp
+/// Imports triangles and color palette from a model, binary STL files natively and other formats via Assimp
 class ModelImporter {
     std::string mPath;
-    std::vector<DataTriangle> mTriangles;
+    TriangleStore mTriangles;
 
     ColorManager mPalette;
     bool mModelLoaded = false;
@@ -37,16 +40,26 @@ class ModelImporter {
     GeometryProgress *mProgress;
 
    public:
+    /// Everything imported from the model, the i-th index triple belongs to the i-th triangle
+    struct Result {
+        TriangleStore triangles;
+        std::vector<glm::vec3> vertexBuffer;
+        std::vector<std::array<size_t, 3>> indexBuffer;
+        ColorManager palette;
+    };
+
     ModelImporter(const std::string p, GeometryProgress *progress, ::ThreadPool &threadPool)
         : mPath(p), mProgress(progress) {
-        auto loadedModel = threadPool.enqueue([this]() { return loadModel(this->mPath); });
-        bool loadedModelWithJoinedVertices = loadModelWithJoinedVertices(this->mPath);
-        this->mModelLoaded = loadedModel.get() & loadedModelWithJoinedVertices;
+        if(BinaryStlReader::isBinaryStl(mPath)) {
+            this->mModelLoaded = loadBinaryStl(this->mPath, threadPool);
+        } else {
+            this->mModelLoaded = loadModel(this->mPath, threadPool);
+        }
         P_ASSERT(mTriangles.size() == mIndexBuffer.size());
     }
 
-    /// Returns a vector of all DataTriangle of the imported mesh.
-    std::vector<DataTriangle> getTriangles() const {
+    /// Returns all triangles of the imported mesh.
+    const TriangleStore& getTriangles() const {
         return mTriangles;
     }
 
@@ -56,24 +69,31 @@ class ModelImporter {
         return mPalette;
     }
 
+    /// Moves the imported mesh out of the importer without copying it, the importer is left empty.
+    Result takeResult() && {
+        P_ASSERT(mModelLoaded);
+        P_ASSERT(!mPalette.empty());
+        mModelLoaded = false;
+        return Result{std::move(mTriangles), std::move(mVertexBuffer), std::move(mIndexBuffer), std::move(mPalette)};
+    }
+
     /// Returns true if the mesh was imported successfully.
     bool isModelLoaded() {
         return mModelLoaded;
     }
 
     /// Returns a vertex buffer of the imported mesh.
-    std::vector<glm::vec3> getVertexBuffer() const {
+    const std::vector<glm::vec3>& getVertexBuffer() const {
         P_ASSERT(!mVertexBuffer.empty());
         return mVertexBuffer;
     }
 
     /// Returns an index buffer of the imported mesh.
-    std::vector<std::array<size_t, 3>> getIndexBuffer() const {
+    const std::vector<std::array<size_t, 3>>& getIndexBuffer() const {
         P_ASSERT(!mIndexBuffer.empty());
         return mIndexBuffer;
     }
 
-   private:
     /// Returns true if the given triangle has a zero area either due to rounding or vertices
     static bool zeroAreaCheck(const std::array<glm::vec3, 3> &triangle, const double Eps = 0.000001) {
         /// Check for degenerate triangles which we do not want in the representation
@@ -88,91 +108,59 @@ class ModelImporter {
         }
     }
 
-    /// Pull the correct Vertex buffer (correct as in vertices are re-used for multiple triangles) from the mesh
-    static std::vector<glm::vec3> calculateVertexBuffer(aiMesh *mesh) {
-        std::vector<glm::vec3> vertices;
-        vertices.reserve(mesh->mNumVertices);
-        for(size_t i = 0; i < mesh->mNumVertices; i++) {
-            vertices.emplace_back(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        }
-        P_ASSERT(vertices.size() == mesh->mNumVertices);
-        return vertices;
-    }
+   private:
+    /// How many faces are processed between two progress updates
+    static const unsigned int sProgressUpdateFaces = 1 << 16;
 
-    /// Pull the correct index buffer (correct as in different than 0-N) from the mesh
-    static std::vector<std::array<size_t, 3>> calculateIndexBuffer(aiMesh *mesh) {
-        std::vector<std::array<size_t, 3>> indices;
-        indices.reserve(mesh->mNumFaces);
+    /// Weld vertices of the mesh by their position, filling mVertexBuffer and mIndexBuffer.
+    /// Faces are skipped the same way as in processFirstMesh, so that the i-th index triple matches the i-th triangle.
+    void weldVertices(const aiMesh *mesh) {
+        // Meshes from STL files have 3 vertices for every face, a closed mesh has about half as many unique vertices
+        VertexWelder welder(mesh->mNumFaces / 2 + 3);
+        mIndexBuffer.clear();
+        mIndexBuffer.reserve(mesh->mNumFaces);
 
         for(unsigned int i = 0; i < mesh->mNumFaces; i++) {
-            P_ASSERT(mesh->mFaces[i].mNumIndices == 3);
+            const aiFace &face = mesh->mFaces[i];
+            P_ASSERT(face.mNumIndices == 3);
 
             std::array<glm::vec3, 3> triangle;
-
-            for(unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++) {
-                triangle[j].x = mesh->mVertices[mesh->mFaces[i].mIndices[j]].x;
-                triangle[j].y = mesh->mVertices[mesh->mFaces[i].mIndices[j]].y;
-                triangle[j].z = mesh->mVertices[mesh->mFaces[i].mIndices[j]].z;
+            for(unsigned int j = 0; j < 3; j++) {
+                const aiVector3D &vertex = mesh->mVertices[face.mIndices[j]];
+                triangle[j] = glm::vec3(vertex.x, vertex.y, vertex.z);
             }
 
             /// Check for degenerate triangles which we do not want in the representation
-            const bool isZeroArea = zeroAreaCheck(triangle);
-            if(!isZeroArea) {
-                indices.push_back(
-                    {mesh->mFaces[i].mIndices[0], mesh->mFaces[i].mIndices[1], mesh->mFaces[i].mIndices[2]});
-            } else {
-                CI_LOG_W("Imported a triangle with zero surface area. Ommiting it from index buffer.");
+            if(!zeroAreaCheck(triangle)) {
+                mIndexBuffer.push_back(
+                    {welder.addVertex(triangle[0]), welder.addVertex(triangle[1]), welder.addVertex(triangle[2])});
             }
-        }
-
-        return indices;
-    }
-
-    /// A method which loads the model with ALL vertex information apart from position removed. This is done to
-    /// correctly merge all vertices and receive a closed mesh, which can't be done if more than one vertex per position
-    /// exists.
-    bool loadModelWithJoinedVertices(const std::string &path) {
-        std::vector<aiMesh *> meshes;
 
-        /// Creates an instance of the Importer class
-        Assimp::Importer importer;
-        importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-        importer.SetPropertyInteger(AI_CONFIG_PP_FD_REMOVE, 1);
-        importer.SetPropertyInteger(AI_CONFIG_PP_FD_CHECKAREA, 1);
-        importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_NORMALS | aiComponent_TANGENTS_AND_BITANGENTS |
-                                                                aiComponent_COLORS | aiComponent_TEXCOORDS |
-                                                                aiComponent_BONEWEIGHTS);
-
-        // Progress handler
-        if(mProgress != nullptr) {
-            auto assimpProgress =
-                std::make_unique<AssimpProgress<std::atomic<float>>>(&(mProgress->importComputePercentage));
-            importer.SetProgressHandler(assimpProgress.release());  // importer calls delete on assimpProgress
+            if(mProgress != nullptr && i % sProgressUpdateFaces == 0) {
+                mProgress->importComputePercentage = static_cast<float>(i) / mesh->mNumFaces;
+            }
         }
 
-        /// Scene with some postprocessing
-        const aiScene *scene =
-            importer.ReadFile(path, aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_RemoveComponent |
-                                        aiProcess_JoinIdenticalVertices | aiProcess_FindDegenerates);
+        mVertexBuffer = welder.takeVertices();
+    }
 
-        // If the import failed, report it
-        if(!scene) {
-            CI_LOG_E(importer.GetErrorString());
-            return false;
+    /// Read a binary STL file without Assimp, the whole mesh is built while streaming through the file once
+    bool loadBinaryStl(const std::string &path, ::ThreadPool &threadPool) {
+        try {
+            BinaryStlReader::Mesh mesh = BinaryStlReader::read(path, mProgress, threadPool);
+            mTriangles = std::move(mesh.triangles);
+            mVertexBuffer = std::move(mesh.vertexBuffer);
+            mIndexBuffer = std::move(mesh.indexBuffer);
+            mPalette = std::move(mesh.palette);
+        } catch(const std::runtime_error &) {
+            return false;  // already logged by the reader
         }
-
-        /// Access the file's contents
-        processNode(scene->mRootNode, scene, meshes);
-
-        mVertexBuffer = calculateVertexBuffer(meshes[0]);
-        mIndexBuffer = calculateIndexBuffer(meshes[0]);
-
-        meshes.clear();
         return true;
     }
 
-    /// A method which loads the model we will use for rendering - with duplicated vertices for normals, colors, etc.
-    bool loadModel(const std::string &path) {
+    /// Parse the model once, building both the triangles used for rendering (with normals and colors) and the welded
+    /// vertex and index buffers used for computation (a closed mesh needs exactly one vertex per position).
+    bool loadModel(const std::string &path, ::ThreadPool &threadPool) {
         mPalette.clear();
         std::vector<aiMesh *> meshes;
 
@@ -183,10 +171,10 @@ class ModelImporter {
         importer.SetPropertyInteger(AI_CONFIG_PP_FD_CHECKAREA, 1);
         importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_NORMALS);
 
-        // Progress handler
+        // Progress handler, parsing is the first half of the render import, building triangles the second
         if(mProgress != nullptr) {
             auto assimpProgress =
-                std::make_unique<AssimpProgress<std::atomic<float>>>(&(mProgress->importRenderPercentage));
+                std::make_unique<AssimpProgress<std::atomic<float>>>(&(mProgress->importRenderPercentage), 0.5f);
             importer.SetProgressHandler(assimpProgress.release());  // importer calls delete on assimpProgress
         }
 
@@ -204,7 +192,16 @@ class ModelImporter {
         /// Access the file's contents
         processNode(scene->mRootNode, scene, meshes);
 
+        // Weld the compute geometry on the pool while the render triangles are built here
+        const aiMesh *mesh = meshes[0];
+        auto weldFuture = threadPool.enqueue([this, mesh]() { weldVertices(mesh); });
         mTriangles = processFirstMesh(meshes[0]);
+        threadPool.wait(weldFuture);
+
+        if(mProgress != nullptr) {
+            mProgress->importRenderPercentage = 1.0f;
+            mProgress->importComputePercentage = 1.0f;
+        }
 
         if(mPalette.empty()) {
             mPalette = ColorManager();  // create new palette with default colors
@@ -231,8 +228,9 @@ class ModelImporter {
     }
 
     /// Obtains model information only from first of the meshes.
-    std::vector<DataTriangle> processFirstMesh(aiMesh *mesh) {
-        std::vector<DataTriangle> triangles;
+    TriangleStore processFirstMesh(aiMesh *mesh) {
+        TriangleStore triangles;
+        triangles.reserve(mesh->mNumFaces);
 
         /// Obtaining triangle color. Default color is set if there is no color information
         std::unordered_map<std::array<float, 3>, size_t, boost::hash<std::array<float, 3>>> colorLookup;
@@ -300,6 +298,10 @@ class ModelImporter {
             } else {
                 CI_LOG_W("Imported a triangle with zero surface area. Ommiting it from geometry data.");
             }
+
+            if(mProgress != nullptr && i % sProgressUpdateFaces == 0) {
+                mProgress->importRenderPercentage = 0.5f + 0.5f * static_cast<float>(i) / mesh->mNumFaces;
+            }
         }
         return triangles;
     }
@@ -0,0 +1,147 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/ModelImporter.h"
+#include "ui/MainApplication.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace pepr3d {
+
+/// Write a binary STL file with a grid of 2 * quadsPerSide^2 triangles in the XZ plane
+void writeGridStl(const std::string& path, const size_t quadsPerSide) {
+    std::ofstream file(path, std::ios::binary);
+    const std::array<char, 80> header{};
+    file.write(header.data(), header.size());
+
+    const uint32_t triangleCount = static_cast<uint32_t>(2 * quadsPerSide * quadsPerSide);
+    file.write(reinterpret_cast<const char*>(&triangleCount), sizeof(triangleCount));
+
+    auto writeTriangle = [&file](const std::array<glm::vec3, 3>& vertices) {
+        const std::array<float, 12> data = {0.f,           1.f,           0.f,           vertices[0].x,
+                                            vertices[0].y, vertices[0].z, vertices[1].x, vertices[1].y,
+                                            vertices[1].z, vertices[2].x, vertices[2].y, vertices[2].z};
+        const uint16_t attributes = 0;
+        file.write(reinterpret_cast<const char*>(data.data()), sizeof(float) * data.size());
+        file.write(reinterpret_cast<const char*>(&attributes), sizeof(attributes));
+    };
+
+    const float step = 1.f / static_cast<float>(quadsPerSide);
+    for(size_t x = 0; x < quadsPerSide; ++x) {
+        for(size_t z = 0; z < quadsPerSide; ++z) {
+            const glm::vec3 a(x * step, 0, z * step);
+            const glm::vec3 b((x + 1) * step, 0, z * step);
+            const glm::vec3 c((x + 1) * step, 0, (z + 1) * step);
+            const glm::vec3 d(x * step, 0, (z + 1) * step);
+            writeTriangle({a, d, b});
+            writeTriangle({b, d, c});
+        }
+    }
+}
+
+/// Peak resident memory of this process in kB, 0 if unknown
+size_t getPeakMemoryKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.rfind("VmHWM:", 0) == 0) {
+            return std::stoul(line.substr(6));
+        }
+    }
+    return 0;
+}
+
+TEST(ModelImporter, WeldsSinglePass) {
+    /**
+     * Test that a single parse produces both the triangle soup and a matching welded mesh
+     */
+
+    const std::string path = "modelImporterGrid.stl";
+    const size_t quadsPerSide = 10;
+    writeGridStl(path, quadsPerSide);
+
+    GeometryProgress progress;
+    ModelImporter importer(path, &progress, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+
+    ASSERT_TRUE(importer.isModelLoaded());
+    EXPECT_EQ(progress.importRenderPercentage, 1.0f);
+    EXPECT_EQ(progress.importComputePercentage, 1.0f);
+
+    const auto triangles = importer.getTriangles();
+    const auto vertices = importer.getVertexBuffer();
+    const auto indices = importer.getIndexBuffer();
+    ASSERT_EQ(triangles.size(), 2 * quadsPerSide * quadsPerSide);
+    ASSERT_EQ(indices.size(), triangles.size());
+    EXPECT_EQ(vertices.size(), (quadsPerSide + 1) * (quadsPerSide + 1));
+
+    // Every welded face has the same positions as the triangle with the same index
+    for(size_t i = 0; i < triangles.size(); ++i) {
+        for(int j = 0; j < 3; ++j) {
+            ASSERT_LT(indices[i][j], vertices.size());
+            EXPECT_EQ(vertices[indices[i][j]], triangles[i].getVertex(j));
+        }
+    }
+}
+
+TEST(ModelImporter, TakeResultDoesNotCopy) {
+    /**
+     * Test that moving the imported mesh out of the importer, as Geometry::loadNewGeometry does, keeps its buffers
+     */
+
+    const std::string path = "modelImporterTake.stl";
+    writeGridStl(path, 100);
+
+    GeometryProgress progress;
+    ModelImporter importer(path, &progress, MainApplication::getThreadPool());
+    std::remove(path.c_str());
+    ASSERT_TRUE(importer.isModelLoaded());
+
+    // A copy would have to allocate new buffers, a move hands over the same ones
+    const glm::vec3* positionsData = importer.getTriangles().getPositions().data();
+    const glm::vec3* verticesData = importer.getVertexBuffer().data();
+    const std::array<size_t, 3>* indicesData = importer.getIndexBuffer().data();
+
+    ModelImporter::Result result = std::move(importer).takeResult();
+    EXPECT_FALSE(importer.isModelLoaded());
+
+    EXPECT_EQ(result.triangles.size(), 2 * 100 * 100);
+    EXPECT_EQ(result.indexBuffer.size(), result.triangles.size());
+    EXPECT_EQ(result.vertexBuffer.size(), 101 * 101);
+    EXPECT_FALSE(result.palette.empty());
+
+    EXPECT_EQ(result.triangles.getPositions().data(), positionsData);
+    EXPECT_EQ(result.vertexBuffer.data(), verticesData);
+    EXPECT_EQ(result.indexBuffer.data(), indicesData);
+}
+
+TEST(ModelImporter, DISABLED_benchmarkImport) {
+    /**
+     * Import a ~500 MB binary STL, report time and peak memory
+     */
+
+    const std::string path = "modelImporterBenchmark.stl";
+    writeGridStl(path, 2200);
+
+    const size_t memoryBeforeKb = getPeakMemoryKb();
+    const auto start = std::chrono::high_resolution_clock::now();
+    GeometryProgress progress;
+    ModelImporter importer(path, &progress, MainApplication::getThreadPool());
+    const ModelImporter::Result result = std::move(importer).takeResult();
+    const auto end = std::chrono::high_resolution_clock::now();
+    std::remove(path.c_str());
+
+    std::cout << "Import of " << result.triangles.size()
+              << " triangles took: " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms, peak memory: " << memoryBeforeKb << " kB before, " << getPeakMemoryKb() << " kB after"
+              << std::endl;
+}
+
+}  // namespace pepr3d
+#endif
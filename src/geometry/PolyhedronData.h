@@ -1,6 +1,9 @@
 #pragma once
 
 #include <CGAL/Surface_mesh.h>
+#include <array>
+#include <cstdint>
+#include <vector>
 #include "geometry/Triangle.h"
 
 namespace pepr3d {
@@ -34,6 +37,10 @@ struct PolyhedronData {
     /// A "map" converting the ID of each triangle (from mTriangles) into a face_descriptor
     std::vector<PolyhedronData::face_descriptor> mFaceDescs;
 
+    /// IDs of the neighbouring triangles of each triangle, in the order of its halfedges. -1 if there is no neighbour.
+    /// Precomputed so that bucket spreading does not need to walk the mesh.
+    std::vector<std::array<int32_t, 3>> adjacency;
+
     /// The data-structure itself
     Mesh mMesh;
 };
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "peprassert.h"
+
+namespace pepr3d {
+
+/// Hash of a position with all bits of the coordinates mixed together.
+/// Coordinates of neighbouring vertices differ only in a few low bits and symmetric models repeat the same coordinates
+/// in different order, neither of which a combination like hash(x) ^ hash(y) ^ hash(z) can tell apart.
+struct PositionHash {
+    size_t operator()(const glm::vec3& position) const {
+        return static_cast<size_t>(hashBits(getBits(position.x), getBits(position.y), getBits(position.z)));
+    }
+
+    static uint64_t hashBits(uint32_t x, uint32_t y, uint32_t z) {
+        return mix(mix(mix(x) ^ y) ^ z);
+    }
+
+    /// SplitMix64 finalizer
+    static uint64_t mix(uint64_t value) {
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    static uint32_t getBits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+};
+
+/// Hash map from exact positions to values, with open addressing and linear probing in a single flat array.
+/// Positions are compared by their bit patterns, so -0.0 and 0.0 are different keys, callers that need them joined
+/// add 0.0f to the coordinates first.
+/// Pointers to values are invalidated by any insertion or erase.
+template <typename Value>
+class PositionMap {
+   public:
+    PositionMap() = default;
+
+    /// @param expectedSize number of keys expected, used to avoid rehashing
+    explicit PositionMap(size_t expectedSize) {
+        reserve(expectedSize);
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    /// Make room for at least keyCount keys without rehashing
+    void reserve(size_t keyCount) {
+        if(getCapacityFor(keyCount) > mSlots.size()) {
+            rehash(getCapacityFor(keyCount));
+        }
+    }
+
+    /// Remove all keys, keeping the allocated capacity
+    void clear() {
+        std::fill(mUsed.begin(), mUsed.end(), 0);
+        mSize = 0;
+    }
+
+    /// Insert the value under the key, unless the key is already present
+    /// @return the value stored under the key, and whether it was inserted
+    std::pair<Value*, bool> emplace(const glm::vec3& position, const Value& value) {
+        reserve(mSize + 1);
+        const Key key = getKey(position);
+        size_t slot = getHomeSlot(key);
+        while(mUsed[slot]) {
+            if(mSlots[slot].first == key) {
+                return {&mSlots[slot].second, false};
+            }
+            slot = (slot + 1) & getMask();
+        }
+
+        mUsed[slot] = 1;
+        mSlots[slot] = {key, value};
+        ++mSize;
+        return {&mSlots[slot].second, true};
+    }
+
+    /// @return the value stored under the key, nullptr if the key is not present
+    Value* find(const glm::vec3& position) {
+        const size_t slot = findSlot(getKey(position));
+        return slot == sNotFound ? nullptr : &mSlots[slot].second;
+    }
+
+    const Value* find(const glm::vec3& position) const {
+        const size_t slot = findSlot(getKey(position));
+        return slot == sNotFound ? nullptr : &mSlots[slot].second;
+    }
+
+    /// Remove the key, keys after it in the probe sequence are shifted back, so no tombstones are needed
+    /// @return true if the key was present
+    bool erase(const glm::vec3& position) {
+        size_t hole = findSlot(getKey(position));
+        if(hole == sNotFound) {
+            return false;
+        }
+
+        for(size_t slot = (hole + 1) & getMask(); mUsed[slot]; slot = (slot + 1) & getMask()) {
+            // Keys whose home slot lies cyclically in (hole, slot] have to stay where they are
+            const size_t home = getHomeSlot(mSlots[slot].first);
+            if(((slot - home) & getMask()) >= ((slot - hole) & getMask())) {
+                mSlots[hole] = mSlots[slot];
+                hole = slot;
+            }
+        }
+
+        mUsed[hole] = 0;
+        --mSize;
+        return true;
+    }
+
+   private:
+    using Key = std::array<uint32_t, 3>;
+
+    static constexpr size_t sNotFound = static_cast<size_t>(-1);
+
+    /// At most half of the slots are used, which keeps the probe sequences short
+    static size_t getCapacityFor(size_t keyCount) {
+        size_t capacity = 16;
+        while(capacity < 2 * keyCount) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    static Key getKey(const glm::vec3& position) {
+        return {PositionHash::getBits(position.x), PositionHash::getBits(position.y),
+                PositionHash::getBits(position.z)};
+    }
+
+    size_t getMask() const {
+        P_ASSERT(!mSlots.empty());
+        return mSlots.size() - 1;
+    }
+
+    size_t getHomeSlot(const Key& key) const {
+        return static_cast<size_t>(PositionHash::hashBits(key[0], key[1], key[2])) & getMask();
+    }
+
+    size_t findSlot(const Key& key) const {
+        if(mSize == 0) {
+            return sNotFound;
+        }
+        for(size_t slot = getHomeSlot(key); mUsed[slot]; slot = (slot + 1) & getMask()) {
+            if(mSlots[slot].first == key) {
+                return slot;
+            }
+        }
+        return sNotFound;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<std::pair<Key, Value>> oldSlots(capacity);
+        std::vector<uint8_t> oldUsed(capacity, 0);
+        oldSlots.swap(mSlots);
+        oldUsed.swap(mUsed);
+
+        for(size_t i = 0; i < oldSlots.size(); ++i) {
+            if(!oldUsed[i]) {
+                continue;
+            }
+            size_t slot = getHomeSlot(oldSlots[i].first);
+            while(mUsed[slot]) {
+                slot = (slot + 1) & getMask();
+            }
+            mUsed[slot] = 1;
+            mSlots[slot] = std::move(oldSlots[i]);
+        }
+    }
+
+    std::vector<std::pair<Key, Value>> mSlots;
+    std::vector<uint8_t> mUsed;
+    size_t mSize = 0;
+};
+
+}  // namespace pepr3d
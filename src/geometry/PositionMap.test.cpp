@@ -0,0 +1,138 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/PositionMap.h"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace pepr3d {
+
+/// Hash that combines the coordinates with XOR, as the detailed mesh used to
+struct XorPositionHash {
+    size_t operator()(const glm::vec3& position) const {
+        return std::hash<float>()(position.x) ^ std::hash<float>()(position.y) ^ std::hash<float>()(position.z);
+    }
+};
+
+/// Vertices of a cube surface with n x n quads on each side, centered at the origin, so that every coordinate also
+/// appears negated and permuted
+std::vector<glm::vec3> getSymmetricPositions(const size_t n) {
+    std::vector<glm::vec3> positions;
+    const float step = 2.f / static_cast<float>(n);
+    for(size_t i = 0; i <= n; ++i) {
+        for(size_t j = 0; j <= n; ++j) {
+            const float u = -1.f + i * step;
+            const float v = -1.f + j * step;
+            for(const float side : {-1.f, 1.f}) {
+                positions.emplace_back(side, u, v);
+                positions.emplace_back(u, side, v);
+                positions.emplace_back(u, v, side);
+            }
+        }
+    }
+    return positions;
+}
+
+TEST(PositionMap, InsertFindErase) {
+    PositionMap<size_t> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.find(glm::vec3(1, 2, 3)), nullptr);
+    EXPECT_FALSE(map.erase(glm::vec3(1, 2, 3)));
+
+    const auto inserted = map.emplace(glm::vec3(1, 2, 3), 7);
+    EXPECT_TRUE(inserted.second);
+    EXPECT_EQ(*inserted.first, 7);
+
+    // Existing keys keep their value
+    const auto existing = map.emplace(glm::vec3(1, 2, 3), 8);
+    EXPECT_FALSE(existing.second);
+    EXPECT_EQ(*existing.first, 7);
+    EXPECT_EQ(map.size(), 1);
+
+    // Keys are bit patterns, permuted coordinates and negative zero are different keys
+    EXPECT_EQ(map.find(glm::vec3(3, 2, 1)), nullptr);
+    map.emplace(glm::vec3(0, 0, 0), 1);
+    EXPECT_EQ(map.find(glm::vec3(-0.f, 0, 0)), nullptr);
+
+    EXPECT_TRUE(map.erase(glm::vec3(1, 2, 3)));
+    EXPECT_EQ(map.find(glm::vec3(1, 2, 3)), nullptr);
+    ASSERT_NE(map.find(glm::vec3(0, 0, 0)), nullptr);
+    EXPECT_EQ(*map.find(glm::vec3(0, 0, 0)), 1);
+    EXPECT_EQ(map.size(), 1);
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.find(glm::vec3(0, 0, 0)), nullptr);
+}
+
+TEST(PositionMap, MatchesUnorderedMap) {
+    /**
+     * Test random insertions and erasures against std::unordered_map, so that probe sequences wrap around and get
+     * shifted back by erase
+     */
+
+    const std::vector<glm::vec3> positions = getSymmetricPositions(12);
+    std::mt19937 generator(3);
+    std::uniform_int_distribution<size_t> positionDistribution(0, positions.size() - 1);
+
+    PositionMap<size_t> map;
+    std::unordered_map<glm::vec3, size_t, PositionHash> reference;
+    for(size_t i = 0; i < 20000; ++i) {
+        const glm::vec3& position = positions[positionDistribution(generator)];
+        if(i % 3 == 0) {
+            EXPECT_EQ(map.erase(position), reference.erase(position) > 0);
+        } else {
+            const auto inserted = map.emplace(position, i);
+            const auto referenceInserted = reference.emplace(position, i);
+            ASSERT_EQ(inserted.second, referenceInserted.second);
+            ASSERT_EQ(*inserted.first, referenceInserted.first->second);
+        }
+        ASSERT_EQ(map.size(), reference.size());
+    }
+
+    for(const glm::vec3& position : positions) {
+        const auto referenceIt = reference.find(position);
+        const size_t* value = map.find(position);
+        if(referenceIt == reference.end()) {
+            EXPECT_EQ(value, nullptr);
+        } else {
+            ASSERT_NE(value, nullptr);
+            EXPECT_EQ(*value, referenceIt->second);
+        }
+    }
+}
+
+TEST(PositionMap, DISABLED_benchmarkSymmetricPositions) {
+    for(const size_t n : {100, 400}) {
+        const std::vector<glm::vec3> positions = getSymmetricPositions(n);
+
+        const auto xorStart = std::chrono::high_resolution_clock::now();
+        std::unordered_map<glm::vec3, size_t, XorPositionHash> xorMap;
+        for(size_t i = 0; i < positions.size(); ++i) {
+            xorMap.emplace(positions[i], i);
+        }
+        const auto xorEnd = std::chrono::high_resolution_clock::now();
+
+        const auto mapStart = std::chrono::high_resolution_clock::now();
+        PositionMap<size_t> map(positions.size());
+        for(size_t i = 0; i < positions.size(); ++i) {
+            map.emplace(positions[i], i);
+        }
+        const auto mapEnd = std::chrono::high_resolution_clock::now();
+        EXPECT_EQ(map.size(), xorMap.size());
+
+        std::cout << "Welding " << positions.size() << " symmetric positions took: "
+                  << std::chrono::duration<double, std::milli>(xorEnd - xorStart).count()
+                  << " ms with XOR hash in std::unordered_map, "
+                  << std::chrono::duration<double, std::milli>(mapEnd - mapStart).count() << " ms with PositionMap"
+                  << std::endl;
+    }
+}
+
+}  // namespace pepr3d
+#endif
@@ -31,25 +31,31 @@
 namespace pepr3d {
 
 void TriangleDetail::paintSphere(const PeprSphere& peprSphere, int minSegments, size_t color) {
+    addPolygon(polygonFromSphere(peprSphere, minSegments), color);
+}
+
+TriangleDetail::Polygon TriangleDetail::polygonFromSphere(const PeprSphere& peprSphere, int minSegments) const {
     // Vertices on the triangle boundaries must be the same across multiple triangle details!
 
     const Sphere sphere(toExactK(peprSphere.center()), peprSphere.squared_radius());
     auto intersection = CGAL::intersection(sphere, mOriginalPlane);
 
     if(!intersection) {
-        return;
+        return {};
     }
 
     std::optional<Circle3> circleIntersection = boost::apply_visitor(SphereIntersectionVisitor{}, *intersection);
 
     // Continue only if the intersection is a circle (not a point or miss)
-    if(circleIntersection) {
-        auto poly = polygonFromCircle(*circleIntersection, minSegments);
-        addPolygon(poly, color);
+    if(!circleIntersection) {
+        return {};
     }
+
+    return polygonFromCircle(*circleIntersection, minSegments);
 }
+
 TriangleDetail::Polygon TriangleDetail::projectShapeToPolygon(const std::vector<PeprPoint3>& shape,
-                                                              const PeprVector3& direction) {
+                                                              const PeprVector3& direction) const {
     P_ASSERT(shape.size() >= 3);
 
     // Create a polygon of the shape
@@ -137,6 +143,11 @@ bool TriangleDetail::addMissingPoints(const std::set<Point3>& myPoints, const st
         updatePolysFromTriangles();
     }
 
+    // Simplification must not remove the points added here
+    if(mNeedsSimplification) {
+        simplifyPolygons();
+    }
+
     // Find missing points
     std::set<Point3> missingPoints;
     std::set_difference(theirPoints.begin(), theirPoints.end(), myPoints.begin(), myPoints.end(),
@@ -153,10 +164,15 @@ bool TriangleDetail::addMissingPoints(const std::set<Point3>& myPoints, const st
         }
     }
 
-    // Bring the 3d points to our plane
+    // Bring the 3d points to our plane.
+    // The projections are stored as new exact values, so that our polygons keep no ref counted handles into the other
+    // detail. Evaluating such a shared handle while another thread evaluates it too, e.g. when triangulating details
+    // in parallel, would be a data race.
     std::vector<Point2> points2D;
-    std::transform(missingPoints.begin(), missingPoints.end(), std::back_inserter(points2D),
-                   [this](auto& e) { return mOriginalPlane.to_2d(e); });
+    std::transform(missingPoints.begin(), missingPoints.end(), std::back_inserter(points2D), [this](auto& e) {
+        const Point2 projected = mOriginalPlane.to_2d(e);
+        return Point2(K::FT(CGAL::exact(projected.x())), K::FT(CGAL::exact(projected.y())));
+    });
 
     const Line2 sharedEdge2D(mOriginalPlane.to_2d(sharedEdge.vertex(0)), mOriginalPlane.to_2d(sharedEdge.vertex(1)));
 
@@ -209,6 +225,7 @@ bool TriangleDetail::addMissingPoints(const std::set<Point3>& myPoints, const st
         colorSetIt.second.clear();
         colorSetIt.second.join(polys.begin(), polys.end());
     }
+    mNeedsTriangulation = true;
 
     if(!points2D.empty()) {
         CI_LOG_E("Some shared points could not be added!");
@@ -257,9 +274,15 @@ void TriangleDetail::simplifyPolygons() {
             colorSetIt.second.join(polys.begin(), polys.end());
         }
     }
+    mNeedsSimplification = false;
 }
 
 std::set<TriangleDetail::Point3> TriangleDetail::findPointsOnEdge(const TriangleDetail::Segment3& edge) {
+    // Points removed by a pending simplification must not be reported
+    if(mNeedsSimplification) {
+        simplifyPolygons();
+    }
+
     Line2 edgeLine(mOriginalPlane.to_2d(edge.point(0)), mOriginalPlane.to_2d(edge.point(1)));
     std::set<Point3> result;
 
@@ -428,8 +451,102 @@ void TriangleDetail::addPolygon(const Polygon& poly, size_t color) {
         return;
     }
 
-    P_ASSERT(CGAL::is_valid_polygon(poly, Traits()));
-    PolygonSet addedShape(poly);
+    paintPolygons({poly}, color);
+}
+
+CGAL::Orientation TriangleDetail::filteredOrientation(const Point2& p, const Point2& q, const Point2& r) {
+    {
+        // Intervals enclose the exact coordinates, so a certain sign of the determinant is the exact sign
+        CGAL::Protect_FPU_rounding<true> protection;
+        using Interval = CGAL::Interval_nt<false>;
+        const Interval px(CGAL::to_interval(p.x()));
+        const Interval py(CGAL::to_interval(p.y()));
+        const Interval qx(CGAL::to_interval(q.x()));
+        const Interval qy(CGAL::to_interval(q.y()));
+        const Interval rx(CGAL::to_interval(r.x()));
+        const Interval ry(CGAL::to_interval(r.y()));
+
+        const CGAL::Uncertain<CGAL::Sign> sign = CGAL::sign((qx - px) * (ry - py) - (qy - py) * (rx - px));
+        if(CGAL::is_certain(sign)) {
+            return static_cast<CGAL::Orientation>(CGAL::get_certain(sign));
+        }
+    }
+
+    return CGAL::orientation(p, q, r);
+}
+
+bool TriangleDetail::mayIntersectBounds(const Polygon& poly) const {
+    // Bounding boxes of exact polygons are computed from intervals, they always contain the exact box
+    return CGAL::do_overlap(poly.bbox(), mBounds.bbox());
+}
+
+bool TriangleDetail::coversBounds(const Polygon& poly) const {
+    for(auto edgeIt = poly.edges_begin(); edgeIt != poly.edges_end(); ++edgeIt) {
+        for(auto boundIt = mBounds.vertices_begin(); boundIt != mBounds.vertices_end(); ++boundIt) {
+            if(filteredOrientation(edgeIt->source(), edgeIt->target(), *boundIt) != CGAL::LEFT_TURN) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool TriangleDetail::isFilledWithColor(size_t color) const {
+    if(mColorChanged) {
+        return false;  // Polygons are not up to date
+    }
+
+    for(const auto& colorSetIt : mColoredPolys) {
+        if(colorSetIt.second.is_empty() == (colorSetIt.first == color)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TriangleDetail::fillWithColor(size_t color) {
+#ifdef PEPR3D_COLLECT_DEBUG_DATA
+    history.emplace_back(PolygonEntry{mBounds, color});
+#endif
+
+    mColoredPolys.clear();
+    mColoredPolys.emplace(color, PolygonSet(mBounds));
+    mColorChanged = false;
+    mNeedsSimplification = false;
+    mNeedsTriangulation = true;
+}
+
+void TriangleDetail::paintPolygons(const std::vector<Polygon>& polygons, size_t color) {
+    std::vector<Polygon> nonEmpty;
+    nonEmpty.reserve(polygons.size());
+    for(const Polygon& poly : polygons) {
+        if(!poly.is_empty()) {
+            P_ASSERT(CGAL::is_valid_polygon(poly, Traits()));
+            if(mUseTrivialCaseFilter && !mayIntersectBounds(poly)) {
+                continue;
+            }
+            nonEmpty.push_back(poly);
+        }
+    }
+
+    if(nonEmpty.empty()) {
+        return;
+    }
+
+    if(mUseTrivialCaseFilter) {
+        if(isFilledWithColor(color)) {
+            return;
+        }
+
+        if(std::any_of(nonEmpty.begin(), nonEmpty.end(), [this](const Polygon& poly) { return coversBounds(poly); })) {
+            fillWithColor(color);
+            return;
+        }
+    }
+
+    // Joining all polygons at once is much faster than joining them one by one
+    PolygonSet addedShape;
+    addedShape.join(nonEmpty.begin(), nonEmpty.end());
     addPolygonSet(addedShape, color);
 }
 
@@ -458,8 +575,18 @@ void TriangleDetail::addPolygonSet(PolygonSet& polySet, size_t color) {
         }
     }
 
-    simplifyPolygons();
-    updateTrianglesFromPolygons();
+    // Triangulated later, once for all paint operations until the triangles are needed
+    mNeedsSimplification = true;
+    mNeedsTriangulation = true;
+}
+
+void TriangleDetail::flushTriangles() {
+    if(mNeedsSimplification) {
+        simplifyPolygons();
+    }
+    if(mNeedsTriangulation) {
+        updateTrianglesFromPolygons();
+    }
 }
 
 TriangleDetail::Segment3 TriangleDetail::findSharedEdge(const TriangleDetail& other) {
@@ -637,6 +764,7 @@ std::vector<TriangleDetail::Triangle2> TriangleDetail::triangulatePolygon(const
 }
 
 void TriangleDetail::updateTrianglesFromPolygons() {
+    mNeedsTriangulation = false;
     mTriangles.clear();
     mTrianglesToExactIdx.clear();
     mTrianglesExact.clear();
@@ -659,6 +787,7 @@ void TriangleDetail::updateTrianglesFromPolygons() {
 }
 
 void TriangleDetail::setColor(size_t detailIdx, size_t color) {
+    flushTriangles();
     P_ASSERT(detailIdx < mTriangles.size());
     P_ASSERT(mTriangles.size() == mTrianglesToExactIdx.size());
 
@@ -686,4 +815,30 @@ void TriangleDetail::setColor(size_t detailIdx, size_t color) {
 #endif
     }
 }
+
+size_t TriangleDetail::getApproximateMemoryBytes() const {
+    // Exact numbers are GMP rationals allocated on the heap, count a fixed size for each of them
+    constexpr size_t exactNumberBytes = 64;
+    constexpr size_t exactPointBytes = sizeof(Point2) + 2 * exactNumberBytes;
+
+    size_t bytes = sizeof(TriangleDetail);
+    bytes += mTriangles.capacity() * sizeof(DataTriangle);
+    bytes += mTrianglesToExactIdx.capacity() * sizeof(size_t);
+    bytes += mTrianglesExact.capacity() * (sizeof(ExactTriangle) + 3 * exactPointBytes);
+    for(const std::vector<size_t>& degenerateTriangles : mPolygonDegenerateTriangles) {
+        bytes += sizeof(degenerateTriangles) + degenerateTriangles.capacity() * sizeof(size_t);
+    }
+    bytes += mBounds.size() * exactPointBytes;
+
+    // Polygon sets are stored as arrangements, each edge keeps its own segment
+    for(const auto& coloredPolys : mColoredPolys) {
+        const auto& arrangement = coloredPolys.second.arrangement();
+        bytes += sizeof(coloredPolys);
+        bytes += arrangement.number_of_vertices() * (exactPointBytes + 4 * sizeof(void*));
+        bytes += arrangement.number_of_edges() * (2 * exactPointBytes + 12 * sizeof(void*));
+        bytes += arrangement.number_of_faces() * 8 * sizeof(void*);
+    }
+
+    return bytes;
+}
 }  // namespace pepr3d
@@ -16,6 +16,7 @@
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
 #include <CGAL/Exact_spherical_kernel_3.h>
 #include <CGAL/General_polygon_2.h>
+#include <CGAL/Interval_nt.h>
 #include <CGAL/IO/io.h>
 #include <CGAL/Lazy_exact_nt.h>
 #include <CGAL/Polygon_2.h>
@@ -158,7 +159,10 @@ class TriangleDetail {
 
 #endif
 
-    explicit TriangleDetail(const DataTriangle& original) : mOriginal(original) {
+    /// @param useTrivialCaseFilter Decide the trivial cases of painting before the exact polygon booleans, see
+    /// paintPolygons(). Only disabled to test and measure the exact path alone.
+    explicit TriangleDetail(const DataTriangle& original, bool useTrivialCaseFilter = true)
+        : mOriginal(original), mUseTrivialCaseFilter(useTrivialCaseFilter) {
         const PeprTriangle& tri = mOriginal.getTri();
         mOriginalPlane = Plane(toExactK(tri.vertex(0)), toExactK(tri.vertex(1)), toExactK(tri.vertex(2)));
         mBounds = polygonFromTriangle(mOriginal.getTri());
@@ -193,22 +197,66 @@ class TriangleDetail {
     /// @param direction Direction vector of the projection
     void paintShape(const std::vector<PeprTriangle>& triangles, const PeprVector3& direction, size_t color);
 
+    /// Paint the union of all polygons with one color, retriangulating the detail only once
+    /// Unless disabled in the constructor, a trivial-case filter first decides polygons missing the triangle,
+    /// covering it whole or painting over a detail of the same color with interval arithmetic. Only answers certain
+    /// in interval arithmetic are used, so the filter gives the same polygons. Any partial overlap still runs the
+    /// exact polygon booleans.
+    /// @param polygons Polygons in the plane of the original triangle, empty polygons are ignored
+    void paintPolygons(const std::vector<Polygon>& polygons, size_t color);
+
+    /// Orientation of the three points, evaluated in interval arithmetic and exactly only if the sign is uncertain
+    static CGAL::Orientation filteredOrientation(const Point2& p, const Point2& q, const Point2& r);
+
+    /// Intersection of a sphere with the plane of the original triangle, as a polygon
+    /// @return Empty polygon if the sphere does not intersect the plane
+    Polygon polygonFromSphere(const PeprSphere& sphere, int minSegments) const;
+
+    /// Project a shape onto the plane of the original triangle
+    /// @param shape Collection of points that form a polygon
+    /// @param direction Direction vector of the projection
+    /// @return Empty polygon if the projection is not a simple polygon
+    Polygon projectShapeToPolygon(const std::vector<PeprPoint3>& shape, const PeprVector3& direction) const;
+
     /// Makes sure all vertices on the common edge between these two triangles are matched
     /// Creates new vertices for both triangles if there are missing
-    /// You will need to updateTrianglesFromPolygons() after calling this method!
+    /// The detail has to be triangulated again afterwards, e.g. by flushTriangles()
     /// @return <bool,bool> true if points were added to a triangle
     std::pair<bool, bool> correctSharedVertices(TriangleDetail& other);
 
+    /// Triangles of this detail, triangulated first if the polygons changed since the last triangulation
+    const std::vector<DataTriangle>& getTriangles() {
+        flushTriangles();
+        return mTriangles;
+    }
+
+    /// Triangles of this detail. The detail has to be triangulated by flushTriangles() after the last paint, so that
+    /// the triangles can be read from many threads at once, e.g. after Geometry::flushDetails().
+    /// @throws std::logic_error if the detail was not triangulated, its triangles would be out of date
     const std::vector<DataTriangle>& getTriangles() const {
+        if(mNeedsTriangulation) {
+            throw std::logic_error("Triangles of a triangle detail read before it was triangulated");
+        }
         return mTriangles;
     }
 
+    /// Did the polygons change since the last triangulation?
+    bool needsTriangulation() const {
+        return mNeedsTriangulation;
+    }
+
+    /// Simplify and triangulate the polygons if they changed since the last triangulation
+    /// Painting only changes the polygons, so that any number of paint operations costs a single triangulation
+    void flushTriangles();
+
     const DataTriangle& getOriginal() const {
         return mOriginal;
     }
 
+    /// Estimate of the heap memory held by this detail, including the exact polygon representation
+    size_t getApproximateMemoryBytes() const;
+
     /// Create new triangles from a set of colored polygons
-    /// Tries to simplify the polygons in the process
     void updateTrianglesFromPolygons();
 
     /// Set color of a detail triangle
@@ -243,7 +291,9 @@ class TriangleDetail {
         mOriginalPlane = Plane(toExactK(tri.vertex(0)), toExactK(tri.vertex(1)), toExactK(tri.vertex(2)));
         mBounds = polygonFromTriangle(mOriginal.getTri());
 
-        updateTrianglesFromPolygons();
+        // Simplified and triangulated once the triangles are needed
+        mNeedsSimplification = true;
+        mNeedsTriangulation = true;
     }
 
     /// Convert Point_2 from Pepr3d kernel to Exact kernel
@@ -342,6 +392,12 @@ class TriangleDetail {
     /// This is used for saving andpolygonset reconstruction
     std::vector<ExactTriangle> mTrianglesExact;
 
+    /// Were the polygons changed by painting since they were last simplified?
+    bool mNeedsSimplification = false;
+
+    /// Were the polygons changed since the last updateTrianglesFromPolygons()?
+    bool mNeedsTriangulation = false;
+
     /// Stores index into mTrianglesExact of every degenerate triangle(when represented as DataTriangle), grouped by the
     /// polygon it belongs to.
     std::vector<std::vector<size_t>> mPolygonDegenerateTriangles;
@@ -362,6 +418,9 @@ class TriangleDetail {
     /// Did color of any detail triangle change since last triangulation?
     bool mColorChanged = false;
 
+    /// Does paintPolygons() decide the trivial cases before the exact polygon booleans?
+    bool mUseTrivialCaseFilter = true;
+
     /// Get points of a circle that are shared with border triangles
     std::vector<std::pair<Point2, double>> getCircleSharedPoints(const Circle3& circle, const Vector3& xBase,
                                                                  const Vector3& yBase) const;
@@ -370,8 +429,6 @@ class TriangleDetail {
     /// Find shared edge between triangles
     Segment3 findSharedEdge(const TriangleDetail& other);
 
-    Polygon projectShapeToPolygon(const std::vector<PeprPoint3>& shape, const PeprVector3& direction);
-
     /// Do two polygons that are triangles intersect
     /// This is faster than checking an intersection between polygons of any size
     static bool trianglePolygonsDoIntersect(const Polygon& first, const Polygon& second) {
@@ -404,6 +461,20 @@ class TriangleDetail {
     /// Simplify polygons, removing any vertices that are collinear
     void simplifyPolygons();
 
+    /// Can the polygon intersect the bounds? False only if their bounding boxes are certainly disjoint.
+    bool mayIntersectBounds(const Polygon& poly) const;
+
+    /// Is the whole triangle certainly inside the polygon?
+    /// True if every vertex of the bounds lies strictly left of every edge of the polygon, which puts the triangle
+    /// inside the kernel of the polygon. Holds for any simple counter-clockwise polygon, convex or not.
+    bool coversBounds(const Polygon& poly) const;
+
+    /// Is the whole detail certainly painted with the color already?
+    bool isFilledWithColor(size_t color) const;
+
+    /// Replace all polygons by the bounds in a single color
+    void fillWithColor(size_t color);
+
     /// Generate one colored polygon set for each color inside the triangle
     /// This is a slow operation
     void updatePolysFromTriangles();
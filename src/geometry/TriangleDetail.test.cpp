@@ -14,8 +14,14 @@
 
 #include <cereal/archives/json.hpp>
 #include <cereal/types/map.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iostream>
 #include <random>
 #include <set>
+#include <string>
 
 namespace pepr3d {
 using Point2 = TriangleDetail::Point2;
@@ -258,6 +264,205 @@ TEST(TriangleDetail, TriangleDetailOperations) {
     }
 }
 
+TEST(TriangleDetail, LazyTriangulation) {
+    /**
+     * Test that painting only changes the polygons and the triangles are created once they are needed
+     */
+
+    const DataTriangle tri(glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), 0);
+    TriangleDetail triDetail(tri);
+    ASSERT_FALSE(triDetail.needsTriangulation());
+    ASSERT_EQ(triDetail.getTriangles().size(), 1);
+
+    for(int i = 0; i < 3; ++i) {
+        const TriangleDetail::PeprSphere sphere(TriangleDetail::PeprPoint3(0.1 * i, 0.1, 0), 0.01);
+        triDetail.paintSphere(sphere, 16, 1);
+        EXPECT_TRUE(triDetail.needsTriangulation());
+    }
+
+    triDetail.flushTriangles();
+    const auto& triangles = triDetail.getTriangles();
+    EXPECT_FALSE(triDetail.needsTriangulation());
+    EXPECT_GT(triangles.size(), 1);
+    EXPECT_TRUE(
+        std::any_of(triangles.begin(), triangles.end(), [](const DataTriangle& t) { return t.getColor() == 1; }));
+    EXPECT_TRUE(
+        std::any_of(triangles.begin(), triangles.end(), [](const DataTriangle& t) { return t.getColor() == 0; }));
+}
+
+TEST(TriangleDetail, FilteredOrientation) {
+    /**
+     * Test that the filtered orientation matches the exact one, including nearly collinear points
+     */
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    for(int i = 0; i < 1000; ++i) {
+        const Point2 p(distribution(generator), distribution(generator));
+        const Point2 q(distribution(generator), distribution(generator));
+        const Point2 r(distribution(generator), distribution(generator));
+        ASSERT_EQ(TriangleDetail::filteredOrientation(p, q, r), CGAL::orientation(p, q, r));
+
+        // Points on the line pq and exact rationals just off it, which intervals cannot decide
+        using FT = TriangleDetail::K::FT;
+        const Point2 onLine = p + (q - p) * (FT(1) / FT(3));
+        const TriangleDetail::Vector2 offset(FT(1) / FT(1000000000) / FT(1000000000), FT(0));
+        ASSERT_EQ(TriangleDetail::filteredOrientation(p, q, onLine), CGAL::COLLINEAR);
+        ASSERT_EQ(TriangleDetail::filteredOrientation(p, q, onLine + offset), CGAL::orientation(p, q, onLine + offset));
+    }
+}
+
+/// Triangles of the detail after painting the polygons one by one, as sorted arrays of vertices and color.
+/// Vertices of each triangle are rotated to start at the smallest one, so that the starting vertex does not matter.
+std::vector<std::array<float, 10>> paintPolygonsWithMode(const std::vector<std::pair<Polygon, size_t>>& polygons,
+                                                         bool useTrivialCaseFilter) {
+    const DataTriangle tri(glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), 0);
+    TriangleDetail triDetail(tri, useTrivialCaseFilter);
+    for(const auto& polygon : polygons) {
+        triDetail.addPolygon(polygon.first, polygon.second);
+    }
+    triDetail.flushTriangles();
+    std::vector<std::array<float, 10>> result;
+    for(const DataTriangle& detailTri : triDetail.getTriangles()) {
+        std::array<std::array<float, 3>, 3> vertices;
+        for(size_t i = 0; i < 3; ++i) {
+            vertices[i] = {detailTri.getVertex(i).x, detailTri.getVertex(i).y, detailTri.getVertex(i).z};
+        }
+        std::rotate(vertices.begin(), std::min_element(vertices.begin(), vertices.end()), vertices.end());
+        result.push_back({vertices[0][0], vertices[0][1], vertices[0][2], vertices[1][0], vertices[1][1],
+                          vertices[1][2], vertices[2][0], vertices[2][1], vertices[2][2],
+                          static_cast<float>(detailTri.getColor())});
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+TEST(TriangleDetail, TrivialCaseFilter) {
+    /**
+     * Test that polygons missing the triangle, covering it or painting over the same color give the same triangles
+     * with and without the trivial-case filter
+     */
+
+    const DataTriangle tri(glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), 0);
+    const TriangleDetail triDetail(tri);
+    auto getSquare = [&triDetail](double x, double y, double size) {
+        Polygon square;
+        square.push_back(triDetail.mOriginalPlane.to_2d(TriangleDetail::Point3(x, y, 0.0)));
+        square.push_back(triDetail.mOriginalPlane.to_2d(TriangleDetail::Point3(x + size, y, 0.0)));
+        square.push_back(triDetail.mOriginalPlane.to_2d(TriangleDetail::Point3(x + size, y + size, 0.0)));
+        square.push_back(triDetail.mOriginalPlane.to_2d(TriangleDetail::Point3(x, y + size, 0.0)));
+        if(square.is_clockwise_oriented()) {
+            square.reverse_orientation();
+        }
+        return square;
+    };
+
+    const std::vector<std::vector<std::pair<Polygon, size_t>>> cases = {
+        {{getSquare(2, 2, 1), 1}},                                       // Misses the triangle
+        {{getSquare(0.1, 0.1, 0.2), 1}, {getSquare(-1, -1, 3), 2}},      // Covers it whole
+        {{getSquare(-1, -1, 3), 1}, {getSquare(0.1, 0.1, 0.2), 1}},      // Same color over it
+        {{getSquare(0.1, 0.1, 0.2), 1}, {getSquare(0.2, 0.2, 0.2), 2}},  // Needs the exact path
+        {{getSquare(0, 0, 1), 1}, {getSquare(0.5, 0, 0.5), 2}},          // Touches the bounds
+    };
+
+    for(const auto& polygons : cases) {
+        EXPECT_EQ(paintPolygonsWithMode(polygons, false), paintPolygonsWithMode(polygons, true));
+    }
+}
+
+TEST(TriangleDetail, DISABLED_benchmarkTrivialCaseFilter) {
+    /**
+     * Replay painting sessions with and without the trivial-case filter:
+     * the recorded session of tests/addMissingPoints.json with shared edge corrections and color changes,
+     * the recorded color regions of tests/updateTrianglesFromPolygons.json painted as whole polygon sets,
+     * and a brush stroke of overlapping dabs in two colors, going over painted parts again.
+     */
+
+    using HistoryEntry = TriangleDetail::HistoryEntry;
+    using PolygonEntry = TriangleDetail::PolygonEntry;
+    using ColorChangeEntry = TriangleDetail::ColorChangeEntry;
+    using PointEntry = TriangleDetail::PointEntry;
+
+    std::stringstream peprTriStream("-0.5 -0.5 0.5 0.5 -0.5 0.5 0.5 0.5 0.5");
+    TriangleDetail::PeprTriangle peprTri;
+    peprTriStream >> peprTri;
+    const DataTriangle tri(TriangleDetail::toGlmVec(peprTri.vertex(0)), TriangleDetail::toGlmVec(peprTri.vertex(1)),
+                           TriangleDetail::toGlmVec(peprTri.vertex(2)), glm::vec3(1, 0, 0), 0);
+
+    std::vector<HistoryEntry> history;
+    {
+        std::ifstream testFile("./tests/addMissingPoints.json", std::ios::in);
+        ASSERT_TRUE(testFile.good());
+        cereal::JSONInputArchive jsonArchive(testFile);
+        jsonArchive(history);
+    }
+
+    std::map<size_t, PolygonSet> coloredPolys;
+    {
+        std::ifstream testFile("./tests/updateTrianglesFromPolygons.json", std::ios::in);
+        ASSERT_TRUE(testFile.good());
+        cereal::JSONInputArchive jsonArchive(testFile);
+        jsonArchive(coloredPolys);
+    }
+
+    const auto replayHistory = [&history](TriangleDetail& triDetail) {
+        for(HistoryEntry& entry : history) {
+            if(PolygonEntry* pe = boost::get<PolygonEntry>(&entry)) {
+                triDetail.addPolygon(pe->polygon, pe->color);
+            } else if(PointEntry* pe = boost::get<PointEntry>(&entry)) {
+                auto myPoints = triDetail.findPointsOnEdge(pe->sharedEdge);
+                triDetail.addMissingPoints(myPoints, pe->theirPoints, pe->sharedEdge);
+                triDetail.updateTrianglesFromPolygons();
+            } else if(ColorChangeEntry* ce = boost::get<ColorChangeEntry>(&entry)) {
+                triDetail.setColor(ce->detailIdx, ce->color);
+            }
+        }
+        return history.size();
+    };
+
+    const auto replayPolygonSets = [&coloredPolys](TriangleDetail& triDetail) {
+        std::map<size_t, PolygonSet> polygonSets = coloredPolys;
+        for(auto& colorAndPolygons : polygonSets) {
+            triDetail.addPolygonSet(colorAndPolygons.second, colorAndPolygons.first);
+        }
+        return polygonSets.size();
+    };
+
+    const auto paintStroke = [](TriangleDetail& triDetail) {
+        // Dabs along the diagonal and back, the way back partially over the same color
+        const size_t dabCount = 200;
+        for(size_t i = 0; i < dabCount; ++i) {
+            const double t = static_cast<double>(i % (dabCount / 2)) / (dabCount / 2);
+            const double offset = i < dabCount / 2 ? 0.0 : 0.03;
+            const TriangleDetail::PeprPoint3 center(-0.3 + 0.7 * t + offset, -0.45 + 0.7 * t, 0.5);
+            triDetail.paintSphere(TriangleDetail::PeprSphere(center, 0.0025), 16, 1 + (i / 50) % 2);
+        }
+        return dabCount;
+    };
+
+    const std::vector<std::pair<std::string, std::function<size_t(TriangleDetail&)>>> sessions = {
+        {"addMissingPoints.json", replayHistory},
+        {"updateTrianglesFromPolygons.json", replayPolygonSets},
+        {"brush stroke", paintStroke}};
+
+    for(const auto& session : sessions) {
+        for(const bool useTrivialCaseFilter : {false, true}) {
+            TriangleDetail triDetail(tri, useTrivialCaseFilter);
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            const size_t operationCount = session.second(triDetail);
+            triDetail.flushTriangles();
+            const size_t triangleCount = triDetail.getTriangles().size();
+            const auto end = std::chrono::high_resolution_clock::now();
+
+            std::cout << "Replaying " << session.first << ", " << operationCount << " operations took "
+                      << std::chrono::duration<double, std::milli>(end - start).count() << " ms "
+                      << (useTrivialCaseFilter ? "with" : "without") << " the trivial-case filter, "
+                      << triangleCount << " triangles" << std::endl;
+        }
+    }
+}
+
 TEST(TriangleDetail, UpdatePolysFromTriangles) {
     /**
      * Test that updating polygon sets from exact triangles preserves correct edge position
@@ -4,7 +4,11 @@
 namespace pepr3d {
 DataTriangleAABBPrimitive::Datum_reference DataTriangleAABBPrimitive::datum() const {
     const Geometry* geometry = idPair.first;
-    return geometry->getTriangle(idPair.second).getTri();
+    if(idPair.second.getDetailId()) {
+        return geometry->getDetailTriangle(idPair.second).getTri();
+    } else {
+        return geometry->getCgalTriangle(idPair.second.getBaseId());
+    }
 }
 
 DataTriangleAABBPrimitive::Point DataTriangleAABBPrimitive::reference_point() const {
@@ -39,7 +39,8 @@ struct DataTriangleAABBPrimitive {
     // CGAL types returned
     using Point = DataTriangle::K::Point_3;     // CGAL 3D point type
     using Datum = DataTriangle::K::Triangle_3;  // CGAL 3D triangle type
-    using Datum_reference = const DataTriangle::K::Triangle_3&;
+    // Returned by value, original triangles are not stored as CGAL types and are built on demand
+    using Datum_reference = DataTriangle::K::Triangle_3;
 
    private:
     Id idPair;
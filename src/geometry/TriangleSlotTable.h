@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cereal/cereal.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "peprassert.h"
+
+namespace pepr3d {
+
+/// Values attached to some of the original triangles, e.g. TriangleDetails.
+/// Every original triangle has an entry in a dense array with the slot of its value, so a lookup is a single array
+/// access. Values are stored contiguously in slots, slots of erased values are reused by later insertions.
+/// Iteration goes over the slots, not in the order of the triangles.
+/// Pointers and references to values are invalidated by insertions.
+template <typename Value>
+class TriangleSlotTable {
+    static constexpr uint32_t sNoSlot = std::numeric_limits<uint32_t>::max();
+    static constexpr size_t sNoTriangle = std::numeric_limits<size_t>::max();
+
+    template <bool IsConst>
+    class Iterator {
+        using Table = std::conditional_t<IsConst, const TriangleSlotTable, TriangleSlotTable>;
+        using ValueRef = std::conditional_t<IsConst, const Value&, Value&>;
+
+        Table* mTable;
+        size_t mSlot;
+
+        void skipFreeSlots() {
+            while(mSlot < mTable->mValues.size() && mTable->mTriangleOfSlot[mSlot] == sNoTriangle) {
+                ++mSlot;
+            }
+        }
+
+       public:
+        Iterator(Table* table, size_t slot) : mTable(table), mSlot(slot) {
+            skipFreeSlots();
+        }
+
+        /// Pair of the original triangle index and its value, the same as dereferencing a std::map iterator
+        std::pair<size_t, ValueRef> operator*() const {
+            return {mTable->mTriangleOfSlot[mSlot], mTable->mValues[mSlot]};
+        }
+
+        Iterator& operator++() {
+            ++mSlot;
+            skipFreeSlots();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return mSlot == other.mSlot;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return mSlot != other.mSlot;
+        }
+    };
+
+    /// Slot of the value of every original triangle, sNoSlot if it has none
+    std::vector<uint32_t> mSlotOfTriangle;
+
+    std::vector<Value> mValues;
+
+    /// Original triangle of every slot, sNoTriangle if the slot is free
+    std::vector<size_t> mTriangleOfSlot;
+
+    std::vector<uint32_t> mFreeSlots;
+
+   public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    /// Number of triangles with a value
+    size_t size() const {
+        return mValues.size() - mFreeSlots.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        mSlotOfTriangle.clear();
+        mValues.clear();
+        mTriangleOfSlot.clear();
+        mFreeSlots.clear();
+    }
+
+    bool contains(const size_t triangleIdx) const {
+        return triangleIdx < mSlotOfTriangle.size() && mSlotOfTriangle[triangleIdx] != sNoSlot;
+    }
+
+    /// @return value of the triangle, nullptr if it has none
+    Value* find(const size_t triangleIdx) {
+        return contains(triangleIdx) ? &mValues[mSlotOfTriangle[triangleIdx]] : nullptr;
+    }
+
+    const Value* find(const size_t triangleIdx) const {
+        return contains(triangleIdx) ? &mValues[mSlotOfTriangle[triangleIdx]] : nullptr;
+    }
+
+    Value& at(const size_t triangleIdx) {
+        if(!contains(triangleIdx)) {
+            throw std::out_of_range("Triangle " + std::to_string(triangleIdx) + " has no value in the slot table");
+        }
+        return mValues[mSlotOfTriangle[triangleIdx]];
+    }
+
+    const Value& at(const size_t triangleIdx) const {
+        return const_cast<TriangleSlotTable*>(this)->at(triangleIdx);
+    }
+
+    /// Insert the value for the triangle, unless it already has one
+    /// @return the value of the triangle, and whether it was inserted
+    std::pair<Value*, bool> emplace(const size_t triangleIdx, Value value) {
+        if(Value* existing = find(triangleIdx)) {
+            return {existing, false};
+        }
+
+        if(triangleIdx >= mSlotOfTriangle.size()) {
+            mSlotOfTriangle.resize(triangleIdx + 1, sNoSlot);
+        }
+
+        uint32_t slot;
+        if(!mFreeSlots.empty()) {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            mValues[slot] = std::move(value);
+            mTriangleOfSlot[slot] = triangleIdx;
+        } else {
+            P_ASSERT(mValues.size() < sNoSlot);
+            slot = static_cast<uint32_t>(mValues.size());
+            mValues.push_back(std::move(value));
+            mTriangleOfSlot.push_back(triangleIdx);
+        }
+
+        mSlotOfTriangle[triangleIdx] = slot;
+        return {&mValues[slot], true};
+    }
+
+    /// Set the value of the triangle, replacing the existing one
+    Value& insert_or_assign(const size_t triangleIdx, Value value) {
+        if(Value* existing = find(triangleIdx)) {
+            *existing = std::move(value);
+            return *existing;
+        }
+        return *emplace(triangleIdx, std::move(value)).first;
+    }
+
+    /// @return true if the triangle had a value
+    bool erase(const size_t triangleIdx) {
+        if(!contains(triangleIdx)) {
+            return false;
+        }
+
+        const uint32_t slot = mSlotOfTriangle[triangleIdx];
+        mSlotOfTriangle[triangleIdx] = sNoSlot;
+        mValues[slot] = Value();  // free the memory held by the value right away
+        mTriangleOfSlot[slot] = sNoTriangle;
+        mFreeSlots.push_back(slot);
+        return true;
+    }
+
+    iterator begin() {
+        return iterator(this, 0);
+    }
+
+    iterator end() {
+        return iterator(this, mValues.size());
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, mValues.size());
+    }
+
+    /// Saved the same way as std::map<size_t, Value> used to be, to keep old project files readable
+    template <class Archive>
+    void save(Archive& archive) const {
+        // Ordered by triangle, so that saving the same state always gives the same file
+        std::vector<size_t> triangles;
+        triangles.reserve(size());
+        for(const size_t triangleIdx : mTriangleOfSlot) {
+            if(triangleIdx != sNoTriangle) {
+                triangles.push_back(triangleIdx);
+            }
+        }
+        std::sort(triangles.begin(), triangles.end());
+
+        archive(cereal::make_size_tag(static_cast<cereal::size_type>(triangles.size())));
+        for(const size_t triangleIdx : triangles) {
+            archive(cereal::make_map_item(triangleIdx, at(triangleIdx)));
+        }
+    }
+
+    template <class Archive>
+    void load(Archive& archive) {
+        cereal::size_type valueCount;
+        archive(cereal::make_size_tag(valueCount));
+        clear();
+        mValues.reserve(static_cast<size_t>(valueCount));
+        mTriangleOfSlot.reserve(static_cast<size_t>(valueCount));
+        for(cereal::size_type i = 0; i < valueCount; ++i) {
+            size_t triangleIdx;
+            Value value;
+            archive(cereal::make_map_item(triangleIdx, value));
+            insert_or_assign(triangleIdx, std::move(value));
+        }
+    }
+};
+
+}  // namespace pepr3d
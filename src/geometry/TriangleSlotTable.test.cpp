@@ -0,0 +1,99 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/TriangleSlotTable.h"
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace pepr3d {
+
+template <typename Value>
+void expectSameValues(const std::map<size_t, Value>& expected, const TriangleSlotTable<Value>& table) {
+    ASSERT_EQ(table.size(), expected.size());
+    for(const auto& it : expected) {
+        ASSERT_TRUE(table.contains(it.first));
+        EXPECT_EQ(table.at(it.first), it.second);
+    }
+
+    std::map<size_t, Value> iterated;
+    for(const auto& it : table) {
+        EXPECT_TRUE(iterated.emplace(it.first, it.second).second);
+    }
+    EXPECT_EQ(iterated, expected);
+}
+
+TEST(TriangleSlotTable, InsertFindErase) {
+    TriangleSlotTable<std::string> table;
+    EXPECT_TRUE(table.empty());
+    EXPECT_FALSE(table.contains(5));
+    EXPECT_EQ(table.find(5), nullptr);
+    EXPECT_THROW(table.at(5), std::out_of_range);
+
+    EXPECT_TRUE(table.emplace(5, "five").second);
+    EXPECT_TRUE(table.emplace(2, "two").second);
+    EXPECT_FALSE(table.emplace(5, "other").second);
+    EXPECT_EQ(table.at(5), "five");
+    EXPECT_FALSE(table.contains(3));
+    EXPECT_FALSE(table.contains(100));
+
+    table.insert_or_assign(5, "FIVE");
+    EXPECT_EQ(*table.find(5), "FIVE");
+
+    EXPECT_TRUE(table.erase(5));
+    EXPECT_FALSE(table.erase(5));
+    EXPECT_FALSE(table.contains(5));
+    expectSameValues<std::string>({{2, "two"}}, table);
+
+    // The free slot is reused
+    table.emplace(7, "seven");
+    table.emplace(1, "one");
+    expectSameValues<std::string>({{1, "one"}, {2, "two"}, {7, "seven"}}, table);
+
+    table.clear();
+    EXPECT_TRUE(table.empty());
+    EXPECT_FALSE(table.contains(2));
+    EXPECT_TRUE(table.begin() == table.end());
+}
+
+TEST(TriangleSlotTable, SerializedAsMap) {
+    /**
+     * Test that the table reads and writes the same data as std::map<size_t, Value> used to
+     */
+
+    const std::map<size_t, std::string> values = {{0, "a"}, {3, "b"}, {4, "c"}, {1000, "d"}};
+
+    std::stringstream mapStream;
+    {
+        cereal::BinaryOutputArchive archive(mapStream);
+        archive(values);
+    }
+
+    TriangleSlotTable<std::string> table;
+    table.emplace(9, "removed before loading");
+    {
+        cereal::BinaryInputArchive archive(mapStream);
+        archive(table);
+    }
+    expectSameValues(values, table);
+
+    // Saved in the order of the triangles, regardless of the order of the slots
+    TriangleSlotTable<std::string> shuffled;
+    for(const size_t triangleIdx : {1000, 4, 0, 3}) {
+        shuffled.emplace(triangleIdx, values.at(triangleIdx));
+    }
+    std::stringstream tableStream;
+    {
+        cereal::BinaryOutputArchive archive(tableStream);
+        archive(shuffled);
+    }
+    EXPECT_EQ(tableStream.str(), mapStream.str());
+}
+
+}  // namespace pepr3d
+#endif
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cereal/cereal.hpp>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry/ColorManager.h"
+#include "geometry/GlmSerialization.h"
+#include "geometry/Triangle.h"
+#include "peprassert.h"
+
+namespace pepr3d {
+
+/// Triangle soup of the original model mesh, stored as separate packed arrays of positions, normals and colors.
+/// Original triangles are always created from float data, so keeping the positions as floats loses nothing, while
+/// taking about half the memory of a DataTriangle and none of its pointer chasing.
+/// CGAL triangles are only built on demand, e.g. for AABB tree queries.
+class TriangleStore {
+    /// Three vertices of every triangle
+    std::vector<glm::vec3> mPositions;
+
+    std::vector<glm::vec3> mNormals;
+
+    /// Color index of every triangle, there are never more than PEPR3D_MAX_PALETTE_COLORS colors
+    std::vector<uint8_t> mColors;
+
+    static_assert(PEPR3D_MAX_PALETTE_COLORS <= UINT8_MAX + 1, "Color indices have to fit into uint8_t");
+
+   public:
+    TriangleStore() = default;
+
+    explicit TriangleStore(const std::vector<DataTriangle>& triangles) {
+        reserve(triangles.size());
+        for(const DataTriangle& triangle : triangles) {
+            push_back(triangle);
+        }
+    }
+
+    size_t size() const {
+        return mColors.size();
+    }
+
+    bool empty() const {
+        return mColors.empty();
+    }
+
+    void reserve(const size_t triangleCount) {
+        mPositions.reserve(3 * triangleCount);
+        mNormals.reserve(triangleCount);
+        mColors.reserve(triangleCount);
+    }
+
+    /// Resize the store, new triangles are degenerate and have to be set before they are used
+    void resize(const size_t triangleCount) {
+        mPositions.resize(3 * triangleCount, glm::vec3(0));
+        mNormals.resize(triangleCount, glm::vec3(0));
+        mColors.resize(triangleCount, 0);
+    }
+
+    void clear() {
+        mPositions.clear();
+        mNormals.clear();
+        mColors.clear();
+    }
+
+    void emplace_back(const glm::vec3& x, const glm::vec3& y, const glm::vec3& z, const glm::vec3& normal,
+                      const size_t color) {
+        P_ASSERT(color <= UINT8_MAX);
+        mPositions.push_back(x);
+        mPositions.push_back(y);
+        mPositions.push_back(z);
+        mNormals.push_back(normal);
+        mColors.push_back(static_cast<uint8_t>(color));
+    }
+
+    void push_back(const DataTriangle& triangle) {
+        emplace_back(triangle.getVertex(0), triangle.getVertex(1), triangle.getVertex(2), triangle.getNormal(),
+                     triangle.getColor());
+    }
+
+    /// Replace the triangle at index, different triangles may be set from different threads
+    void set(const size_t triangleIdx, const glm::vec3& x, const glm::vec3& y, const glm::vec3& z,
+             const glm::vec3& normal, const size_t color) {
+        P_ASSERT(triangleIdx < size());
+        P_ASSERT(color <= UINT8_MAX);
+        mPositions[3 * triangleIdx] = x;
+        mPositions[3 * triangleIdx + 1] = y;
+        mPositions[3 * triangleIdx + 2] = z;
+        mNormals[triangleIdx] = normal;
+        mColors[triangleIdx] = static_cast<uint8_t>(color);
+    }
+
+    glm::vec3 getVertex(const size_t triangleIdx, const size_t vertexIdx) const {
+        P_ASSERT(triangleIdx < size() && vertexIdx < 3);
+        return mPositions[3 * triangleIdx + vertexIdx];
+    }
+
+    glm::vec3 getNormal(const size_t triangleIdx) const {
+        P_ASSERT(triangleIdx < size());
+        return mNormals[triangleIdx];
+    }
+
+    size_t getColor(const size_t triangleIdx) const {
+        P_ASSERT(triangleIdx < size());
+        return mColors[triangleIdx];
+    }
+
+    void setColor(const size_t triangleIdx, const size_t color) {
+        P_ASSERT(triangleIdx < size());
+        P_ASSERT(color <= UINT8_MAX);
+        mColors[triangleIdx] = static_cast<uint8_t>(color);
+    }
+
+    /// Build the CGAL triangle for geometric queries
+    DataTriangle::Triangle getCgalTriangle(const size_t triangleIdx) const {
+        const glm::vec3 x = getVertex(triangleIdx, 0);
+        const glm::vec3 y = getVertex(triangleIdx, 1);
+        const glm::vec3 z = getVertex(triangleIdx, 2);
+        return DataTriangle::Triangle(DataTriangle::Point(x.x, x.y, x.z), DataTriangle::Point(y.x, y.y, y.z),
+                                      DataTriangle::Point(z.x, z.y, z.z));
+    }
+
+    /// Build a DataTriangle with all data of the triangle
+    DataTriangle operator[](const size_t triangleIdx) const {
+        return DataTriangle(getVertex(triangleIdx, 0), getVertex(triangleIdx, 1), getVertex(triangleIdx, 2),
+                            getNormal(triangleIdx), getColor(triangleIdx));
+    }
+
+    /// Three vertices of every triangle, laid out the same way as in the OpenGL vertex buffer
+    const std::vector<glm::vec3>& getPositions() const {
+        return mPositions;
+    }
+
+    size_t getMemoryBytes() const {
+        return sizeof(TriangleStore) + mPositions.capacity() * sizeof(glm::vec3) +
+               mNormals.capacity() * sizeof(glm::vec3) + mColors.capacity() * sizeof(uint8_t);
+    }
+
+    /// Saved the same way as std::vector<DataTriangle> used to be, to keep old project files readable
+    template <class Archive>
+    void save(Archive& archive) const {
+        archive(cereal::make_size_tag(static_cast<cereal::size_type>(size())));
+        for(size_t i = 0; i < size(); ++i) {
+            archive((*this)[i]);
+        }
+    }
+
+    template <class Archive>
+    void load(Archive& archive) {
+        cereal::size_type triangleCount;
+        archive(cereal::make_size_tag(triangleCount));
+        clear();
+        reserve(static_cast<size_t>(triangleCount));
+        for(size_t i = 0; i < triangleCount; ++i) {
+            DataTriangle triangle;
+            archive(triangle);
+            push_back(triangle);
+        }
+    }
+};
+
+}  // namespace pepr3d
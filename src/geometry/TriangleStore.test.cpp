@@ -0,0 +1,80 @@
+#ifdef _TEST_
+#include <gtest/gtest.h>
+
+#include "geometry/TriangleStore.h"
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <sstream>
+#include <vector>
+
+namespace pepr3d {
+
+std::vector<DataTriangle> getStoreTestTriangles() {
+    std::vector<DataTriangle> triangles;
+    for(size_t i = 0; i < 100; ++i) {
+        const float offset = 0.25f * i;
+        triangles.emplace_back(glm::vec3(offset, 0, 0), glm::vec3(offset + 1, 0, 0.5f), glm::vec3(offset, 1, 0.1f),
+                               glm::normalize(glm::vec3(0.1f, 0.2f, 1)), i % PEPR3D_MAX_PALETTE_COLORS);
+    }
+    return triangles;
+}
+
+void expectSameTriangles(const std::vector<DataTriangle>& triangles, const TriangleStore& store) {
+    ASSERT_EQ(store.size(), triangles.size());
+    for(size_t i = 0; i < triangles.size(); ++i) {
+        EXPECT_EQ(store.getColor(i), triangles[i].getColor());
+        EXPECT_EQ(store.getNormal(i), triangles[i].getNormal());
+        EXPECT_EQ(store.getCgalTriangle(i), triangles[i].getTri());
+        for(size_t j = 0; j < 3; ++j) {
+            EXPECT_EQ(store.getVertex(i, j), triangles[i].getVertex(j));
+            EXPECT_EQ(store.getPositions()[3 * i + j], triangles[i].getVertex(j));
+        }
+    }
+}
+
+TEST(TriangleStore, MatchesDataTriangles) {
+    const std::vector<DataTriangle> triangles = getStoreTestTriangles();
+    TriangleStore store(triangles);
+    expectSameTriangles(triangles, store);
+
+    store.setColor(3, 7);
+    EXPECT_EQ(store.getColor(3), 7);
+    EXPECT_EQ(store[3].getColor(), 7);
+    EXPECT_EQ(store[4].getTri(), triangles[4].getTri());
+
+    // Positions, normals and colors take about half of a DataTriangle
+    EXPECT_LT(store.getMemoryBytes(), triangles.size() * sizeof(DataTriangle) * 6 / 10);
+}
+
+TEST(TriangleStore, SerializedAsVector) {
+    /**
+     * Test that the store reads and writes the same data as std::vector<DataTriangle> used to
+     */
+
+    const std::vector<DataTriangle> triangles = getStoreTestTriangles();
+
+    std::stringstream vectorStream;
+    {
+        cereal::BinaryOutputArchive archive(vectorStream);
+        archive(triangles);
+    }
+
+    TriangleStore store;
+    {
+        cereal::BinaryInputArchive archive(vectorStream);
+        archive(store);
+    }
+    expectSameTriangles(triangles, store);
+
+    std::stringstream storeStream;
+    {
+        cereal::BinaryOutputArchive archive(storeStream);
+        archive(store);
+    }
+    EXPECT_EQ(storeStream.str(), vectorStream.str());
+}
+
+}  // namespace pepr3d
+#endif
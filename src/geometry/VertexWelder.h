@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "geometry/PositionMap.h"
+
+namespace pepr3d {
+
+/// Joins vertices with identical positions, producing a vertex buffer without duplicates and indices into it.
+/// Replaces Assimp's aiProcess_JoinIdenticalVertices, so that a model does not need to be parsed twice.
+class VertexWelder {
+   public:
+    /// @param expectedVertices number of unique vertices expected, used to avoid rehashing
+    explicit VertexWelder(size_t expectedVertices = 0) {
+        mVertices.reserve(expectedVertices);
+        mLookup.reserve(expectedVertices);
+    }
+
+    /// Get index of the vertex at this position, adding it to the vertex buffer if it was not seen yet
+    size_t addVertex(const glm::vec3& position) {
+        // Adding zero turns -0.0 into 0.0, both have to end up in the same vertex
+        const glm::vec3 key(position.x + 0.0f, position.y + 0.0f, position.z + 0.0f);
+        const auto inserted = mLookup.emplace(key, mVertices.size());
+        if(inserted.second) {
+            mVertices.push_back(key);
+        }
+        return *inserted.first;
+    }
+
+    const std::vector<glm::vec3>& getVertices() const {
+        return mVertices;
+    }
+
+    /// Move the welded vertices out of the welder, leaving it empty
+    std::vector<glm::vec3> takeVertices() {
+        mLookup = PositionMap<size_t>();
+        return std::move(mVertices);
+    }
+
+   private:
+    PositionMap<size_t> mLookup;
+    std::vector<glm::vec3> mVertices;
+};
+
+}  // namespace pepr3d
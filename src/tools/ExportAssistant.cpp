@@ -1,4 +1,5 @@
 #include "tools/ExportAssistant.h"
+#include <algorithm>
 #include <random>
 #include <vector>
 #include "commands/CmdPaintSingleColor.h"
@@ -17,7 +18,6 @@ void ExportAssistant::drawToSidePane(SidePane& sidePane) {
     if(ImGui::RadioButton("Surfaces only", isSurfaceExport())) {
         mExportType = ExportType::Surface;
         validateExportType();
-        mScenes.clear();
         resetOverride();
         setOverride();
     }
@@ -173,6 +173,13 @@ void ExportAssistant::drawToSidePane(SidePane& sidePane) {
         }
         sidePane.drawTooltipOnHover("Export as separate .obj and .mtl files.", "",
                                     "This is a simple non-binary format supported by standard 3D editors.");
+        ImGui::SameLine();
+        if(ImGui::RadioButton(".3mf", mExportFileType == "3mf")) {
+            mExportFileType = "3mf";
+        }
+        sidePane.drawTooltipOnHover("Export as a single .3mf file with a separate object for every color.", "",
+                                    "This is a 3D printing format which keeps the colors of the objects, supported "
+                                    "by Slic3r Prusa Edition and other slicers.");
 
         ImGui::Checkbox("Create a new folder", &mShouldExportInNewFolder);
         sidePane.drawTooltipOnHover("If checked, a new separate folder will be created for the exported files.");
@@ -224,8 +231,9 @@ void ExportAssistant::onToolDeselect(ModelView& modelView) {
 void ExportAssistant::onNewGeometryLoaded(ModelView& modelView) {
     auto* const geometry = mApplication.getCurrentGeometry();
     assert(geometry != nullptr);
-    mExporter = std::make_unique<ModelExporter>(geometry, &geometry->getProgress());
-    mScenes.clear();
+    mExporter = std::make_unique<ModelExporter>(geometry, &geometry->getProgress(), MainApplication::getThreadPool());
+    mPreviews.clear();
+    mPreviewExportType.reset();
     if(mIsSelected) {
         resetOverride();
         updateSettings();
@@ -249,34 +257,50 @@ void ExportAssistant::setOverride() {
     auto* const geometry = mApplication.getCurrentGeometry();
     assert(geometry != nullptr);
 
-    uint32_t bufferOffset = 0;
-    for(auto& scene : mScenes) {
-        const size_t colorIndex = scene.first;
-        assert(mSettingsPerColor.size() > colorIndex);
-        if(!mSettingsPerColor[colorIndex].isShown) {
-            continue;
-        }
-        const glm::vec4 color = geometry->getColorManager().getColor(colorIndex);
-        aiScene* const sceneData = scene.second.get();
-        assert(sceneData->mNumMeshes == 1);
-        aiMesh* const mesh = sceneData->mMeshes[0];
-        for(size_t i = 0; i < mesh->mNumVertices; ++i) {
-            modelView.getOverrideColorBuffer().push_back(color);
-            modelView.getOverrideNormalBuffer().emplace_back(mesh->mNormals[i].x, mesh->mNormals[i].y,
-                                                             mesh->mNormals[i].z);
-            modelView.getOverrideVertexBuffer().emplace_back(mesh->mVertices[i].x, mesh->mVertices[i].y,
-                                                             mesh->mVertices[i].z);
-        }
-        for(size_t i = 0; i < mesh->mNumFaces; ++i) {
-            const aiFace face = mesh->mFaces[i];
-            assert(face.mNumIndices == 3);
-            modelView.getOverrideIndexBuffer().push_back(bufferOffset + face.mIndices[0]);
-            modelView.getOverrideIndexBuffer().push_back(bufferOffset + face.mIndices[1]);
-            modelView.getOverrideIndexBuffer().push_back(bufferOffset + face.mIndices[2]);
+    struct ShownPreview {
+        const ModelExporter::ExtrusionPreview* preview;
+        glm::vec4 color;
+        float depth;
+        size_t bufferOffset;
+    };
+
+    std::vector<ShownPreview> shownPreviews;
+    size_t vertexCount = 0;
+    if(!isSurfaceExport()) {
+        for(const auto& preview : mPreviews) {
+            const size_t colorIndex = preview.first;
+            assert(mSettingsPerColor.size() > colorIndex);
+            if(!mSettingsPerColor[colorIndex].isShown) {
+                continue;
+            }
+            const float depth = mExporter->getExtrusionDepth(mSettingsPerColor[colorIndex].depth / 100.0f);
+            shownPreviews.push_back(
+                {&preview.second, geometry->getColorManager().getColor(colorIndex), depth, vertexCount});
+            vertexCount += preview.second.vertices.size();
         }
-        bufferOffset += mesh->mNumVertices;
     }
 
+    // Every triangle has its own three vertices, so all buffers have the same size
+    std::vector<glm::vec4>& colorBuffer = modelView.getOverrideColorBuffer();
+    std::vector<glm::vec3>& normalBuffer = modelView.getOverrideNormalBuffer();
+    std::vector<glm::vec3>& vertexBuffer = modelView.getOverrideVertexBuffer();
+    std::vector<uint32_t>& indexBuffer = modelView.getOverrideIndexBuffer();
+    colorBuffer.resize(vertexCount);
+    normalBuffer.resize(vertexCount);
+    vertexBuffer.resize(vertexCount);
+    indexBuffer.resize(vertexCount);
+
+    MainApplication::getThreadPool().parallel_for(
+        shownPreviews.begin(), shownPreviews.end(), [&](const ShownPreview& shown) {
+            const ModelExporter::ExtrusionPreview& preview = *shown.preview;
+            const size_t offset = shown.bufferOffset;
+            preview.extrude(shown.depth, vertexBuffer.data() + offset);
+            std::copy(preview.normals.begin(), preview.normals.end(), normalBuffer.begin() + offset);
+            std::fill_n(colorBuffer.begin() + offset, preview.vertices.size(), shown.color);
+            std::transform(preview.indices.begin(), preview.indices.end(), indexBuffer.begin() + offset,
+                           [offset](uint32_t index) { return static_cast<uint32_t>(offset + index); });
+        });
+
     modelView.toggleMeshOverride(true);
     modelView.setPreviewMinMaxHeight(mPreviewMinMaxHeight);
 }
@@ -361,12 +385,26 @@ void ExportAssistant::exportFiles() {
 }
 
 void ExportAssistant::updateExtrusionPreview() {
+    auto* const commandManager = mApplication.getCommandManager();
+    assert(commandManager != nullptr);
+
+    // Only the depths changed since the last update, the cached previews are just extruded again
+    if(mPreviewExportType == mExportType && mLastVersionPreviewed == commandManager->getVersionNumber()) {
+        mIsPreviewUpToDate = true;
+        resetOverride();
+        setOverride();
+        return;
+    }
+
     mApplication.enqueueSlowOperation(
         [this]() {
             try {
                 prepareExport();
-                mScenes = mExporter->createScenes(mExportType);
+                mPreviews = mExporter->createExtrusionPreviews(mExportType);
+                mPreviewExportType = mExportType;
             } catch(std::exception& e) {
+                mPreviews.clear();
+                mPreviewExportType.reset();
                 pushErrorDialog(e.what());
                 updateSettings();
             }
@@ -404,8 +442,8 @@ void ExportAssistant::prepareExport() {
         mExporter->setExtrusionCoef(extrusionCoefs);
     }
 
-    if(!geometry->isTemporaryDetailedDataValid()) {
-        geometry->updateTemporaryDetailedData();
+    if(!geometry->isTemporaryDetailedDataValid() && !geometry->updateTemporaryDetailedData()) {
+        throw std::runtime_error("The detailed mesh of the painted model could not be built.");
     }
 }
 
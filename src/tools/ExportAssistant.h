@@ -49,8 +49,12 @@ class ExportAssistant : public Tool {
     bool mIsFirstFrame = true;
     bool mIsSelected = false;
 
-    /// Map of colors (color index) and Assimp scenes representing them
-    std::map<size_t, std::unique_ptr<aiScene>> mScenes;
+    /// Map of colors (color index) and their extruded objects shown in the preview.
+    /// Kept while the Geometry and the export type stay the same, changed depths only extrude them again.
+    std::map<size_t, ModelExporter::ExtrusionPreview> mPreviews;
+
+    /// Export type of mPreviews, none if there are no valid previews
+    std::optional<ExportType> mPreviewExportType;
 
     /// Export settings available for each color.
     struct SettingsPerColor {
@@ -1,4 +1,5 @@
 #include "tools/PaintBucket.h"
+#include <memory>
 #include "commands/CmdPaintSingleColor.h"
 #include "ui/MainApplication.h"
 
@@ -68,7 +69,11 @@ void PaintBucket::onToolSelect(ModelView &modelView) {
         return;
     }
     if(!geometry->isTemporaryDetailedDataValid()) {
-        mApplication.enqueueSlowOperation([geometry]() { geometry->updateTemporaryDetailedData(); }, []() {}, true);
+        // The result is read back in the main thread, where the tool reads mGeometryCorrect
+        auto isBuilt = std::make_shared<bool>(false);
+        mApplication.enqueueSlowOperation(
+            [geometry, isBuilt]() { *isBuilt = geometry->updateTemporaryDetailedData(); },
+            [this, isBuilt]() { mGeometryCorrect = *isBuilt; }, true);
     }
 }
 
@@ -125,7 +130,12 @@ void PaintBucket::onModelViewMouseDown(ModelView &modelView, ci::app::MouseEvent
     std::vector<DetailedTriangleId> trianglesToPaint;
 
     try {
-        trianglesToPaint = geometry->bucket(*hoveredTriangleId, combinedCriterion);
+        if(mDoNotStop) {
+            // Whole connected component, no need to evaluate any criterion
+            trianglesToPaint = geometry->getConnectedComponent(*hoveredTriangleId);
+        } else {
+            trianglesToPaint = geometry->bucket(*hoveredTriangleId, combinedCriterion);
+        }
     } catch(std::exception &e) {
         const std::string errorCaption = "Error: Failed to bucket paint";
         const std::string errorDescription =
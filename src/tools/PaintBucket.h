@@ -73,7 +73,7 @@ class PaintBucket : public Tool {
         ColorStopping(const Geometry* g) : geo(g) {}
 
         bool operator()(const DetailedTriangleId a, const DetailedTriangleId b) const {
-            if(geo->getTriangle(a).getColor() == geo->getTriangle(b).getColor()) {
+            if(geo->getTriangleColor(a) == geo->getTriangleColor(b)) {
                 return true;
             } else {
                 return false;
@@ -99,11 +99,11 @@ class PaintBucket : public Tool {
 
             double cosAngle = 0.0;
             if(angleCompare == NormalAngleCompare::ABSOLUTE) {
-                const auto& newNormal = geo->getTriangle(a).getNormal();
+                const glm::vec3 newNormal = geo->getTriangleNormal(a.getBaseId());
                 cosAngle = glm::dot(glm::normalize(newNormal), glm::normalize(startNormal));
             } else if(angleCompare == NormalAngleCompare::NEIGHBOURS) {
-                const auto& newNormal1 = geo->getTriangle(a).getNormal();
-                const auto& newNormal2 = geo->getTriangle(b).getNormal();
+                const glm::vec3 newNormal1 = geo->getTriangleNormal(a.getBaseId());
+                const glm::vec3 newNormal2 = geo->getTriangleNormal(b.getBaseId());
                 cosAngle = glm::dot(glm::normalize(newNormal1), glm::normalize(newNormal2));
             } else {
                 assert(false);
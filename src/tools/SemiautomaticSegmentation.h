@@ -77,6 +77,8 @@ class SemiautomaticSegmentation : public Tool {
 
     /// A segmentation criterion that stops when angles of normals are too different
     struct NormalStopping {
+        static constexpr bool isPure = true;
+
         const Geometry* geo;
         const double threshold;
 
@@ -84,8 +86,8 @@ class SemiautomaticSegmentation : public Tool {
 
         bool operator()(const size_t a, const size_t b) const {
             double cosAngle = 0.0;
-            const auto& newNormal1 = geo->getTriangle(a).getNormal();
-            const auto& newNormal2 = geo->getTriangle(b).getNormal();
+            const glm::vec3 newNormal1 = geo->getTriangleNormal(a);
+            const glm::vec3 newNormal2 = geo->getTriangleNormal(b);
             cosAngle = glm::dot(glm::normalize(newNormal1), glm::normalize(newNormal2));
 
             if(cosAngle < threshold) {
@@ -98,6 +100,8 @@ class SemiautomaticSegmentation : public Tool {
 
     /// A segmentation criterion that stops when SDF values are too different
     struct SDFStopping {
+        static constexpr bool isPure = true;
+
         const Geometry* const geo;
         double maximumDifference;
         bool areEdgesHard;
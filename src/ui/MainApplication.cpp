@@ -41,11 +41,11 @@ using namespace ci::app;
 using namespace std;
 
 namespace pepr3d {
-// At least 2 threads in thread pool must be created!
-// There are several occasions in which we enqueue a new task from inside a thread pool.
-// If there was only 1 thread in the pool, the tasks would never finish causing a deadlock.
+// One worker for every core except the one running the main thread.
+// Tasks enqueue more tasks and wait for them, e.g. loading a model or parallel_for inside a slow operation. Waiting
+// workers run the queued tasks themselves (ThreadPool::wait), so even a single worker does not deadlock.
 // Note: std::thread::hardware_concurrency() may return 0
-::ThreadPool MainApplication::sThreadPool(std::max<size_t>(3, std::thread::hardware_concurrency()) - 1);
+::ThreadPool MainApplication::sThreadPool(std::max<size_t>(2, std::thread::hardware_concurrency()) - 1);
 
 MainApplication::MainApplication() : mFontStorage{}, mToolbar(*this), mSidePane(*this), mModelView(*this) {}
 
@@ -89,6 +89,7 @@ void MainApplication::setup() {
     }
 
     mCommandManager = std::make_unique<CommandManager<Geometry>>(*mGeometry);
+    mCommandManager->setMemoryBudget(sUndoHistoryBudgetBytes, sUndoSpillBudgetBytes);
 
     mTools.emplace_back(make_unique<TrianglePainter>(*this));
     mTools.emplace_back(make_unique<PaintBucket>(*this));
@@ -313,6 +314,7 @@ void MainApplication::openFile(const std::string& path) {
         mShouldSaveAs = true;
         mIsGeometryDirty = false;
         mCommandManager = std::make_unique<CommandManager<Geometry>>(*mGeometry);
+        mCommandManager->setMemoryBudget(sUndoHistoryBudgetBytes, sUndoSpillBudgetBytes);
         fs::path fsPath(path);
         getWindow()->setTitle(fsPath.stem().string() + std::string(" - Pepr3D"));
         mProgressIndicator.setGeometryInProgress(nullptr);
@@ -336,6 +336,12 @@ class MainApplication : public cinder::app::App {
         mGeometryInProgress;  // used for async loading of Geometry, is nullptr if nothing is being loaded
     std::unique_ptr<CommandManager<Geometry>> mCommandManager;
 
+    /// Memory the undo history may use before older snapshots are spilled to the disk
+    static const size_t sUndoHistoryBudgetBytes = size_t(1) << 30;
+
+    /// Disk space the spilled snapshots may use before the oldest undo steps are dropped
+    static const size_t sUndoSpillBudgetBytes = size_t(4) << 30;
+
     std::string mGeometryFileName;
     bool mShouldSaveAs = true;
     std::size_t mLastVersionSaved = std::numeric_limits<std::size_t>::max();
@@ -164,16 +164,16 @@ void ModelView::initOverrideFromBasicGeoemtry() {
     overrideIndexBuffer.clear();
     const size_t triCount = geometry->getTriangleCount();
     for(size_t i = 0; i < triCount; ++i) {
-        const DataTriangle& tri = geometry->getTriangle(i);
-        overrideVertexBuffer.push_back(tri.getVertex(0));
-        overrideVertexBuffer.push_back(tri.getVertex(1));
-        overrideVertexBuffer.push_back(tri.getVertex(2));
+        overrideVertexBuffer.push_back(geometry->getTriangleVertex(i, 0));
+        overrideVertexBuffer.push_back(geometry->getTriangleVertex(i, 1));
+        overrideVertexBuffer.push_back(geometry->getTriangleVertex(i, 2));
 
-        overrideNormalBuffer.push_back(tri.getNormal());
-        overrideNormalBuffer.push_back(tri.getNormal());
-        overrideNormalBuffer.push_back(tri.getNormal());
+        const glm::vec3 triNormal = geometry->getTriangleNormal(i);
+        overrideNormalBuffer.push_back(triNormal);
+        overrideNormalBuffer.push_back(triNormal);
+        overrideNormalBuffer.push_back(triNormal);
 
-        const glm::vec4 triColor = geometry->getColorManager().getColor(geometry->getTriangle(i).getColor());
+        const glm::vec4 triColor = geometry->getColorManager().getColor(geometry->getTriangleColor(i));
         overrideColorBuffer.push_back(triColor);
         overrideColorBuffer.push_back(triColor);
         overrideColorBuffer.push_back(triColor);
@@ -349,7 +349,8 @@ void ModelView::drawGeometry() {
 }
 
 void ModelView::drawTriangleHighlight(const DetailedTriangleId triangleId) {
-    const Geometry* const geometry = mApplication.getCurrentGeometry();
+    // Not const, counting the detail triangles triangulates the detail if it was painted since
+    Geometry* const geometry = mApplication.getCurrentGeometry();
     if(geometry == nullptr || triangleId.getBaseId() >= geometry->getTriangleCount()) {
         return;
     }